@@ -7,6 +7,7 @@
 //
 
 #import "AutoModel.h"
+#import "AutoModelRelation.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -18,6 +19,10 @@ NS_ASSUME_NONNULL_BEGIN
 @property NSString *name;
 @end
 
+@interface AutoJoinChild : AutoModel
+@property NSString *name;
+@end
+
 @interface AutoParent : AutoModel
 
 @property NSString *name;
@@ -27,6 +32,15 @@ NS_ASSUME_NONNULL_BEGIN
 
 @property NSString *manyChildIds;
 @property NSMutableArray <__kindof AutoModel*> *manyChildren;
+@property AutoDBSet <AutoJoinChild*> *joinedChildren;
+
+@end
+
+///Loads its relations on first access
+@interface AutoFaultParent : AutoModel
+
+@property NSString *name;
+@property AutoDBSet <AutoJoinChild*> *joinedChildren;
 
 @end
 
@@ -35,6 +49,8 @@ NS_ASSUME_NONNULL_BEGIN
 @property NSString *name;
 @property uint64_t parent_id;
 @property (weak) AutoParent *parent;
+@property uint64_t strong_child_id;
+@property AutoStrongChild *strong_child;
 
 @end
 
@@ -18,21 +18,43 @@
 		AUTO_RELATIONS_STRONG_OBJECT_KEY : @{ @"AutoStrongChild" : @"strong_child" },
 		AUTO_RELATIONS_MANY_ID_KEY : @{ @"AutoManyChild" : @"manyChildIds" },
 		AUTO_RELATIONS_MANY_CONTAINER_KEY : @{ @"AutoManyChild" : @"manyChildren" },
+		AUTO_RELATIONS_MANY_JOIN_KEY : @{ @"AutoJoinChild" : @"joinedChildren" },
 	};
 }
 
 @end
 
+@implementation AutoFaultParent
+
++ (NSDictionary*) relations
+{
+	return @{ AUTO_RELATIONS_MANY_JOIN_KEY : @{ @"AutoJoinChild" : @"joinedChildren" } };
+}
+
++ (BOOL) faultRelations
+{
+	return YES;
+}
+
+@end
+
 @implementation AutoChild
 
 + (NSDictionary*) relations
 {
   	return @{
 	  	AUTO_RELATIONS_PARENT_ID_KEY : @{ @"AutoParent" : @"parent_id"},
+		AUTO_RELATIONS_STRONG_ID_KEY : @{ @"AutoStrongChild" : @"strong_child_id" },
+		AUTO_RELATIONS_STRONG_OBJECT_KEY : @{ @"AutoStrongChild" : @"strong_child" },
 		//AUTO_RELATIONS_PARENT_OBJECT_KEY : @{ @"AutoParent" : @"parent" }
 	};
 }
 
++ (NSDictionary*) columnIndex
+{
+	return @{ AUTO_INDEX_SPECIFIC : @[@"parent_id, name", @"(lower(name)) WHERE parent_id != 0", @"strong_child_id, name WHERE strong_child_id != 0", @"(length(name)), parent_id", @"(parent_id + strong_child_id), name WHERE name IS NOT NULL"] };
+}
+
 @end
 
 @implementation AutoStrongChild
@@ -40,3 +62,6 @@
 
 @implementation AutoManyChild
 @end
+
+@implementation AutoJoinChild
+@end
@@ -76,7 +76,7 @@ static NSMutableArray *idArray;
 
 + (void) printMigrateState:(MigrationState) state willMigrateTables:(NSMutableSet * _Nullable) willMigrateTables errors:(NSArray *)errors
 {
-	NSArray <NSString*> *stateStrings = @[@"MigrationStateError", @"MigrationStateStart", @"MigrationStateComplete"];
+	NSArray <NSString*> *stateStrings = @[@"MigrationStateError", @"MigrationStateStart", @"MigrationStateComplete", @"MigrationStateProgress", @"MigrationStateFileComplete"];
 	NSMutableString *logString = stateStrings[state].mutableCopy;
 	if (willMigrateTables)
 		[logString appendFormat:@" tables: %@", willMigrateTables];
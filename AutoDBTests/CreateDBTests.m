@@ -11,6 +11,7 @@
 #import "ConcurrencyModel.h"
 #import "SecondModel.h"
 #import "AutoParent.h"
+#import "ValueHandling.h"
 #import "AutoDB.h"
 
 @interface CreateDBTests : XCTestCase
@@ -35,7 +36,7 @@ static NSString* testString = @"hello test string!";
 
 - (void) printMigrateState:(MigrationState) state willMigrateTables:(NSMutableSet * _Nullable) willMigrateTables errors:(NSArray *)errors
 {
-	NSArray <NSString*> *stateStrings = @[@"MigrationStateError", @"MigrationStateStart", @"MigrationStateComplete"];
+	NSArray <NSString*> *stateStrings = @[@"MigrationStateError", @"MigrationStateStart", @"MigrationStateComplete", @"MigrationStateProgress", @"MigrationStateFileComplete"];
 	NSMutableString *logString = stateStrings[state].mutableCopy;
 	if (willMigrateTables)
 		[logString appendFormat:@" tables: %@", willMigrateTables];
@@ -44,6 +45,24 @@ static NSString* testString = @"hello test string!";
 	NSLog(@"%@", logString);
 }
 
+///Create the files the way RelationTests does and wait until every table is set up.
+- (void) createDatabaseWithRelations
+{
+	NSString *supportPath = [[NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES) objectAtIndex:0] stringByAppendingPathComponent:@"auto"];
+	NSString *concurrency = [supportPath stringByAppendingPathComponent:@"concurrency.sqlite3"];
+	NSString *second = [supportPath stringByAppendingPathComponent:@"second.sqlite3"];
+	NSString *standard = [supportPath stringByAppendingPathComponent:@"standard.sqlite3"];
+	NSDictionary *paths = @{ concurrency : @[@"AutoParent", @"AutoFaultParent", @"ConcurrencyModel"], second : @[@"AutoChild", @"AutoStrongChild", @"SecondModel", @"ValueHandling"], standard: @[@"AutoManyChild", @"AutoJoinChild"]};
+	
+	[[AutoDB sharedInstance] createDatabaseWithPathsForClasses:paths migrateBlock:^(MigrationState state, NSMutableSet * _Nullable willMigrateTables, NSArray *errors)
+	{
+		[self printMigrateState:state willMigrateTables:willMigrateTables errors:errors];
+		if (state == MigrationStateComplete)
+			[self->expect fulfill];
+	}];
+	[self waitForExpectationsWithTimeout:10.0 handler:nil];
+}
+
 //WAIT_FOR_SETUP has been removed since we have dedicated threads. Do the new system work?
 - (void)testWaitForSetup
 {
@@ -123,6 +142,192 @@ static NSString* testString = @"hello test string!";
 	[[AutoDB sharedInstance] destroyDatabase];
 }
 
+- (void) testLazyTableSetup
+{
+	NSString *supportPath = [[NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES) objectAtIndex:0] stringByAppendingPathComponent:@"auto"];
+	NSString *concurrency = [supportPath stringByAppendingPathComponent:@"concurrency.sqlite3"];
+	NSString *second = [supportPath stringByAppendingPathComponent:@"second.sqlite3"];
+	NSDictionary *paths = @{ concurrency : @[@"AutoParent", @"ConcurrencyModel"], second : @[@"AutoChild", @"AutoStrongChild", @"SecondModel", @"ValueHandling"]};
+	
+	//forget the stored schemas, so all tables must be created and checked again
+	[[AutoDB sharedInstance] destroyDatabase];
+	for (NSString *path in paths)
+	{
+		AFMDatabase *db = [AFMDatabase databaseWithPath:path];
+		[db open];
+		[db executeUpdate:@"DROP TABLE IF EXISTS auto_db_metadata"];
+		[db close];
+	}
+	
+	__block NSSet *checkedTables = nil;
+	NSMutableArray <NSSet*>*completedFiles = [NSMutableArray new];
+	[[AutoDB sharedInstance] createDatabaseWithPathsForClasses:paths migrateBlock:^(MigrationState state, NSMutableSet * _Nullable willMigrateTables, NSArray *errors)
+	{
+		[self printMigrateState:state willMigrateTables:willMigrateTables errors:errors];
+		if (state == MigrationStateStart)
+			checkedTables = willMigrateTables.copy;
+		if (state == MigrationStateFileComplete)
+		{
+			@synchronized (completedFiles)
+			{
+				[completedFiles addObject:willMigrateTables.copy];
+			}
+		}
+		if (state == MigrationStateComplete)
+		{
+			XCTAssertNil(errors);
+			[self->expect fulfill];
+		}
+	}];
+	
+	//the first use sets up the table, the rest are set up in the background.
+	SecondModel *model = [SecondModel createInstanceWithId:1];
+	model.string = testString;
+	XCTAssertNil([model save]);
+	SecondModel *result = [SecondModel fetchIds:@[@1]].rows.firstObject;
+	XCTAssertEqualObjects(result.string, testString);
+	[[AutoDB sharedInstance] setupTableIfNeeded:ValueHandling.class];
+	
+	[self waitForExpectationsWithTimeout:10.0 handler:nil];
+	XCTAssertEqualObjects(checkedTables, [NSSet setWithArray:@[@"AutoParent", @"ConcurrencyModel", @"AutoChild", @"AutoStrongChild", @"SecondModel", @"ValueHandling"]]);
+	XCTAssertEqual([SecondModel setupPriority], 0);
+	//files are set up concurrently, each one reports when it is done
+	XCTAssertEqual(completedFiles.count, 2);
+	XCTAssertTrue([completedFiles containsObject:[NSSet setWithArray:paths[second]]]);
+}
+
+- (void) testResumeInterruptedMigration
+{
+	NSString *supportPath = [[NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES) objectAtIndex:0] stringByAppendingPathComponent:@"auto"];
+	NSString *concurrency = [supportPath stringByAppendingPathComponent:@"concurrency.sqlite3"];
+	NSString *second = [supportPath stringByAppendingPathComponent:@"second.sqlite3"];
+	NSDictionary *paths = @{ concurrency : @[@"AutoParent", @"ConcurrencyModel"], second : @[@"AutoChild", @"AutoStrongChild", @"SecondModel", @"ValueHandling"]};
+	
+	[[AutoDB sharedInstance] createDatabaseWithPathsForClasses:paths migrateBlock:nil];
+	NSMutableArray *models = [NSMutableArray new];
+	for (NSUInteger index = 1; index < 12; index++)
+	{
+		SecondModel *model = [SecondModel createInstanceWithId:index];
+		model.string = testString;
+		[models addObject:model];
+	}
+	XCTAssertNil([SecondModel save:models]);
+	models = nil;
+	[[AutoDB sharedInstance] destroyDatabase];
+	
+	//pretend the app died while copying SecondModel, after the first rows
+	AFMDatabase *db = [AFMDatabase databaseWithPath:second];
+	[db open];
+	NSMutableArray *columns = [NSMutableArray new];
+	AFMResultSet *result = [db executeQuery:@"PRAGMA table_info(SecondModel)"];
+	while ([result next])
+		[columns addObject:[result stringForColumnIndex:1]];
+	[result close];
+	NSString *columnString = [columns componentsJoinedByString:@","];
+	[db executeUpdate:@"DROP TABLE IF EXISTS auto_db_metadata"];
+	[db executeUpdate:@"CREATE TABLE IF NOT EXISTS auto_migration_progress (table_name TEXT PRIMARY KEY, last_id INTEGER NOT NULL, old_columns TEXT NOT NULL, new_columns TEXT NOT NULL, convert_columns TEXT NOT NULL, row_count INTEGER NOT NULL, copied INTEGER NOT NULL)"];
+	result = [db executeQuery:@"SELECT sql FROM sqlite_master WHERE name = 'SecondModel'"];
+	[result next];
+	NSString *createCopy = [[result stringForColumnIndex:0] stringByReplacingOccurrencesOfString:@"SecondModel" withString:@"SecondModel_auto_migrating"];
+	[result close];
+	[db executeUpdate:createCopy];
+	[db executeUpdate:@"INSERT INTO SecondModel_auto_migrating SELECT * FROM SecondModel WHERE id <= 5"];
+	[db executeUpdate:@"INSERT OR REPLACE INTO auto_migration_progress VALUES ('SecondModel', 5, ?, ?, '', 11, 5)", columnString, columnString];
+	[db close];
+	
+	[[AutoDB sharedInstance] createDatabaseWithPathsForClasses:paths migrateBlock:^(MigrationState state, NSMutableSet * _Nullable willMigrateTables, NSArray *errors)
+	{
+		[self printMigrateState:state willMigrateTables:willMigrateTables errors:errors];
+		if (state == MigrationStateComplete)
+		{
+			XCTAssertNil(errors);
+			XCTAssertTrue([willMigrateTables containsObject:@"SecondModel"]);
+			[self->expect fulfill];
+		}
+	}];
+	[self waitForExpectationsWithTimeout:10.0 handler:nil];
+	
+	[SecondModel inDatabase:^(AFMDatabase * _Nonnull db) {
+		
+		AFMResultSet *result = [db executeQuery:@"SELECT count(*) FROM auto_migration_progress"];
+		XCTAssertTrue([result next]);
+		XCTAssertEqual([result intForColumnIndex:0], 0, @"migration marker is not removed");
+		[result close];
+		result = [db executeQuery:@"SELECT name FROM sqlite_master WHERE name = 'SecondModel_auto_migrating'"];
+		XCTAssertFalse([result next], @"the copy is not renamed");
+		[result close];
+	}];
+	NSArray <SecondModel*>*rows = [SecondModel fetchQuery:@"WHERE id <= 11" arguments:nil].rows;
+	XCTAssertEqual(rows.count, 11);
+	XCTAssertEqualObjects(rows.lastObject.string, testString);
+}
+
+- (void) testReadsDuringCopy
+{
+	NSString *supportPath = [[NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES) objectAtIndex:0] stringByAppendingPathComponent:@"auto"];
+	NSString *concurrency = [supportPath stringByAppendingPathComponent:@"concurrency.sqlite3"];
+	NSString *second = [supportPath stringByAppendingPathComponent:@"second.sqlite3"];
+	NSDictionary *paths = @{ concurrency : @[@"AutoParent", @"ConcurrencyModel"], second : @[@"AutoChild", @"AutoStrongChild", @"SecondModel", @"ValueHandling"]};
+	
+	[[AutoDB sharedInstance] createDatabaseWithPathsForClasses:paths migrateBlock:nil];
+	NSMutableArray *models = [NSMutableArray new];
+	for (NSUInteger index = 1; index < 12; index++)
+	{
+		SecondModel *model = [SecondModel createInstanceWithId:index];
+		model.string = testString;
+		[models addObject:model];
+	}
+	XCTAssertNil([SecondModel save:models]);
+	models = nil;
+	[SecondModel inDatabase:^(AFMDatabase * _Nonnull db) {
+		
+		[db executeUpdate:@"DELETE FROM SecondModel WHERE id = 12"];
+	}];
+	[[AutoDB sharedInstance] destroyDatabase];
+	
+	//a column the model doesn't have makes SecondModel be copied into a new table
+	AFMDatabase *db = [AFMDatabase databaseWithPath:second];
+	[db open];
+	[db executeUpdate:@"DROP TABLE IF EXISTS auto_db_metadata"];
+	[db executeUpdate:@"ALTER TABLE SecondModel ADD removed_column INTEGER NOT NULL DEFAULT 0"];
+	[db close];
+	
+	__block BOOL hasUsedTable = NO;
+	[[AutoDB sharedInstance] createDatabaseWithPathsForClasses:paths migrateBlock:^(MigrationState state, NSMutableSet * _Nullable willMigrateTables, NSArray *errors)
+	{
+		[self printMigrateState:state willMigrateTables:willMigrateTables errors:errors];
+		if (state == MigrationStateProgress && [willMigrateTables containsObject:@"SecondModel"] && hasUsedTable == NO)
+		{
+			//the copy is not done, but the table can be read and written
+			hasUsedTable = YES;
+			NSArray <SecondModel*>*rows = [SecondModel fetchQuery:@"WHERE id <= 11" arguments:nil].rows;
+			XCTAssertEqual(rows.count, 11);
+			SecondModel *model = [SecondModel createInstanceWithId:12];
+			model.string = testString;
+			XCTAssertNil([SecondModel save:@[model]]);
+		}
+		if (state == MigrationStateComplete)
+		{
+			XCTAssertNil(errors);
+			[self->expect fulfill];
+		}
+	}];
+	[self waitForExpectationsWithTimeout:10.0 handler:nil];
+	XCTAssertTrue(hasUsedTable);
+	
+	//the row written during the copy made it into the new table
+	[SecondModel inDatabase:^(AFMDatabase * _Nonnull db) {
+		
+		AFMResultSet *result = [db executeQuery:@"SELECT count(*) FROM SecondModel WHERE id <= 12"];
+		XCTAssertTrue([result next]);
+		XCTAssertEqual([result intForColumnIndex:0], 12);
+		[result close];
+		result = [db executeQuery:@"SELECT removed_column FROM SecondModel"];
+		XCTAssertNil(result, @"the table is not replaced");
+		[result close];
+	}];
+}
+
 - (void) testMigrationMoveTable
 {
 	NSString *supportPath = [[NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES) objectAtIndex:0] stringByAppendingPathComponent:@"auto"];
@@ -182,4 +387,184 @@ static NSString* testString = @"hello test string!";
 	[self waitForExpectationsWithTimeout:99916.0 handler:nil];
 }
 
+- (void) testSpecificIndexes
+{
+	[self createDatabaseWithRelations];
+	
+	[AutoChild inDatabase:^(AFMDatabase * _Nonnull db) {
+		
+		NSMutableArray *definitions = [NSMutableArray new];
+		AFMResultSet *result = [db executeQuery:@"SELECT sql FROM sqlite_master WHERE type = 'index' AND tbl_name = 'AutoChild' AND name LIKE 'AutoChild_auto_index_%'"];
+		while ([result next])
+		{
+			[definitions addObject:[result stringForColumnIndex:0]];
+		}
+		[result close];
+		XCTAssertEqual(definitions.count, 5, @"Specific indexes were not created: %@", definitions);
+		//the shorthand of a partial index only wraps its columns.
+		result = [db executeQuery:@"SELECT count(*) FROM sqlite_master WHERE type = 'index' AND tbl_name = 'AutoChild' AND sql LIKE '%ON AutoChild (strong_child_id, name) WHERE strong_child_id != 0'"];
+		XCTAssertTrue([result next]);
+		XCTAssertEqual([result intForColumnIndex:0], 1, @"Wrong partial index: %@", definitions);
+		[result close];
+		//a list that only starts with an expression is still wrapped.
+		result = [db executeQuery:@"SELECT count(*) FROM sqlite_master WHERE type = 'index' AND tbl_name = 'AutoChild' AND sql LIKE '%ON AutoChild ((length(name)), parent_id)'"];
+		XCTAssertTrue([result next]);
+		XCTAssertEqual([result intForColumnIndex:0], 1, @"Wrong expression index: %@", definitions);
+		[result close];
+		result = [db executeQuery:@"SELECT count(*) FROM sqlite_master WHERE type = 'index' AND tbl_name = 'AutoChild' AND sql LIKE '%ON AutoChild ((parent_id + strong_child_id), name) WHERE name IS NOT NULL'"];
+		XCTAssertTrue([result next]);
+		XCTAssertEqual([result intForColumnIndex:0], 1, @"Wrong partial expression index: %@", definitions);
+		[result close];
+		
+		//the composite index should be used for this query, without sorting in a temp b-tree.
+		NSMutableString *plan = [NSMutableString new];
+		result = [db executeQuery:@"EXPLAIN QUERY PLAN SELECT id FROM AutoChild WHERE parent_id = ? ORDER BY name", @1];
+		while ([result next])
+		{
+			[plan appendString:[result stringForColumn:@"detail"]];
+		}
+		[result close];
+		XCTAssertTrue([plan containsString:@"AutoChild_auto_index_"], @"Wrong plan: %@", plan);
+		XCTAssertFalse([plan containsString:@"TEMP B-TREE"], @"Wrong plan: %@", plan);
+	}];
+}
+
+- (void) testKeysetPaging
+{
+	[self createDatabaseWithRelations];
+	[AutoChild inDatabase:^(AFMDatabase * _Nonnull db) {
+		[db executeUpdate:@"DELETE FROM AutoChild"];
+	}];
+	
+	NSUInteger childCount = 250;
+	NSMutableArray *newChildren = [NSMutableArray new];
+	for (NSUInteger index = 1; index < childCount + 1; index++)
+	{
+		AutoChild *child = [AutoChild createInstanceWithId:index];
+		//give many the same name, so the id must break ties.
+		child.name = [NSString stringWithFormat:@"child %i", (int)(index % 20)];
+		child.parent_id = 1;
+		[newChildren addObject:child];
+	}
+	[AutoChild save:newChildren];
+	
+	AutoPageCursor *cursor = [AutoPageCursor cursorWithSortColumn:@"name" ascending:YES pageSize:100 condition:@"parent_id = ?" arguments:@[@1]];
+	NSMutableArray <AutoChild*>*fetched = [NSMutableArray new];
+	NSUInteger pages = 0;
+	AutoResult *page;
+	while ((page = [AutoChild fetchNextPage:cursor]))
+	{
+		[fetched addObjectsFromArray:page.rows];
+		pages++;
+	}
+	XCTAssertEqual(pages, 3);
+	XCTAssertTrue(cursor.isAtEnd);
+	XCTAssertEqual(fetched.count, childCount);
+	XCTAssertEqual([NSSet setWithArray:fetched].count, childCount, @"Paging returned duplicates");
+	for (NSUInteger index = 1; index < fetched.count; index++)
+	{
+		AutoChild *previous = fetched[index - 1], *current = fetched[index];
+		NSComparisonResult order = [previous.name compare:current.name];
+		XCTAssertTrue(order == NSOrderedAscending || (order == NSOrderedSame && previous.id < current.id), @"Wrong order at %i", (int)index);
+	}
+	
+	//continue from an archived cursor
+	AutoPageCursor *descending = [AutoPageCursor cursorWithSortColumn:@"id" ascending:NO pageSize:10 condition:nil arguments:nil];
+	[AutoChild fetchNextPage:descending];
+	NSData *token = [NSKeyedArchiver archivedDataWithRootObject:descending requiringSecureCoding:YES error:nil];
+	AutoPageCursor *restored = [NSKeyedUnarchiver unarchivedObjectOfClass:AutoPageCursor.class fromData:token error:nil];
+	XCTAssertEqualObjects(restored.lastId, @(childCount - 9));
+	AutoChild *first = [AutoChild fetchNextPage:restored].rows.firstObject;
+	XCTAssertEqual(first.id, childCount - 10);
+}
+
+- (void) testQueryPlanInspector
+{
+	[self createDatabaseWithRelations];
+	
+	AFMQueryPlanInspector *inspector = [AFMQueryPlanInspector sharedInspector];
+	[inspector reset];
+	inspector.enabled = YES;
+	[AutoManyChild fetchQuery:@"WHERE name = ? ORDER BY name" arguments:@[@"child 1"]];
+	[AutoChild fetchQuery:@"WHERE parent_id = ? ORDER BY name" arguments:@[@1]];
+	inspector.enabled = NO;
+	
+	NSDictionary *problems = [inspector problemsByTable];
+	XCTAssertNotNil(problems[@"AutoManyChild"], @"Full scan was not detected");
+	XCTAssertNil(problems[@"AutoChild"], @"Indexed query reported as a problem: %@", problems[@"AutoChild"]);
+	XCTAssertEqualObjects([inspector suggestedIndexes][@"AutoManyChild"], @[@"(name)"]);
+	NSString *report = [inspector report];
+	XCTAssertTrue([report containsString:@"FULL SCAN of AutoManyChild"], @"Wrong report: %@", report);
+}
+
+- (void) testSchemaFingerprint
+{
+	[self createDatabaseWithRelations];
+	
+	//every file remembers its schema, so the next launch can skip checking it.
+	for (Class classObject in @[AutoParent.class, AutoChild.class, AutoManyChild.class])
+	{
+		[classObject inDatabase:^(AFMDatabase * _Nonnull db) {
+			AFMResultSet *result = [db executeQuery:@"SELECT key FROM auto_db_metadata ORDER BY key"];
+			NSMutableArray *keys = [NSMutableArray new];
+			while ([result next])
+				[keys addObject:[result stringForColumnIndex:0]];
+			[result close];
+			XCTAssertEqualObjects(keys, (@[@"schema_build", @"schema_hash", @"table_syntax"]), @"%@ has no schema fingerprint", classObject);
+		}];
+	}
+	XCTAssertNotNil([[AutoDB sharedInstance] columnSyntaxForClass:AutoParent.class][@"name"]);
+}
+
+- (void) testBackgroundIndexBuilds
+{
+	[self createDatabaseWithRelations];
+	NSMutableArray *newChildren = [NSMutableArray new];
+	for (NSUInteger index = 1; index < 101; index++)
+	{
+		AutoChild *child = [AutoChild createInstanceWithId:index];
+		child.name = [NSString stringWithFormat:@"child %i", (int)index];
+		child.parent_id = 1;
+		[newChildren addObject:child];
+	}
+	XCTAssertNil([AutoChild save:newChildren]);
+	newChildren = nil;
+	
+	//drop the composite index AutoChild declares and forget the schema, so the next setup finds it missing on a table with rows.
+	__block NSString *indexName = nil;
+	[AutoChild inDatabase:^(AFMDatabase * _Nonnull db) {
+		AFMResultSet *result = [db executeQuery:@"SELECT name FROM sqlite_master WHERE type = 'index' AND tbl_name = 'AutoChild' AND sql LIKE '%(parent_id, name)'"];
+		if ([result next])
+			indexName = [result stringForColumnIndex:0];
+		[result close];
+		XCTAssertNotNil(indexName, @"the specific index was never created");
+		[db executeUpdate:[NSString stringWithFormat:@"DROP INDEX IF EXISTS %@", indexName]];
+		[db executeUpdate:@"DROP TABLE IF EXISTS auto_db_metadata"];
+	}];
+	[[AutoDB sharedInstance] destroyDatabase];
+	
+	//indexes missing on tables with rows are queued during setup and built in the background afterwards.
+	expect = [self expectationWithDescription:@"Setup with rows"];
+	[self createDatabaseWithRelations];
+	NSArray <NSString*>*pendingIndexes = [[AutoDB sharedInstance] pendingIndexesForClass:AutoChild.class];
+	NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:10];
+	while (pendingIndexes.count && timeout.timeIntervalSinceNow > 0)
+	{
+		[NSThread sleepForTimeInterval:0.05];
+		pendingIndexes = [[AutoDB sharedInstance] pendingIndexesForClass:AutoChild.class];
+	}
+	XCTAssertEqual(pendingIndexes.count, 0, @"indexes are never built: %@", pendingIndexes);
+	
+	[AutoChild inDatabase:^(AFMDatabase * _Nonnull db) {
+		AFMResultSet *result = [db executeQuery:@"SELECT status FROM auto_index_status WHERE name = ?", indexName];
+		XCTAssertTrue([result next], @"the index was not queued");
+		XCTAssertEqual([result intForColumnIndex:0], 1, @"the index was not built");
+		[result close];
+		result = [db executeQuery:@"SELECT count(*) FROM sqlite_master WHERE type = 'index' AND tbl_name = 'AutoChild' AND name = ?", indexName];
+		XCTAssertTrue([result next]);
+		XCTAssertEqual([result intForColumnIndex:0], 1);
+		[result close];
+	}];
+}
+
 @end
@@ -173,6 +173,44 @@
 	XCTAssertTrue(set.hasChanges); set.hasChanges = NO;
 }
 
+- (void)testValuesForColumnMasks
+{
+	//more ids than one statement fetches, and they are not in the cache so they are read from the db.
+	NSUInteger count = 250;
+	NSMutableDictionary <NSNumber*, NSNumber*> *idsWithMasks = [NSMutableDictionary new];
+	NSMutableDictionary <NSNumber*, NSMutableSet*> *idsWithColumns = [NSMutableDictionary new];
+	@autoreleasepool
+	{
+		NSMutableArray *items = [NSMutableArray new];
+		for (NSUInteger index = 0; index < count; index++)
+		{
+			ValueHandling *item = [ValueHandling createInstanceWithId:5000 + index];
+			item.string = [NSString stringWithFormat:@"mask %@", @(index)];
+			item.doubleValue = index;
+			[items addObject:item];
+			//odd rows want only string, even rows string and doubleValue.
+			idsWithMasks[@(item.id)] = index % 2 ? @1 : @3;
+			idsWithColumns[@(item.id)] = index % 2 ? [NSMutableSet setWithObject:@"string"] : [NSMutableSet setWithObjects:@"string", @"doubleValue", nil];
+		}
+		XCTAssertNil([ValueHandling save:items]);
+	}
+	
+	NSDictionary <NSNumber*, NSDictionary*> *values = [[AutoDB sharedInstance] valuesForColumnMasks:idsWithMasks columns:@[@"string", @"doubleValue"] class:[ValueHandling class] translateDates:NO];
+	XCTAssertEqual(values.count, count);
+	for (NSUInteger index = 0; index < count; index++)
+	{
+		NSDictionary *row = values[@(5000 + index)];
+		XCTAssertEqualObjects(row[@"id"], @(5000 + index));
+		XCTAssertEqualObjects(row[@"string"], ([NSString stringWithFormat:@"mask %@", @(index)]));
+		if (index % 2)
+			XCTAssertNil(row[@"doubleValue"]);
+		else
+			XCTAssertEqual([row[@"doubleValue"] doubleValue], index);
+	}
+	
+	XCTAssertEqualObjects([[AutoDB sharedInstance] valuesForColumns:idsWithColumns class:[ValueHandling class] translateDates:NO], values);
+}
+
 //	- @warning If you have dependent properties you need to call keyPathsForValuesAffecting<property-name> to get automatic behaviour (like if you store a dictionary in the db under some other property).
 
 
@@ -27,7 +27,7 @@
 	NSString *second = [supportPath stringByAppendingPathComponent:@"second.sqlite3"];
 	NSString *standard = [supportPath stringByAppendingPathComponent:@"standard.sqlite3"];
 	
-	[[AutoDB sharedInstance] createDatabaseWithPathsForClasses:@{ concurrency : @[@"AutoParent", @"ConcurrencyModel"], second : @[@"AutoChild", @"AutoStrongChild", @"SecondModel", @"ValueHandling"], standard: @[@"AutoManyChild"]} migrateBlock:nil];
+	[[AutoDB sharedInstance] createDatabaseWithPathsForClasses:@{ concurrency : @[@"AutoParent", @"AutoFaultParent", @"ConcurrencyModel"], second : @[@"AutoChild", @"AutoStrongChild", @"SecondModel", @"ValueHandling"], standard: @[@"AutoManyChild", @"AutoJoinChild"]} migrateBlock:nil];
 }
 
 - (void)setUp
@@ -45,9 +45,16 @@
 	}];
 	[AutoChild inDatabase:^(AFMDatabase * _Nonnull db) {
 		[db executeUpdate:@"DELETE FROM AutoChild"];
+		[db executeUpdate:@"DELETE FROM AutoStrongChild"];
 	}];
 	[AutoManyChild inDatabase:^(AFMDatabase * _Nonnull db) {
 		[db executeUpdate:@"DELETE FROM AutoManyChild"];
+		[db executeUpdate:@"DELETE FROM AutoJoinChild"];
+	}];
+	[AutoParent inDatabase:^(AFMDatabase * _Nonnull db) {
+		[db executeUpdate:@"DELETE FROM AutoParent_AutoJoinChild_join"];
+		[db executeUpdate:@"DELETE FROM AutoFaultParent"];
+		[db executeUpdate:@"DELETE FROM AutoFaultParent_AutoJoinChild_join"];
 	}];
 }
 
@@ -459,6 +466,306 @@ static int children = 3000;
 	NSLog(@"working?");
 }
 
+- (void)test810ManyRelationsForSeveralParents
+{
+	NSUInteger parentCount = 50;
+	@autoreleasepool
+	{
+		NSMutableArray *manyChildren = [NSMutableArray new];
+		for (NSUInteger index = 1; index < 101; index++)
+		{
+			AutoManyChild *child = [AutoManyChild createInstanceWithId:index];
+			child.name = [NSString stringWithFormat:@"child %i", (int)index];
+			[manyChildren addObject:child];
+		}
+		[AutoManyChild save:manyChildren];
+		
+		NSMutableArray *parents = [NSMutableArray new];
+		for (NSUInteger index = 1; index < parentCount + 1; index++)
+		{
+			//every parent shares children with its neighbours, in descending order.
+			AutoParent *parent = [AutoParent createInstanceWithId:index];
+			parent.manyChildIds = [NSString stringWithFormat:@"%i,%i,%i", (int)index + 2, (int)index + 1, (int)index];
+			[parents addObject:parent];
+		}
+		[AutoParent save:parents];
+	}
+	
+	AutoResult *parents = [AutoParent fetchQuery:nil arguments:nil];
+	[AutoParent fetchRelations:parents.rows];
+	XCTAssertEqual(parents.rows.count, parentCount);
+	for (AutoParent *parent in parents.rows)
+	{
+		XCTAssertEqual(parent.manyChildren.count, 3);
+		NSArray *ids = [parent.manyChildren valueForKey:@"idValue"];
+		XCTAssertEqualObjects([ids componentsJoinedByString:@","], parent.manyChildIds);
+	}
+}
+
+- (void)test811JoinTableRelations
+{
+	@autoreleasepool
+	{
+		NSMutableArray *joinChildren = [NSMutableArray new];
+		for (NSUInteger index = 1; index < 11; index++)
+		{
+			AutoJoinChild *child = [AutoJoinChild createInstanceWithId:index];
+			child.name = [NSString stringWithFormat:@"child %i", (int)index];
+			[joinChildren addObject:child];
+		}
+		[AutoJoinChild save:joinChildren];
+		
+		AutoParent *first = [AutoParent createInstanceWithId:1];
+		AutoParent *second = [AutoParent createInstanceWithId:2];
+		first.joinedChildren = [AutoDBSet new];
+		second.joinedChildren = [AutoDBSet new];
+		for (AutoJoinChild *child in joinChildren)
+		{
+			[first.joinedChildren addObject:child];
+			if (child.id % 2 == 0)
+				[second.joinedChildren addObject:child];
+		}
+		[AutoParent save:@[first, second]];
+	}
+	
+	AutoResult *parents = [AutoParent fetchQuery:@"ORDER BY id" arguments:nil];
+	[AutoParent fetchRelations:parents.rows];
+	AutoParent *first = parents.rows.firstObject;
+	AutoParent *second = parents.rows.lastObject;
+	XCTAssertEqual(first.joinedChildren.count, 10);
+	XCTAssertEqual(second.joinedChildren.count, 5);
+	XCTAssertNotNil(first.joinedChildren.membershipChanges, @"Fetched containers must track their changes");
+	
+	//only the changes are written, and the parent is marked as changed.
+	AutoJoinChild *removed = [AutoJoinChild fetchId:@(2)];
+	[first.joinedChildren removeObject:removed];
+	XCTAssertTrue(first.hasChanges);
+	XCTAssertEqualObjects(first.joinedChildren.membershipChanges.removedObjects, [NSSet setWithObject:removed]);
+	[AutoParent save:@[first]];
+	XCTAssertEqual(first.joinedChildren.membershipChanges.removedObjects.count, 0);
+	
+	NSArray *joinedParents = [[removed fetchJoinedParents:AutoParent.class].rows valueForKey:@"idValue"];
+	XCTAssertEqualObjects(joinedParents, @[@(2)]);
+	XCTAssertEqual([[AutoJoinChild fetchId:@(3)] fetchJoinedParents:AutoParent.class].rows.count, 1);
+	XCTAssertEqual([[AutoJoinChild fetchId:@(4)] fetchJoinedParents:AutoParent.class].rows.count, 2);
+	
+	[AutoParent inDatabase:^(AFMDatabase * _Nonnull db) {
+		AFMResultSet *result = [db executeQuery:@"SELECT COUNT(*) FROM AutoParent_AutoJoinChild_join"];
+		[result next];
+		XCTAssertEqual([result intForColumnIndex:0], 14);
+		[result close];
+	}];
+}
+
+///Parents with two joined children each, saved and released so they are fetched with relation faults.
+- (void) saveFaultParents:(NSUInteger)parentCount
+{
+	@autoreleasepool
+	{
+		NSMutableArray *joinChildren = [NSMutableArray new];
+		NSMutableArray *parents = [NSMutableArray new];
+		for (NSUInteger index = 1; index < parentCount + 1; index++)
+		{
+			AutoJoinChild *first = [AutoJoinChild createInstanceWithId:index * 2];
+			AutoJoinChild *second = [AutoJoinChild createInstanceWithId:index * 2 + 1];
+			[joinChildren addObjectsFromArray:@[first, second]];
+			
+			AutoFaultParent *parent = [AutoFaultParent createInstanceWithId:index];
+			parent.joinedChildren = [AutoDBSet new];
+			[parent.joinedChildren addObject:first];
+			[parent.joinedChildren addObject:second];
+			[parents addObject:parent];
+		}
+		[AutoJoinChild save:joinChildren];
+		[AutoFaultParent save:parents];
+	}
+}
+
+- (void)test812RelationFaults
+{
+	NSUInteger parentCount = 20;
+	[self saveFaultParents:parentCount];
+	
+	AutoResult <AutoFaultParent*>*parents = [AutoFaultParent fetchQuery:nil arguments:nil];
+	XCTAssertEqual(parents.rows.count, parentCount);
+	for (AutoFaultParent *parent in parents.rows)
+	{
+		XCTAssertFalse(parent.hasFetchedRelations, @"Relations should not load until used");
+	}
+	
+	//touching one object loads every sibling from the same result.
+	XCTAssertEqual(parents.rows.firstObject.joinedChildren.count, 2);
+	for (AutoFaultParent *parent in parents.rows)
+	{
+		XCTAssertTrue(parent.hasFetchedRelations);
+		XCTAssertEqual(parent.joinedChildren.count, 2);
+	}
+}
+
+- (void)test813PrefetchRelationGraph
+{
+	NSUInteger parentCount = 5, childCount = 4;
+	@autoreleasepool
+	{
+		NSMutableArray *parents = [NSMutableArray new];
+		NSMutableArray *allChildren = [NSMutableArray new];
+		NSMutableArray *strongChildren = [NSMutableArray new];
+		for (NSUInteger parentIndex = 1; parentIndex < parentCount + 1; parentIndex++)
+		{
+			AutoParent *parent = [AutoParent createInstanceWithId:parentIndex];
+			[parents addObject:parent];
+			for (NSUInteger index = 0; index < childCount; index++)
+			{
+				u_int64_t childId = parentIndex * 100 + index;
+				AutoStrongChild *strongChild = [AutoStrongChild createInstanceWithId:childId];
+				strongChild.name = [NSString stringWithFormat:@"strong %i", (int)childId];
+				[strongChildren addObject:strongChild];
+				
+				AutoChild *child = [AutoChild createInstanceWithId:childId];
+				child.parent_id = parentIndex;
+				child.strong_child_id = childId;
+				[allChildren addObject:child];
+			}
+		}
+		[AutoStrongChild save:strongChildren];
+		[AutoChild save:allChildren];
+		[AutoParent save:parents];
+	}
+	
+	AutoResult <AutoParent*>*parents = [AutoParent fetchQuery:nil arguments:nil];
+	[AutoParent prefetchRelations:parents.rows keyPaths:@[@"children.strong_child"]];
+	XCTAssertEqual(parents.rows.count, parentCount);
+	for (AutoParent *parent in parents.rows)
+	{
+		XCTAssertEqual(parent.children.count, childCount);
+		XCTAssertFalse(parent.hasFetchedRelations, @"Only the relation in the key path should be fetched");
+		XCTAssertEqualObjects(parent.fetchedRelations, [NSSet setWithObject:@"children"]);
+		XCTAssertNil(parent.joinedChildren);
+		for (AutoChild *child in parent.children)
+		{
+			XCTAssertTrue(child.hasFetchedRelations, @"Second level was not fetched");
+			XCTAssertEqualObjects(child.strong_child.name, ([NSString stringWithFormat:@"strong %i", (int)child.id]));
+		}
+	}
+	
+	//the rest is fetched later, without fetching the children again.
+	AutoParent *parent = parents.rows.firstObject;
+	NSArray *children = parent.children;
+	[parent fetchRelations];
+	XCTAssertTrue(parent.hasFetchedRelations);
+	XCTAssertNotNil(parent.joinedChildren);
+	XCTAssertEqual(parent.children, children);
+	XCTAssertEqual(parent.children.count, childCount);
+}
+
+- (void)test814CompiledRelations
+{
+	//children, strong child, many children and joined children
+	XCTAssertEqual([AutoModelRelation compileRelationsForClass:AutoParent.class].count, 4);
+	//only the strong relation, the parent id is compiled into the parent's descriptor
+	XCTAssertEqual([AutoModelRelation compileRelationsForClass:AutoChild.class].count, 1);
+	XCTAssertEqual([AutoModelRelation compileRelationsForClass:AutoManyChild.class].count, 0);
+}
+
+- (void)test815RelationFaultThreads
+{
+	NSUInteger parentCount = 20;
+	[self saveFaultParents:parentCount];
+	AutoResult <AutoFaultParent*>*parents = [AutoFaultParent fetchQuery:nil arguments:nil];
+	XCTAssertEqual(parents.rows.count, parentCount);
+	
+	//siblings reading at the same time all wait for the one fetch.
+	NSArray <AutoFaultParent*>*rows = parents.rows;
+	dispatch_apply(rows.count, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t index) {
+		
+		XCTAssertEqual(rows[index].joinedChildren.count, 2);
+	});
+}
+
+- (void)test819RelationFaultOnDatabaseThread
+{
+	NSUInteger parentCount = 20;
+	[self saveFaultParents:parentCount];
+	AutoResult <AutoFaultParent*>*parents = [AutoFaultParent fetchQuery:nil arguments:nil];
+	NSArray <AutoFaultParent*>*rows = parents.rows;
+	
+	//a sibling read on the database thread while another thread fetches, the fetch needs that thread so the reader must not block it.
+	XCTestExpectation *fetched = [self expectationWithDescription:@"fetched"];
+	dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+		XCTAssertEqual(rows.firstObject.joinedChildren.count, 2);
+		[fetched fulfill];
+	});
+	[AutoFaultParent inDatabase:^(AFMDatabase * _Nonnull db) {
+		XCTAssertEqual(rows.lastObject.joinedChildren.count, 2);
+	}];
+	[self waitForExpectationsWithTimeout:10 handler:nil];
+}
+
+- (void)test816RelationFaultSetter
+{
+	NSUInteger parentCount = 20;
+	[self saveFaultParents:parentCount];
+	AutoResult <AutoFaultParent*>*parents = [AutoFaultParent fetchQuery:nil arguments:nil];
+	XCTAssertEqual(parents.rows.count, parentCount);
+	
+	//a relation we set is not overwritten when a sibling loads the others.
+	AutoFaultParent *emptied = parents.rows.firstObject;
+	emptied.joinedChildren = [AutoDBSet new];
+	XCTAssertEqual(parents.rows.lastObject.joinedChildren.count, 2);
+	XCTAssertEqual(emptied.joinedChildren.count, 0);
+}
+
+- (void)test817JoinTableDuplicatesAndDelete
+{
+	[self saveFaultParents:2];
+	AutoFaultParent *parent = [AutoFaultParent fetchId:@(1)];
+	AutoJoinChild *child = parent.joinedChildren.anyObject;
+	
+	//an array may hold the same child twice, but the join table only once.
+	AutoDBArray *array = [AutoDBArray new];
+	array.membershipChanges = [AutoDBMembershipChanges changesForOwner:parent];
+	[array addObject:child];
+	[array addObject:child];
+	[array.membershipChanges.addedObjects removeAllObjects];
+	[array removeObjectAtIndex:0];
+	XCTAssertEqual(array.membershipChanges.removedObjects.count, 0);
+	[array removeLastObject];
+	XCTAssertEqualObjects(array.membershipChanges.removedObjects, [NSSet setWithObject:child]);
+	
+	//adding a stored child again and removing both copies still removes its row.
+	AutoDBArray *storedArray = [AutoDBArray new];
+	[storedArray addObject:child];
+	storedArray.membershipChanges = [AutoDBMembershipChanges changesForOwner:parent];
+	[storedArray addObject:child];
+	XCTAssertEqual(storedArray.membershipChanges.addedObjects.count, 0);
+	[storedArray removeAllObjects];
+	XCTAssertEqualObjects(storedArray.membershipChanges.removedObjects, [NSSet setWithObject:child]);
+	
+	//deleting a parent removes its rows.
+	[AutoFaultParent deleteIds:@[@(1)]];
+	[AutoFaultParent inDatabase:^(AFMDatabase * _Nonnull db) {
+		AFMResultSet *result = [db executeQuery:@"SELECT parent_id, COUNT(*) FROM AutoFaultParent_AutoJoinChild_join GROUP BY parent_id"];
+		XCTAssertTrue([result next]);
+		XCTAssertEqual([result intForColumnIndex:0], 2);
+		XCTAssertEqual([result intForColumnIndex:1], 2);
+		XCTAssertFalse([result next]);
+		[result close];
+	}];
+}
+
+- (void)test818RelationsInChunks
+{
+	//more parents than fit in one statement, their rows and children are fetched in chunks.
+	NSUInteger parentCount = 1200;
+	[self saveFaultParents:parentCount];
+	AutoResult <AutoFaultParent*>*parents = [AutoFaultParent fetchQuery:nil arguments:nil];
+	XCTAssertEqual(parents.rows.count, parentCount);
+	[AutoFaultParent fetchRelations:parents.rows];
+	for (AutoFaultParent *parent in parents.rows)
+	{
+		XCTAssertEqualObjects([parent.joinedChildren valueForKey:@"idValue"], ([NSSet setWithObjects:@(parent.id * 2), @(parent.id * 2 + 1), nil]));
+	}
+}
 
 /*
  TODO:
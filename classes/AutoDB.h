@@ -14,8 +14,13 @@
 	#define DEBUG 0
 #endif
 
-#define AUTO_WAIT_FOR_SETUP if (!self->isSetup) [self->setupLockQueue.thread syncPerformBlock:^{}];
+//wait until all tables are created and migrated
+#define AUTO_WAIT_FOR_SETUP if (!self->isSetup && self->setupGroup) dispatch_group_wait(self->setupGroup, DISPATCH_TIME_FOREVER);
+//wait until the syntax of all tables is known, threads are started right after.
+#define AUTO_WAIT_FOR_TABLE_SYNTAX if (!self->hasTableSyntax) [self->setupLockQueue.thread syncPerformBlock:^{}];
 #define AutoDBIsSetupNotification @"AutoDBIsSetupNotification"
+//Column masks have one bit per column, columns beyond the last bit share it so it means "this column or any after it".
+#define AUTO_COLUMN_MASK_LAST_BIT 63
 
 /**
  A database manager
@@ -27,7 +32,9 @@ typedef NS_ENUM(NSUInteger, MigrationState)
 {
 	MigrationStateError,
 	MigrationStateStart,
-	MigrationStateComplete
+	MigrationStateComplete,
+	MigrationStateProgress,
+	MigrationStateFileComplete
 };
 typedef void (^MigrationBlock)(MigrationState state, NSMutableSet * _Nullable willMigrateTables, NSArray <NSError*>* _Nullable migrationErrors);
 
@@ -41,17 +48,17 @@ typedef void (^MigrationBlock)(MigrationState state, NSMutableSet * _Nullable wi
 
 /**
  Create database by supplying a path (supply nil for the default path, in applicationSupportDirectory that will be backed up). It will find all available classes for you.
- @arg migrateBlock is called if there will be migration with "start" state and a set of tables that will be migrated and/or after processing with "complete" state. If there are any errors, the third parameter will contain those. This means that the block can be called twice.
- @note The DB has locks so you can query the database while migration is taking place (you will just have to wait until it's done). BUT: You must call this on the main thread - before creating any new objects/fetches.
- A good practice is to call this method first at startup, it will leave the main thread as soon as possible and setup your DB in the background.
+ @arg migrateBlock is called with "start" state and the set of tables whose schema has changed (those that may be migrated) and after processing with "complete" state and the tables that were migrated. If there are any errors, the third parameter will contain those. Tables that must be copied report "progress" state after each chunk with the table name, see migrationProgressForTable:. Files are set up concurrently, every file with changes reports "file complete" state with its tables when done. The block is called on background threads, possibly several at once.
+ @note The DB has locks so you can query the database while migration is taking place (you will just have to wait for the tables you use). BUT: You must call this on the main thread - before creating any new objects/fetches.
+ A good practice is to call this method first at startup, it will leave the main thread as soon as possible and setup your DB in the background. Tables are created and migrated the first time they are used, the rest are set up in the background ordered by setupPriority.
  */
 - (void) createDatabaseMigrateBlock:(nullable MigrationBlock)migrateBlock;
 /**
  @arg location Specify some other path for the DB.
  if you want to limit the classes used for the db, specify those in specificClassNames.
  
- @arg migrateBlock is called if there will be migration with "start" state and a set of tables that will be migrated and/or after processing with "complete" state. If there are any errors, the third parameter will contain those. This means that the block can be called twice.
- @note The DB has locks so you can query the database while migration is taking place (you will just have to wait until it's done). BUT: You must call this on the main thread - before creating any new objects/fetches.
+ @arg migrateBlock is called with "start" state and the set of tables whose schema has changed (those that may be migrated) and after processing with "complete" state and the tables that were migrated. If there are any errors, the third parameter will contain those. Tables that must be copied report "progress" state after each chunk with the table name, see migrationProgressForTable:. Files are set up concurrently, every file with changes reports "file complete" state with its tables when done. The block is called on background threads, possibly several at once.
+ @note The DB has locks so you can query the database while migration is taking place (you will just have to wait for the tables you use). BUT: You must call this on the main thread - before creating any new objects/fetches.
  A good practice is to call this method first at startup, it will leave the main thread as soon as possible and setup your DB in the background.
  */
 - (void) createDatabase:(nullable NSString*)location withModelClasses:(nullable NSArray<NSString*>*)specificClassNames migrateBlock:(nullable MigrationBlock)migrateBlock;
@@ -62,6 +69,17 @@ typedef void (^MigrationBlock)(MigrationState state, NSMutableSet * _Nullable wi
  */
 - (void) createDatabaseWithPathsForClasses:(nullable NSDictionary <NSString*, NSArray <NSString*>*>*)pathsForClassNames migrateBlock:(nullable MigrationBlock)migrateBlock;
 
+///Create, check and migrate the table of this class now unless that is already done, blocks until complete. This happens automatically the first time a class uses its databaseQueue.
+- (void) setupTableIfNeeded:(Class)classObject;
+///Like setupTableIfNeeded, but from another file's database thread the setup is only queued first on the table's thread instead of waiting for it. Used by databaseQueue.
+- (void) queueSetupOfTable:(Class)classObject;
+
+///Progress of a table being copied during migration (rows copied of all rows), nil when no copy is running. Read it when the migrateBlock is called with MigrationStateProgress.
+- (nullable NSProgress*) migrationProgressForTable:(NSString*)tableName;
+
+///Indexes of this class that are not built yet. New indexes on tables with rows are built in the background after setup, queries work without them but may be slower until then.
+- (NSArray <NSString*>*) pendingIndexesForClass:(Class)classObject;
+
 - (NSArray <NSString *>*) columnNamesForClass:(Class)classObject;
 - (NSDictionary <NSString *, NSNumber *>*) columnSyntaxForClass:(Class)classObject;
 - (NSDictionary <NSString*, NSDictionary*> *) tableSyntaxForClass:(NSString*)classString;
@@ -77,6 +95,8 @@ typedef void (^MigrationBlock)(MigrationState state, NSMutableSet * _Nullable wi
 ///fetch only certain values, return a dictionary with the result (id is key), since we can't have ordering anyway.
 /// @param translateDates YES will give you dates as NSDate, otherwise NSNumber (timestamp)
 - (NSMutableDictionary <NSNumber*, NSMutableDictionary*> *) valuesForColumns:(NSMutableDictionary<NSNumber*, NSMutableSet*> *)idsWithColumns class:(Class)classObject translateDates:(BOOL)translateDates;
+///Like valuesForColumns but the columns of each id are a bitmask, bit n is maskColumns[n] (see AUTO_COLUMN_MASK_LAST_BIT). Ids with the same mask are fetched together with one cached statement.
+- (NSMutableDictionary <NSNumber*, NSMutableDictionary*> *) valuesForColumnMasks:(NSDictionary<NSNumber*, NSNumber*> *)idsWithMasks columns:(NSArray<NSString*> *)maskColumns class:(Class)classObject translateDates:(BOOL)translateDates;
 
 //These methods must be implemented by the sync engine
 + (void) mainSync;
@@ -8,10 +8,38 @@
 
 #import "AutoDB.h"
 #import "AutoThread.h"
+#import "AutoModelRelation.h"
 @import ObjectiveC;
 
 #define AUTO_SQLITE_FIELD_NAMES @[@"TEXT", @"BLOB", @"INTEGER", @"REAL", @"REAL", @"REAL", @"NONE"]
 
+//Each file remembers the table syntax it was last setup with, so unchanged files can skip introspection and DDL.
+#define AUTO_METADATA_TABLE @"auto_db_metadata"
+#define AUTO_METADATA_VERSION 1
+#define AUTO_METADATA_BUILD @"schema_build"
+#define AUTO_METADATA_HASH @"schema_hash"
+#define AUTO_METADATA_SYNTAX @"table_syntax"
+
+//Tables that cannot be migrated in place are copied in chunks, remembering how far we got in the migration table.
+#define AUTO_MIGRATION_TABLE @"auto_migration_progress"
+#define AUTO_MIGRATION_SUFFIX @"_auto_migrating"
+#define AUTO_MIGRATION_CHUNK_SIZE 5000
+//Meanwhile the old table is used as before, rows written to it are remembered in this table (ending with the suffix, so it is never seen as a model table) and copied again before the swap.
+#define AUTO_MIGRATION_DIRTY_SUFFIX @"_dirty" AUTO_MIGRATION_SUFFIX
+//The copy has its own connection, both connections wait this many seconds for each other's locks.
+#define AUTO_MIGRATION_BUSY_TIMEOUT 30
+
+//New indexes on tables with rows are built after setup, their state is kept in the index status table.
+#define AUTO_INDEX_STATUS_TABLE @"auto_index_status"
+//valuesForColumnMasks fetches this many ids per statement.
+#define AUTO_VALUES_FETCH_IDS 100
+typedef NS_ENUM(NSInteger, AutoIndexStatus)
+{
+	AutoIndexStatusPending,
+	AutoIndexStatusBuilt,
+	AutoIndexStatusFailed
+};
+
 @implementation AutoDB
 {
 	NSMutableDictionary *tablesWithChanges;
@@ -19,8 +47,14 @@
 	
 	
 	AFMDatabaseQueue *setupLockQueue;
+	dispatch_group_t setupGroup;	//left when all tables are set up
+	NSMutableSet <NSString*>*unpreparedTables, *migratedTables;	//tables not yet created/checked, and those migrated. Both guarded by unpreparedTables.
+	NSMutableDictionary <NSString*, NSArray <NSError*>*>*migrationErrors;	//per table
+	NSMutableDictionary <NSString*, NSProgress*>*migrationProgress;
+	NSMutableDictionary <NSString*, dispatch_group_t>*copyGroups;	//tables copied in the background, per file. Guarded by unpreparedTables.
+	MigrationBlock migrationBlock;	//only set during setup
 	dispatch_queue_t tablesWithChangesQueue;		   //A queue for making changes to tablesWithChanges - so we don't need to interfere with the database queue while making changes to our objects. Was called dictionaryQueue
-	BOOL needsMigration, isSetup, hasSetupObservingProperties;
+	BOOL isSetup, hasTableSyntax, hasSetupObservingProperties;
 	
 	/*
 	 I want to rebuild the concurrency model. I want one queue for DB-actions (like queries), and one for our cached objects. This should remove the semaphore since it is not needed (cached objects needs an own queue) - OR - we use all three.
@@ -31,6 +65,7 @@
 }
 
 + (void) setupWithChangesQueue:(dispatch_queue_t)queue changesDictionary:(NSMutableDictionary*)tablesWithChanges {}
++ (void) setupRelationFaults {}
 
 static Class uiApplication;
 static AutoDB *sharedInstance = nil;
@@ -49,6 +84,7 @@ static AutoDB *sharedInstance = nil;
 {
 	self = [super init];
 	tablesWithChanges = [NSMutableDictionary new];
+	migrationProgress = [NSMutableDictionary new];
 	//not yet! API_URL = [[[NSBundle mainBundle] infoDictionary] objectForKey:@"API_URL"];
 	
 	tablesWithChangesQueue = dispatch_queue_create(NULL, DISPATCH_QUEUE_SERIAL);
@@ -140,7 +176,9 @@ static AutoDB *sharedInstance = nil;
 		objc_setAssociatedObject(classObject, @selector(tableCache), nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
 	}
 	tableSyntax = nil;
+	unpreparedTables = nil;
 	isSetup = NO;
+	hasTableSyntax = NO;
 	
 	NSLog(@"all your database is destroyed!");
 }
@@ -208,40 +246,19 @@ static AutoDB *sharedInstance = nil;
 		{
 			Class classObject = NSClassFromString(className);
 			objc_setAssociatedObject(classObject, @selector(databaseQueue), specificQueue, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+			objc_setAssociatedObject(classObject, @selector(tableCache), [AutoConcurrentMapTable strongToWeakObjectsMapTable], OBJC_ASSOCIATION_RETAIN_NONATOMIC);
 		}
 		[allQueues addObject:specificQueue];
 		if (!setupLockQueue)
 			setupLockQueue = specificQueue;	//make one the lockQueue
 	}
 	
-	if (DEBUG)
-	{
-		//always remember to add ALL classes, otherwise it will fail. So tell us otherwise!
-		NSMutableSet *runtimeClasses = [NSMutableSet setWithArray:[self modelClassesFromRuntime]];
-		for (NSString *className in @[@"AutoUser", @"AutoSync"])
-		{
-			[runtimeClasses removeObject:className];
-		}
-		if (pathsForClassNames.count)
-		{
-			for (NSArray *items in pathsForClassNames.allValues)
-			{
-				for (NSString *className in items)
-				{
-					[runtimeClasses removeObject:className];
-				}
-			}
-		}
-		if (runtimeClasses.count)
-		{
-			NSLog(@"NOTE: Missing classes: %@", [runtimeClasses.allObjects componentsJoinedByString:@", "]);
-		}
-	}
-	
 	tableSyntax = [NSMutableDictionary new];
-	//we don't start the threads until setup is complete, but someone who want the table-info needs to wait (AUTO_WAIT_FOR_SETUP).
-	dispatch_async(tablesWithChangesQueue, ^{
-		AUTO_WAIT_FOR_SETUP
+	setupGroup = dispatch_group_create();
+	dispatch_group_enter(setupGroup);
+	//we don't start the threads until the table syntax is known, someone who want the table-info needs to wait (AUTO_WAIT_FOR_TABLE_SYNTAX). Waiting for all tables is done with AUTO_WAIT_FOR_SETUP.
+	//don't block tablesWithChangesQueue while waiting, tables that are ready may save changes during setup.
+	dispatch_group_notify(setupGroup, tablesWithChangesQueue, ^{
 		if (DEBUG) NSLog(@"DBSem is released!");
 		[[NSNotificationCenter defaultCenter] postNotificationName:AutoDBIsSetupNotification object:nil userInfo:nil];
 	});
@@ -259,6 +276,30 @@ static AutoDB *sharedInstance = nil;
 	});
 }
 
+- (void) logMissingClasses:(nullable NSDictionary <NSString*, NSArray <NSString*>*>*)pathsForClassNames
+{
+	//always remember to add ALL classes, otherwise it will fail. So tell us otherwise!
+	NSMutableSet *runtimeClasses = [NSMutableSet setWithArray:[self modelClassesFromRuntime]];
+	for (NSString *className in @[@"AutoUser", @"AutoSync"])
+	{
+		[runtimeClasses removeObject:className];
+	}
+	if (pathsForClassNames.count)
+	{
+		for (NSArray *items in pathsForClassNames.allValues)
+		{
+			for (NSString *className in items)
+			{
+				[runtimeClasses removeObject:className];
+			}
+		}
+	}
+	if (runtimeClasses.count)
+	{
+		NSLog(@"NOTE: Missing classes: %@", [runtimeClasses.allObjects componentsJoinedByString:@", "]);
+	}
+}
+
 - (void) internalCreateDatabaseWithPaths:(nullable NSDictionary <NSString*, NSArray <NSString*>*>*)pathsForClassNames allQueues:(NSArray<AFMDatabaseQueue *>*)allQueues migrateBlock:(MigrationBlock)migrateBlock
 {
 	//allow for dynamical set/remove of sync engine.
@@ -271,7 +312,7 @@ static AutoDB *sharedInstance = nil;
 	{
 		//give migration a chance to handle table changes, if we move from one file to the other.
 		NSArray *paths = pathsForClassNames.allKeys;
-		NSString *showTables = @"SELECT name FROM sqlite_master WHERE type = 'table'";
+		NSString *showTables = [NSString stringWithFormat:@"SELECT name FROM sqlite_master WHERE type = 'table' AND name NOT IN ('%@', '%@', '%@') AND name NOT LIKE '%%%@'", AUTO_METADATA_TABLE, AUTO_MIGRATION_TABLE, AUTO_INDEX_STATUS_TABLE, AUTO_MIGRATION_SUFFIX];
 		for (NSInteger index = 0; index < paths.count - 1; index++)
 		{
 			NSString *path = paths[index];
@@ -418,147 +459,344 @@ static AutoDB *sharedInstance = nil;
 		}
 	}
 	
-	//create syntax and check for migration
-	NSMutableSet <NSString*>*lightweightMigrateTables = [NSMutableSet set];
-	for (NSArray<NSString*>* tableNames in pathsForClassNames.allValues)
+	//read the schema of every file up front, this is only runtime introspection and one metadata row per file. Files whose schema is unchanged since last launch are then ready, the rest have their tables created, checked and migrated one at a time - when first used or when the warm-up below reaches them.
+	NSMutableSet <NSString*>*willMigrateTables = [NSMutableSet set];
+	NSMutableDictionary <NSString*, NSDictionary*>*changedSchemas = [NSMutableDictionary new];
+	NSMutableArray <NSString*>*setupOrder = [NSMutableArray new];
+	BOOL hasLoggedMissingClasses = NO;
+	for (NSString *path in pathsForClassNames)
 	{
-		for (NSString* tableName in tableNames)
+		NSArray<NSString*>* tableNames = pathsForClassNames[path];
+		if (tableNames.count == 0)
+			continue;
+		AFMDatabase *fileDB = [self queueForTable:tableNames.firstObject].database;
+		NSString *buildIdentifier = [self buildIdentifierForTables:tableNames];
+		NSDictionary *metadata = [self schemaMetadataInDB:fileDB];
+		BOOL schemaIsUnchanged = NO;
+		if ([metadata[AUTO_METADATA_BUILD] isEqual:buildIdentifier] && [self loadTableSyntax:metadata[AUTO_METADATA_SYNTAX] tables:tableNames])
 		{
-			Class classObject = NSClassFromString(tableName);
-			[self createTableSyntax:classObject];
-			if (hasSetupObservingProperties == NO && [classObject preventObservingProperties] == NO)
+			//the same binary as last time, the model cannot have changed.
+			schemaIsUnchanged = YES;
+		}
+		else
+		{
+			if (DEBUG && hasLoggedMissingClasses == NO)
 			{
-				//even if we destroy the DB we cannot run this twice, so we must have a hasSetupObservingProperties.
-				[self setupObservingProperties:classObject];
+				hasLoggedMissingClasses = YES;
+				[self logMissingClasses:pathsForClassNames];
 			}
-			objc_setAssociatedObject(classObject, @selector(tableCache), [AutoConcurrentMapTable strongToWeakObjectsMapTable], OBJC_ASSOCIATION_RETAIN_NONATOMIC);
-			
-			AFMDatabase *db = [[classObject databaseQueue] database];
-			NSString *createTable = [self generateTableSyntax:tableName];
-			//TODO: compare with existing syntax!
-			if ([db executeUpdate:createTable] == NO)
+			for (NSString* tableName in tableNames)
 			{
-				NSLog(@"error: %@", [db lastErrorMessage]);
+				[self createTableSyntax:NSClassFromString(tableName)];
 			}
-			
-			if ([self createIndexInTable:tableName inDB:db])
+			NSDictionary *newMetadata = [self schemaMetadataForTables:tableNames buildIdentifier:buildIdentifier];
+			if ([metadata[AUTO_METADATA_HASH] isEqual:newMetadata[AUTO_METADATA_HASH]])
 			{
-				//couldn't add index - likely the column does not exist yet.
-				needsMigration = YES;
-				[lightweightMigrateTables addObject:tableName];
+				//a new build with the same model, remember the build so the next launch can skip introspection as well.
+				schemaIsUnchanged = YES;
+				[self storeSchemaMetadata:newMetadata inDB:fileDB];
 			}
-			
-			NSMutableDictionary *columnsInDB = [NSMutableDictionary dictionary];
-			NSString *query = [NSString stringWithFormat:@"PRAGMA table_info(%@);", tableName];
-			AFMResultSet *result = [db executeQuery:query];
-			while ([result next])
+			else
 			{
-				//column name, data type, whether or not the column can be NULL, and the default value for the column (we only need name and data type
-				columnsInDB[result[1]] = result[2];
+				changedSchemas[path] = newMetadata;
 			}
-			[result close];
-			
-			NSMutableDictionary *syntax = tableSyntax[tableName];
-			
-			//check for unique constraints
-			NSMutableArray *uniqueColumns = [syntax[AUTO_UNIQUE_COLUMNS] mutableCopy];
-			query = [NSString stringWithFormat:@"SELECT sql FROM sqlite_master WHERE name = '%@';", tableName];
-			result = [db executeQuery:query];
-			[result next];
-			NSString *table = result[0];
-			for (NSString *row in [table componentsSeparatedByString:@"\n"])
+		}
+		
+		for (NSString* tableName in tableNames)
+		{
+			Class classObject = NSClassFromString(tableName);
+			if (hasSetupObservingProperties == NO && [classObject preventObservingProperties] == NO)
 			{
-				//the actual query, here we can also find keys.
-				NSRange range = [row rangeOfString:@"unique("];
-				if (range.length)
-				{
-					NSString *constraint = [row substringFromIndex:NSMaxRange(range)];
-					constraint = [constraint substringToIndex:[constraint rangeOfString:@")"].location];
-					NSArray *existingUniqueStatement = [constraint componentsSeparatedByString:@","];
-					BOOL hasFound = NO;
-					for (NSArray *newUniqueStatement in uniqueColumns)
-					{
-						if ([newUniqueStatement isEqualToArray:existingUniqueStatement])
-						{
-							hasFound = YES;
-						}
-					}
-					if (!hasFound)
-					{
-						needsMigration = YES;
-						syntax[AUTO_UNIQUE_COLUMNS_UPDATE] = @1;
-						[lightweightMigrateTables addObject:tableName];
-					}
-					else
-					{
-						[uniqueColumns removeObject:existingUniqueStatement];
-					}
-				}
+				//even if we destroy the DB we cannot run this twice, so we must have a hasSetupObservingProperties.
+				[self setupObservingProperties:classObject];
 			}
-			[result close];
-			if (uniqueColumns.count)
+			if (hasSetupObservingProperties == NO)
+				[classObject setupRelationFaults];
+			[AutoModelRelation compileRelationsForClass:classObject];
+			if (schemaIsUnchanged == NO)
 			{
-				needsMigration = YES;
-				syntax[AUTO_UNIQUE_COLUMNS_UPDATE] = @1;
-				[lightweightMigrateTables addObject:tableName];
+				[willMigrateTables addObject:tableName];
+				[setupOrder addObject:tableName];
 			}
-			
-			//check for missing columns
-			NSDictionary *columnSyntax = syntax[AUTO_COLUMN_KEY];
-			NSArray *fieldNames = AUTO_SQLITE_FIELD_NAMES;
-			[columnSyntax enumerateKeysAndObjectsUsingBlock:^(NSString *columnName, NSNumber *columnType, BOOL *stop)
-			 {
-				NSString *columnTypeString = [fieldNames objectAtIndex:columnType.integerValue];
-				if (columnsInDB[columnName] == nil)
-				{
-					needsMigration = YES;
-					[lightweightMigrateTables addObject:tableName];	   //we need to migrate if we are missing columns.
-				}
-				else if ([columnsInDB[columnName] isEqualToString:columnTypeString] == NO)
-				{
-					//change type of column - we must do this. SQLite claims to not care about types (according to the docs), but it is not technically possible, e.g. changing a 64 bit float to 64 bit int.
-					needsMigration = YES;
-					[lightweightMigrateTables addObject:tableName];
-					//NSLog(@"column is not equal %@ %@ %@", columnName, columnsInDB[columnName], columnTypeString);
-				}
-			}];
-			
-			//check for deleted columns
-			[columnsInDB enumerateKeysAndObjectsUsingBlock:^(NSString *columnName, NSString *columnType, BOOL *stop)
-			 {
-				if (columnSyntax[columnName] == nil)
-				{
-					[lightweightMigrateTables addObject:tableName];
-					needsMigration = YES;
-				}
-			}];
 		}
 	}
 	hasSetupObservingProperties = YES;
 	
+	unpreparedTables = [NSMutableSet setWithArray:setupOrder];
+	migratedTables = [NSMutableSet new];
+	migrationErrors = [NSMutableDictionary new];
+	copyGroups = [NSMutableDictionary new];
+	migrationBlock = migrateBlock;
 	if (migrateBlock)
-		migrateBlock(MigrationStateStart, lightweightMigrateTables, nil);
+		migrateBlock(MigrationStateStart, willMigrateTables, nil);
 	
-	if (lightweightMigrateTables.count)
+	//from here on tables are set up on their own thread, so queries to tables that are ready are not held back by the others.
+	hasTableSyntax = YES;
+	for (AFMDatabaseQueue *queue in allQueues)
 	{
-		//NOTE: if there are problems with lightweightMigration we can only ask for someone to fix it, and continue the best we can.
-		NSArray *errors = [self lightweightMigration:lightweightMigrateTables];
-		if (migrateBlock) migrateBlock(MigrationStateComplete, lightweightMigrateTables, errors);
+		[queue.thread start];
+	}
+	
+	//warm up the rest in priority order, tables used before we get to them are set up on demand. Files are independent, so each file is warmed up concurrently.
+	[setupOrder sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(NSString *tableName, NSString *otherTableName)
+	{
+		NSInteger priority = [NSClassFromString(tableName) setupPriority], otherPriority = [NSClassFromString(otherTableName) setupPriority];
+		if (priority == otherPriority)
+			return NSOrderedSame;
+		return priority > otherPriority ? NSOrderedAscending : NSOrderedDescending;
+	}];
+	NSArray <NSString*>*changedPaths = changedSchemas.allKeys;
+	dispatch_apply(changedPaths.count, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t index)
+	{
+		NSString *path = changedPaths[index];
+		NSSet <NSString*>*fileTables = [NSSet setWithArray:pathsForClassNames[path]];
+		for (NSString *tableName in setupOrder)
+		{
+			if ([fileTables containsObject:tableName])
+				[self setupTableIfNeeded:NSClassFromString(tableName)];
+		}
+		
+		//tables set up on demand may still be running
+		AFMDatabaseQueue *queue = [self queueForTable:pathsForClassNames[path].firstObject];
+		[queue.thread syncPerformBlock:^{}];
+		//and so may tables copied in the background
+		dispatch_group_t copyGroup;
+		@synchronized (self->unpreparedTables)
+		{
+			copyGroup = self->copyGroups[path];
+		}
+		if (copyGroup)
+			dispatch_group_wait(copyGroup, DISPATCH_TIME_FOREVER);
+		
+		NSMutableArray <NSError*>*fileErrors = [NSMutableArray new];
+		@synchronized (self->unpreparedTables)
+		{
+			for (NSString *tableName in fileTables)
+			{
+				if (self->migrationErrors[tableName])
+					[fileErrors addObjectsFromArray:self->migrationErrors[tableName]];
+			}
+		}
+		
+		//only remember schemas that made it into the file, otherwise we try again next launch.
+		if (fileErrors.count == 0)
+		{
+			[queue.thread syncPerformBlock:^{
+				[self storeSchemaMetadata:changedSchemas[path] inDB:queue.database];
+			}];
+		}
+		if (migrateBlock)
+			migrateBlock(MigrationStateFileComplete, fileTables.mutableCopy, fileErrors.count ? fileErrors : nil);
+	});
+	
+	NSMutableArray <NSError*>*errors = [NSMutableArray new];
+	for (NSArray *tableErrors in migrationErrors.allValues)
+	{
+		[errors addObjectsFromArray:tableErrors];
+	}
+	migrationBlock = nil;
+	if (migrateBlock)
+	{
+		if (migratedTables.count)
+			migrateBlock(MigrationStateComplete, migratedTables, errors.count ? errors : nil);
+		else
+			migrateBlock(MigrationStateComplete, nil, errors.count ? errors : nil);
 	}
-	else if (migrateBlock)
-		migrateBlock(MigrationStateComplete, nil, nil);
 	
-	//kill semaphore after migration
 	[self killSemaphore];
+	
+	//indexes queued now or by an earlier launch are built when setup is done
 	for (AFMDatabaseQueue *queue in allQueues)
 	{
-		[queue.thread start];
+		[self buildPendingIndexesInQueue:queue];
 	}
 	
 	//also check if we need syncing - TODO: do this properly instead!
 	//if (AutoSyncHandlerClass && pathsForClassNames) [AutoSyncHandlerClass setupSync:pathsForClassNames];
 }
 
+- (AFMDatabaseQueue*) queueForTable:(NSString*)tableName
+{
+	//not using databaseQueue since that would set up the table
+	return objc_getAssociatedObject(NSClassFromString(tableName), @selector(databaseQueue));
+}
+
+- (void) setupTableIfNeeded:(Class)classObject
+{
+	if (isSetup || !setupLockQueue)
+		return;
+	AUTO_WAIT_FOR_TABLE_SYNTAX
+	
+	NSString *tableName = NSStringFromClass(classObject);
+	@synchronized (unpreparedTables)
+	{
+		if ([unpreparedTables containsObject:tableName] == NO)
+			return;
+	}
+	
+	//run on the table's own thread, so it is serialized with its queries (and recursive calls from within the setup just run inline).
+	AFMDatabaseQueue *queue = [self queueForTable:tableName];
+	[queue.thread syncPerformBlock:^{
+		
+		@synchronized (self->unpreparedTables)
+		{
+			if ([self->unpreparedTables containsObject:tableName] == NO)
+				return;
+			[self->unpreparedTables removeObject:tableName];
+		}
+		[self setupTable:tableName inDB:queue.database];
+	}];
+}
+
+- (void) queueSetupOfTable:(Class)classObject
+{
+	if (isSetup || !setupLockQueue)
+		return;
+	AUTO_WAIT_FOR_TABLE_SYNTAX
+	
+	NSThread *thread = [self queueForTable:NSStringFromClass(classObject)].thread;
+	if ([NSThread.currentThread isKindOfClass:AutoThread.class] == NO || [NSThread.currentThread isEqual:thread])
+	{
+		[self setupTableIfNeeded:classObject];
+		return;
+	}
+	
+	//we are inside another file's block, waiting here while that file's thread is blocked could deadlock if the setup needs that file. The table's thread runs blocks in order, so queueing the setup first is enough for the query that follows.
+	NSString *tableName = NSStringFromClass(classObject);
+	@synchronized (unpreparedTables)
+	{
+		if ([unpreparedTables containsObject:tableName] == NO)
+			return;
+	}
+	[thread asyncExecuteBlock:^{
+		[self setupTableIfNeeded:classObject];
+	}];
+}
+
+///Create the table, its indexes and join tables. Then compare with the table in the DB and migrate if they differ.
+- (void) setupTable:(NSString*)tableName inDB:(AFMDatabase *)db
+{
+	Class classObject = NSClassFromString(tableName);
+	__block BOOL tableNeedsMigration = NO;
+	NSDictionary *marker = [self migrationMarkerForTable:tableName inDB:db];
+	if (marker)
+	{
+		//we were interrupted while copying, continue where we were. The table is checked again when the copy has replaced it.
+		@synchronized (unpreparedTables)
+		{
+			[migratedTables addObject:tableName];
+		}
+		[self startCopyOfTable:tableName marker:marker inDB:db];
+		[AutoModelRelation createJoinTablesForClass:classObject inDB:db];
+		return;
+	}
+	NSString *createTable = [self generateTableSyntax:tableName];
+	//TODO: compare with existing syntax!
+	if ([db executeUpdate:createTable] == NO)
+	{
+		NSLog(@"error: %@", [db lastErrorMessage]);
+	}
+	
+	if ([self createIndexInTable:tableName inDB:db])
+	{
+		//couldn't add index - likely the column does not exist yet.
+		tableNeedsMigration = YES;
+	}
+	[AutoModelRelation createJoinTablesForClass:classObject inDB:db];
+	
+	NSMutableDictionary *columnsInDB = [NSMutableDictionary dictionary];
+	NSString *query = [NSString stringWithFormat:@"PRAGMA table_info(%@);", tableName];
+	AFMResultSet *result = [db executeQuery:query];
+	while ([result next])
+	{
+		//column name, data type, whether or not the column can be NULL, and the default value for the column (we only need name and data type
+		columnsInDB[result[1]] = result[2];
+	}
+	[result close];
+	
+	NSMutableDictionary *syntax = tableSyntax[tableName];
+	
+	//check for unique constraints
+	NSMutableArray *uniqueColumns = [syntax[AUTO_UNIQUE_COLUMNS] mutableCopy];
+	query = [NSString stringWithFormat:@"SELECT sql FROM sqlite_master WHERE name = '%@';", tableName];
+	result = [db executeQuery:query];
+	[result next];
+	NSString *table = result[0];
+	for (NSString *row in [table componentsSeparatedByString:@"\n"])
+	{
+		//the actual query, here we can also find keys.
+		NSRange range = [row rangeOfString:@"unique("];
+		if (range.length)
+		{
+			NSString *constraint = [row substringFromIndex:NSMaxRange(range)];
+			constraint = [constraint substringToIndex:[constraint rangeOfString:@")"].location];
+			NSArray *existingUniqueStatement = [constraint componentsSeparatedByString:@","];
+			BOOL hasFound = NO;
+			for (NSArray *newUniqueStatement in uniqueColumns)
+			{
+				if ([newUniqueStatement isEqualToArray:existingUniqueStatement])
+				{
+					hasFound = YES;
+				}
+			}
+			if (!hasFound)
+			{
+				syntax[AUTO_UNIQUE_COLUMNS_UPDATE] = @1;
+				tableNeedsMigration = YES;
+			}
+			else
+			{
+				[uniqueColumns removeObject:existingUniqueStatement];
+			}
+		}
+	}
+	[result close];
+	if (uniqueColumns.count)
+	{
+		syntax[AUTO_UNIQUE_COLUMNS_UPDATE] = @1;
+		tableNeedsMigration = YES;
+	}
+	
+	//check for missing columns
+	NSDictionary *columnSyntax = syntax[AUTO_COLUMN_KEY];
+	NSArray *fieldNames = AUTO_SQLITE_FIELD_NAMES;
+	[columnSyntax enumerateKeysAndObjectsUsingBlock:^(NSString *columnName, NSNumber *columnType, BOOL *stop)
+	 {
+		NSString *columnTypeString = [fieldNames objectAtIndex:columnType.integerValue];
+		if (columnsInDB[columnName] == nil)
+		{
+			tableNeedsMigration = YES;	   //we need to migrate if we are missing columns.
+		}
+		else if ([columnsInDB[columnName] isEqualToString:columnTypeString] == NO)
+		{
+			//change type of column - we must do this. SQLite claims to not care about types (according to the docs), but it is not technically possible, e.g. changing a 64 bit float to 64 bit int.
+			tableNeedsMigration = YES;
+			//NSLog(@"column is not equal %@ %@ %@", columnName, columnsInDB[columnName], columnTypeString);
+		}
+	}];
+	
+	//check for deleted columns
+	[columnsInDB enumerateKeysAndObjectsUsingBlock:^(NSString *columnName, NSString *columnType, BOOL *stop)
+	 {
+		if (columnSyntax[columnName] == nil)
+		{
+			tableNeedsMigration = YES;
+		}
+	}];
+	
+	if (tableNeedsMigration)
+	{
+		//NOTE: if there are problems with lightweightMigration we can only ask for someone to fix it, and continue the best we can.
+		NSArray *errors = [self lightweightMigration:[NSMutableSet setWithObject:tableName]];
+		@synchronized (unpreparedTables)
+		{
+			[migratedTables addObject:tableName];
+			if (errors.count)
+				migrationErrors[tableName] = [migrationErrors[tableName] ?: @[] arrayByAddingObjectsFromArray:errors];
+		}
+	}
+}
+
 //default implementation does nothing
 + (void) setupSync:(NSDictionary <NSString*, NSArray <NSString*>*> *)pathsForClassNames{};
 + (void) mainSync{};
@@ -586,24 +824,17 @@ static AutoDB *sharedInstance = nil;
 {
 	NSLog(@"db is now setup");
 	isSetup = YES;
-	
-	/*
-	 A better system:
-	 We only need AUTO_WAIT_FOR_SETUP when asking for table-info.
-	 1. Always wrap those questions in a function.
-	 2. Check if setup is complete, otherwise enqueue onto a thread.
-	 */
+	dispatch_group_leave(setupGroup);
 }
 
 - (nullable NSArray <NSError*>*) lightweightMigration:(NSMutableSet*)migrateTables
 {
 	NSArray *fieldNames = AUTO_SQLITE_FIELD_NAMES;
+	NSMutableArray <NSError*>*errors = [NSMutableArray new];
 	for (NSString *tableName in migrateTables)
 	{
-		Class classObject = NSClassFromString(tableName);
-		AFMDatabase *db = [classObject databaseQueue].database;
+		AFMDatabase *db = [self queueForTable:tableName].database;
 		NSDictionary *syntax = tableSyntax[tableName];
-		NSString *createTable = [self generateTableSyntax:tableName];
 		NSMutableSet *allowNull = syntax[@"ALLOW_NULL"];
 		
 		NSString *query = [NSString stringWithFormat:@"PRAGMA table_info(%@);", tableName];
@@ -639,7 +870,7 @@ static AutoDB *sharedInstance = nil;
 				NSString *addColumnSyntax = [NSString stringWithFormat:@"ALTER TABLE %@ ADD %@ %@%@", tableName, columnName, columnTypeString, nullRestriction];
 				[addColumnStatements addObject:addColumnSyntax];
 				
-				__block BOOL columnExistsInBothTables = NO;
+				//columns without an old name are added to the old table before it is copied, so they are copied as they are.
 				[syntax[@"MIGRATE_PARAMETERS"] enumerateKeysAndObjectsUsingBlock:^(NSString* oldName, NSString* newName, BOOL *stop)
 				{
 					if ([newName isEqualToString:columnName] && columnsInDB[oldName])
@@ -649,16 +880,9 @@ static AutoDB *sharedInstance = nil;
 						{
 							[oldTableColumns replaceObjectAtIndex:index withObject:oldName];
 							onlyAddColumn = NO;
-							columnExistsInBothTables = YES; //please explain this
 						}
 					}
 				}];
-				if (columnExistsInBothTables == NO)
-				{
-					//NSLog(@"We don't have column %@ in the new and the old table for %@. All its values will be removed and its default will be used.", columnName, tableName);
-					[newTableColumns removeObject:columnName];
-					[oldTableColumns removeObject:columnName];
-				}
 			}
 			else if ([columnsInDB[columnName] isEqualToString:columnTypeString] == NO)
 			{
@@ -686,128 +910,29 @@ static AutoDB *sharedInstance = nil;
 		}
 		else
 		{
-			NSString *oldTableName = [NSString stringWithFormat:@"%@_OLD", tableName];
-			[db executeUpdate:[NSString stringWithFormat:@"DROP TABLE IF EXISTS %@", oldTableName]]; //drops the old table
-			
-			BOOL success = [db executeUpdate:[NSString stringWithFormat:@"ALTER TABLE %@ RENAME TO %@", tableName, oldTableName]];	   //renames the old table
-			if (!success)
-			{
-				//TODO: handle error
-				NSLog(@"Could not handle rename %@ in migration! What now?", tableName);
-			}
-			success = [db executeUpdate:createTable]; //creates the new table with all correct properties
-			if (!success)
-			{
-				//TODO: handle error
-				NSLog(@"Could not handle create table %@ during migration! What now?", tableName);
-			}
-			NSString *query = [NSString stringWithFormat:@"INSERT OR IGNORE INTO %@ (%@) SELECT %@ FROM %@;", tableName, [newTableColumns componentsJoinedByString:@","], [oldTableColumns componentsJoinedByString:@","], oldTableName];
-			if ([db executeUpdate:query])
-			{
-				//inserts all data from the old table to the new, this is a remarkably fast operation.
-				[db executeUpdate:[NSString stringWithFormat:@"DROP TABLE %@", oldTableName]]; //drops the old table
-			}
-			else
-			{
-				//failing! we need to rollback...
-				NSLog(@"error failing! we need to rollback...");
-				[db executeUpdate:[NSString stringWithFormat:@"DROP TABLE %@", tableName]]; //drops the old table
-				[db executeUpdate:[NSString stringWithFormat:@"ALTER TABLE %@ RENAME TO %@", oldTableName, tableName]];	   //renames back again.
-			}
-			
-			//Here we give the user the choice to translate the old values somehow. They can do this however they want.
-			//Note: IF the app dies due to user implementing a bug, it will magically work again when relaunched - since we won't do this twice, the DB is already copied!
+			//columns that change type are converted by the model class while copying
+			NSMutableDictionary <NSString*, NSArray <NSNumber*>*>*convertColumns = [NSMutableDictionary new];
 			[columnSyntax enumerateKeysAndObjectsUsingBlock:^(NSString *columnName, NSNumber *columnType, BOOL *stop)
 			{
 				NSString *columnTypeString = [fieldNames objectAtIndex:columnType.integerValue];
 				NSString *existingColumnName = columnsInDB[columnName];
 				if (existingColumnName && [existingColumnName isEqualToString:columnTypeString] == NO)
 				{
-					AutoFieldType oldType = [fieldNames indexOfObject:existingColumnName];
-					AutoFieldType newType = columnType.integerValue;
-					
-					//Select all values on the form (id, columnName) and give it as an array to the user
-					//they return a new array with new tuples which we save.
-					NSMutableArray *arrayOfTuples = [NSMutableArray new];
-					AFMResultSet *resultSet = [db executeQuery:[NSString stringWithFormat:@"SELECT id, %@ FROM %@", columnName, tableName]];
-					while ([resultSet next])
-					{
-						id firstValue = resultSet[0];
-						if (!firstValue)
-							firstValue = [NSNull null];
-						id secondValue = resultSet[1];
-						if (!secondValue)
-							secondValue = [NSNull null];
-						
-						[arrayOfTuples addObject:[NSMutableArray arrayWithObjects:firstValue, secondValue, nil]];
-					}
-					[classObject migrateTable:tableName column:columnName oldType:oldType newType:newType values:arrayOfTuples];
-					BOOL correctType = NO;
-					if (arrayOfTuples.count)
-					{
-						NSInteger index = 0;
-						id firstObject = arrayOfTuples[index][1];
-						while (firstObject == [NSNull null] && index < arrayOfTuples.count)
-						{
-							index++;
-							firstObject = arrayOfTuples[index][1];
-						}
-						switch (newType)
-						{
-							case AutoFieldTypeBlob:
-								if ([firstObject isKindOfClass:[NSData class]])
-									correctType = YES;
-								break;
-							case AutoFieldTypeDate:
-								if ([firstObject isKindOfClass:[NSNumber class]])
-									correctType = YES;
-								break;
-							case AutoFieldTypeText:
-								if ([firstObject isKindOfClass:[NSString class]])
-									correctType = YES;
-								break;
-							case AutoFieldTypeDouble:
-							case AutoFieldTypeInteger:
-							case AutoFieldTypeNumber:
-								if ([firstObject isKindOfClass:[NSNumber class]])
-									correctType = YES;
-								break;
-							default:
-								break;
-						}
-					}
-					if (correctType && arrayOfTuples.count)
-					{
-						//group with regard to maxVariableLimit, so we can update without errors.
-						NSUInteger maxVariableLimit = 200000;
-						NSUInteger objectCount = 0;
-						NSMutableArray *parameters = [NSMutableArray new];
-						for (NSArray *tuple in arrayOfTuples)
-						{
-							[parameters addObjectsFromArray:tuple];
-							objectCount++;
-							if (parameters.count >= maxVariableLimit)
-							{
-								[self convertParameters:parameters objectCount:objectCount tableName:tableName columnName:columnName db:db];
-								objectCount = 0;
-								[parameters removeAllObjects];
-							}
-						}
-						if (objectCount)
-						{
-							[self convertParameters:parameters objectCount:objectCount tableName:tableName columnName:columnName db:db];
-						}
-					}
+					convertColumns[columnName] = @[@([fieldNames indexOfObject:existingColumnName]), columnType];
 				}
 			}];
+			NSError *error = [self copyTable:tableName newColumns:newTableColumns oldColumns:oldTableColumns convertColumns:convertColumns inDB:db];
+			if (error)
+				[errors addObject:error];
+			//indexes are created when the copy replaces the table
+			continue;
 		}
 		
 		if ([self createIndexInTable:tableName inDB:db])
 			NSLog(@"could not set index after migration: %@", tableName);
 	}
 	
-	needsMigration = NO;
-	return nil;
+	return errors.count ? errors : nil;
 }
 
 - (NSMutableArray <NSString*>*) modelClassesFromRuntime
@@ -846,33 +971,377 @@ static AutoDB *sharedInstance = nil;
 	return modelClasses.allObjects.mutableCopy;
 }
 
-- (nullable NSError*) convertParameters:(NSArray*)parameters objectCount:(NSUInteger)objectCount tableName:(NSString*)tableName columnName:(NSString*)columnName db:(AFMDatabase *)db
+#pragma mark - chunked copy
+
+- (nullable NSDictionary*) migrationMarkerForTable:(NSString*)tableName inDB:(AFMDatabase *)db
 {
-	NSString *questionMarks = [AutoModel questionMarksForQueriesWithObjects:objectCount columns:2];
-	NSString *query = [NSString stringWithFormat:@"INSERT OR REPLACE INTO %@ (id, %@) VALUES %@", tableName, columnName, questionMarks];
-	NSError* error = nil;
-	BOOL success = [db executeUpdate:query withArgumentsInArray:parameters];
-	if (!success)
+	AFMResultSet *result = [db executeQuery:@"SELECT name FROM sqlite_master WHERE type = 'table' AND name = ?", AUTO_MIGRATION_TABLE];
+	BOOL hasMarkers = [result next];
+	[result close];
+	if (!hasMarkers)
+		return nil;
+	
+	NSDictionary *marker = nil;
+	result = [db executeQuery:[NSString stringWithFormat:@"SELECT last_id, old_columns, new_columns, convert_columns, row_count, copied FROM %@ WHERE table_name = ?", AUTO_MIGRATION_TABLE], tableName];
+	if ([result next])
 	{
-		error = db.lastError;
+		marker = [result resultDictionary];
 	}
-	return error;
+	[result close];
+	return marker;
 }
 
-- (NSString*) generateTableSyntax:(NSString*)tableName
+/**
+ Copy a table into a new one with the current syntax, for when we cannot just add columns. Rows are copied in chunks of AUTO_MIGRATION_CHUNK_SIZE on a connection of its own, each chunk in its own transaction that also persists how far we have come. If the app dies we continue from there at next launch.
+ Meanwhile the old table is used as before: missing columns are added to it, and renamed columns are read from their old name until written. Triggers remember the rows written during the copy, they are copied again when the copy replaces the old table.
+ */
+- (nullable NSError*) copyTable:(NSString*)tableName newColumns:(NSArray <NSString*>*)newColumns oldColumns:(NSArray <NSString*>*)oldColumns convertColumns:(NSDictionary <NSString*, NSArray <NSNumber*>*>*)convertColumns inDB:(AFMDatabase *)db
 {
+	NSString *copyName = [tableName stringByAppendingString:AUTO_MIGRATION_SUFFIX];
+	NSString *dirtyName = [tableName stringByAppendingString:AUTO_MIGRATION_DIRTY_SUFFIX];
 	NSDictionary *syntax = tableSyntax[tableName];
-	NSMutableArray *columns = [NSMutableArray array];
+	NSDictionary *columnSyntax = syntax[AUTO_COLUMN_KEY];
 	NSMutableSet *allowNull = syntax[@"ALLOW_NULL"];
-	NSArray *fieldNames = AUTO_SQLITE_FIELD_NAMES;
-	
-	//start with default values now.
 	NSDictionary *defaultValues = syntax[@"DEFAULT"];
+	NSArray *fieldNames = AUTO_SQLITE_FIELD_NAMES;
+	NSMutableArray <NSString*>*convertStrings = [NSMutableArray new];
+	[convertColumns enumerateKeysAndObjectsUsingBlock:^(NSString *columnName, NSArray <NSNumber*>*types, BOOL *stop)
+	{
+		[convertStrings addObject:[NSString stringWithFormat:@"%@:%@:%@", columnName, types[0], types[1]]];
+	}];
+	AFMResultSet *result = [db executeQuery:[NSString stringWithFormat:@"SELECT count(*) FROM %@", tableName]];
+	NSNumber *rowCount = [result next] ? result[0] : @0;
+	[result close];
+	NSMutableSet <NSString*>*columnsInDB = [NSMutableSet new];
+	result = [db executeQuery:[NSString stringWithFormat:@"PRAGMA table_info(%@);", tableName]];
+	while ([result next])
+	{
+		[columnsInDB addObject:result[1]];
+	}
+	[result close];
 	
-	[syntax[AUTO_COLUMN_KEY] enumerateKeysAndObjectsUsingBlock:^(NSString *columnName, NSNumber *columnType, BOOL *stop)
+	//the old columns are also what we read from until the copy is done, so renamed columns get their new name. Columns the old table lacks are added to it, renamed ones allow NULL so we know when they are written.
+	NSMutableArray <NSString*>*selectColumns = [NSMutableArray new];
+	NSMutableArray <NSString*>*addColumnStatements = [NSMutableArray new];
+	for (NSUInteger index = 0; index < newColumns.count; index++)
 	{
-		 NSString *primaryKey = @"";
-		 NSString *nullRestriction = @" NOT NULL";
+		NSString *columnName = newColumns[index];
+		BOOL isRenamed = [oldColumns[index] isEqualToString:columnName] == NO;
+		if (isRenamed)
+			[selectColumns addObject:[NSString stringWithFormat:@"COALESCE(%@, %@) AS %@", columnName, oldColumns[index], columnName]];
+		else
+			[selectColumns addObject:columnName];
+		if ([columnsInDB containsObject:columnName])
+			continue;
+		
+		NSNumber *columnType = columnSyntax[columnName];
+		NSString *nullRestriction = @"";
+		if (isRenamed == NO)
+		{
+			if (defaultValues[columnName])
+				nullRestriction = [NSString stringWithFormat:@" DEFAULT %@", defaultValues[columnName]];
+			else if (columnType.integerValue != AutoFieldTypeDate && [allowNull containsObject:columnName] == NO)
+				nullRestriction = @" DEFAULT 0";
+			if (columnType.integerValue != AutoFieldTypeDate && [allowNull containsObject:columnName] == NO)
+				nullRestriction = [@" NOT NULL" stringByAppendingString:nullRestriction];
+		}
+		[addColumnStatements addObject:[NSString stringWithFormat:@"ALTER TABLE %@ ADD %@ %@%@", tableName, columnName, fieldNames[columnType.integerValue], nullRestriction]];
+	}
+	
+	[db beginTransaction];
+	NSString *createMarkers = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ (table_name TEXT PRIMARY KEY, last_id INTEGER NOT NULL, old_columns TEXT NOT NULL, new_columns TEXT NOT NULL, convert_columns TEXT NOT NULL, row_count INTEGER NOT NULL, copied INTEGER NOT NULL)", AUTO_MIGRATION_TABLE];
+	NSString *insertMarker = [NSString stringWithFormat:@"INSERT OR REPLACE INTO %@ (table_name, last_id, old_columns, new_columns, convert_columns, row_count, copied) VALUES (?, ?, ?, ?, ?, ?, 0)", AUTO_MIGRATION_TABLE];
+	BOOL success = [db executeUpdate:createMarkers] &&
+		[db executeUpdate:[NSString stringWithFormat:@"DROP TABLE IF EXISTS %@", copyName]] &&
+		[db executeUpdate:[self generateTableSyntax:tableName named:copyName]] &&
+		[db executeUpdate:[NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ (id INTEGER PRIMARY KEY)", dirtyName]] &&
+		[db executeUpdate:insertMarker, tableName, @(LLONG_MIN), [selectColumns componentsJoinedByString:@","], [newColumns componentsJoinedByString:@","], [convertStrings componentsJoinedByString:@","], rowCount];
+	for (NSString *statement in addColumnStatements)
+	{
+		success = success && [db executeUpdate:statement];
+	}
+	for (NSString *event in @[@"INSERT", @"UPDATE", @"DELETE"])
+	{
+		NSString *rows = [event isEqualToString:@"INSERT"] ? @"(NEW.id)" : [event isEqualToString:@"DELETE"] ? @"(OLD.id)" : @"(OLD.id), (NEW.id)";
+		NSString *trigger = [NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS %@_%@ AFTER %@ ON %@ BEGIN INSERT OR IGNORE INTO %@ (id) VALUES %@; END", dirtyName, event.lowercaseString, event, tableName, dirtyName, rows];
+		success = success && [db executeUpdate:trigger];
+	}
+	if (!success)
+	{
+		NSError *error = db.lastError;
+		[db rollback];
+		NSLog(@"Could not start migration of %@: %@", tableName, error);
+		return error;
+	}
+	[db commit];
+	
+	[self startCopyOfTable:tableName marker:[self migrationMarkerForTable:tableName inDB:db] inDB:db];
+	return nil;
+}
+
+///Copy the rows on a background queue, until it is done the table is read with the old columns of the marker. Called on the table's own thread.
+- (void) startCopyOfTable:(NSString*)tableName marker:(NSDictionary*)marker inDB:(AFMDatabase *)db
+{
+	Class classObject = NSClassFromString(tableName);
+	AFMDatabaseQueue *queue = [self queueForTable:tableName];
+	NSString *path = queue.path;
+	int openFlags = queue.openFlags;
+	[db setRetryTimeout:AUTO_MIGRATION_BUSY_TIMEOUT];
+	[self setSelectQuery:[NSString stringWithFormat:@"SELECT %@ FROM %@ ", marker[@"old_columns"], tableName] forClass:classObject];
+	
+	dispatch_group_t copyGroup;
+	@synchronized (unpreparedTables)
+	{
+		copyGroup = copyGroups[path];
+		if (!copyGroup)
+		{
+			copyGroup = dispatch_group_create();
+			copyGroups[path] = copyGroup;
+		}
+	}
+	dispatch_group_async(copyGroup, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+		
+		__block NSError *error = nil;
+		AFMDatabase *copyDB = [AFMDatabase databaseWithPath:path];
+		copyDB.busyTimeout = AUTO_MIGRATION_BUSY_TIMEOUT;
+		if ([copyDB openWithFlags:openFlags])
+			error = [self copyTableInChunks:tableName marker:marker inDB:copyDB];
+		else
+			error = [NSError errorWithDomain:@"AUTO_DB" code:SQLITE_CANTOPEN userInfo:@{@"localizedDescription": [NSString stringWithFormat:@"Could not open %@ to copy %@", path, tableName]}];
+		[copyDB close];
+		
+		//the table is replaced on its own thread, so no query sees it half done.
+		[queue.thread syncPerformBlock:^{
+			
+			if (!error)
+				error = [self replaceTableWithCopy:tableName marker:marker inDB:queue.database];
+			if (error)
+				[self abandonCopyOfTable:tableName error:error inDB:queue.database];
+			[self setSelectQuery:nil forClass:classObject];
+			if (!error)
+			{
+				//check the new table, creating its indexes.
+				[self setupTable:tableName inDB:queue.database];
+			}
+		}];
+		if (error)
+		{
+			@synchronized (self->unpreparedTables)
+			{
+				self->migrationErrors[tableName] = [self->migrationErrors[tableName] ?: @[] arrayByAddingObject:error];
+			}
+		}
+	});
+}
+
+- (NSDictionary <NSString*, NSArray <NSNumber*>*>*) convertColumnsForMarker:(NSDictionary*)marker
+{
+	NSMutableDictionary <NSString*, NSArray <NSNumber*>*>*convertColumns = [NSMutableDictionary new];
+	for (NSString *convertString in [marker[@"convert_columns"] componentsSeparatedByString:@","])
+	{
+		NSArray <NSString*>*parts = [convertString componentsSeparatedByString:@":"];
+		if (parts.count == 3)
+			convertColumns[parts[0]] = @[@(parts[1].integerValue), @(parts[2].integerValue)];
+	}
+	return convertColumns;
+}
+
+- (nullable NSError*) copyTableInChunks:(NSString*)tableName marker:(NSDictionary*)marker inDB:(AFMDatabase *)db
+{
+	Class classObject = NSClassFromString(tableName);
+	NSString *copyName = [tableName stringByAppendingString:AUTO_MIGRATION_SUFFIX];
+	NSString *newColumns = marker[@"new_columns"];
+	NSString *oldColumns = marker[@"old_columns"];
+	NSDictionary <NSString*, NSArray <NSNumber*>*>*convertColumns = [self convertColumnsForMarker:marker];
+	
+	NSProgress *progress = [NSProgress progressWithTotalUnitCount:[marker[@"row_count"] longLongValue]];
+	progress.completedUnitCount = [marker[@"copied"] longLongValue];
+	@synchronized (migrationProgress)
+	{
+		migrationProgress[tableName] = progress;
+	}
+	
+	NSString *chunkEndQuery = [NSString stringWithFormat:@"SELECT id FROM %@ WHERE id > ? ORDER BY id LIMIT 1 OFFSET %i", tableName, AUTO_MIGRATION_CHUNK_SIZE - 1];
+	NSString *copyQuery = [NSString stringWithFormat:@"INSERT OR IGNORE INTO %@ (%@) SELECT %@ FROM %@ WHERE id > ? AND id <= ?", copyName, newColumns, oldColumns, tableName];
+	NSString *updateMarker = [NSString stringWithFormat:@"UPDATE %@ SET last_id = ?, copied = copied + ? WHERE table_name = ?", AUTO_MIGRATION_TABLE];
+	long long lastId = [marker[@"last_id"] longLongValue];
+	BOOL isDone = NO;
+	NSError *error = nil;
+	while (!isDone && !error)
+	{
+		@autoreleasepool
+		{
+			AFMResultSet *result = [db executeQuery:chunkEndQuery, @(lastId)];
+			long long chunkEnd = LLONG_MAX;
+			if ([result next])
+				chunkEnd = [result longLongIntForColumnIndex:0];
+			else
+				isDone = YES;
+			[result close];
+			
+			[db beginTransaction];
+			BOOL success = [db executeUpdate:copyQuery, @(lastId), @(chunkEnd)];
+			int copied = [db changes];
+			for (NSString *columnName in convertColumns)
+			{
+				if (!success)
+					break;
+				success = [self convertColumn:columnName table:tableName copy:copyName types:convertColumns[columnName] where:@"id > ? AND id <= ?" arguments:@[@(lastId), @(chunkEnd)] classObject:classObject inDB:db];
+			}
+			success = success && [db executeUpdate:updateMarker, @(chunkEnd), @(copied), tableName];
+			if (!success)
+			{
+				error = db.lastError;
+				[db rollback];
+				break;
+			}
+			[db commit];
+			lastId = chunkEnd;
+			progress.completedUnitCount += copied;
+			if (migrationBlock)
+				migrationBlock(MigrationStateProgress, [NSMutableSet setWithObject:tableName], nil);
+		}
+	}
+	
+	@synchronized (migrationProgress)
+	{
+		[migrationProgress removeObjectForKey:tableName];
+	}
+	return error;
+}
+
+///Copy the rows written since they were copied, then replace the old table with the copy. Called on the table's own thread, after the last chunk.
+- (nullable NSError*) replaceTableWithCopy:(NSString*)tableName marker:(NSDictionary*)marker inDB:(AFMDatabase *)db
+{
+	NSString *copyName = [tableName stringByAppendingString:AUTO_MIGRATION_SUFFIX];
+	NSString *dirtyName = [tableName stringByAppendingString:AUTO_MIGRATION_DIRTY_SUFFIX];
+	AFMResultSet *result = [db executeQuery:@"SELECT name FROM sqlite_master WHERE type = 'table' AND name = ?", dirtyName];
+	BOOL hasDirtyTable = [result next];
+	[result close];
+	
+	[db beginTransaction];
+	BOOL success = YES;
+	if (hasDirtyTable)
+	{
+		//these rows were written by the current model, so their values already have the new types and are not converted again.
+		NSString *dirtyRows = [NSString stringWithFormat:@"id IN (SELECT id FROM %@)", dirtyName];
+		success = [db executeUpdate:[NSString stringWithFormat:@"DELETE FROM %@ WHERE %@", copyName, dirtyRows]] &&
+			[db executeUpdate:[NSString stringWithFormat:@"INSERT OR IGNORE INTO %@ (%@) SELECT %@ FROM %@ WHERE %@", copyName, marker[@"new_columns"], marker[@"old_columns"], tableName, dirtyRows]] &&
+			[db executeUpdate:[NSString stringWithFormat:@"DROP TABLE %@", dirtyName]];
+	}
+	//dropping the table also drops its triggers
+	success = success && [db executeUpdate:[NSString stringWithFormat:@"DROP TABLE %@", tableName]] &&
+		[db executeUpdate:[NSString stringWithFormat:@"ALTER TABLE %@ RENAME TO %@", copyName, tableName]] &&
+		[db executeUpdate:[NSString stringWithFormat:@"DELETE FROM %@ WHERE table_name = ?", AUTO_MIGRATION_TABLE], tableName];
+	if (success)
+	{
+		[db commit];
+		return nil;
+	}
+	NSError *error = db.lastError;
+	[db rollback];
+	return error;
+}
+
+///Leave the old table as it was (with the columns we added), and try again next launch.
+- (void) abandonCopyOfTable:(NSString*)tableName error:(NSError*)error inDB:(AFMDatabase *)db
+{
+	NSLog(@"error migrating %@, keeping the old table: %@", tableName, error);
+	NSString *dirtyName = [tableName stringByAppendingString:AUTO_MIGRATION_DIRTY_SUFFIX];
+	for (NSString *event in @[@"insert", @"update", @"delete"])
+	{
+		[db executeUpdate:[NSString stringWithFormat:@"DROP TRIGGER IF EXISTS %@_%@", dirtyName, event]];
+	}
+	[db executeUpdate:[NSString stringWithFormat:@"DROP TABLE IF EXISTS %@", dirtyName]];
+	[db executeUpdate:[NSString stringWithFormat:@"DROP TABLE IF EXISTS %@", [tableName stringByAppendingString:AUTO_MIGRATION_SUFFIX]]];
+	[db executeUpdate:[NSString stringWithFormat:@"DELETE FROM %@ WHERE table_name = ?", AUTO_MIGRATION_TABLE], tableName];
+}
+
+///Let the model class convert the values of the copied rows matching condition, we give it (id, value) tuples and save what it returns.
+- (BOOL) convertColumn:(NSString*)columnName table:(NSString*)tableName copy:(NSString*)copyName types:(NSArray <NSNumber*>*)types where:(NSString*)condition arguments:(nullable NSArray*)arguments classObject:(Class)classObject inDB:(AFMDatabase *)db
+{
+	NSMutableArray <NSMutableArray*>*arrayOfTuples = [NSMutableArray new];
+	AFMResultSet *resultSet = [db executeQuery:[NSString stringWithFormat:@"SELECT id, %@ FROM %@ WHERE %@", columnName, copyName, condition] withArgumentsInArray:arguments ?: @[]];
+	while ([resultSet next])
+	{
+		id firstValue = resultSet[0];
+		if (!firstValue)
+			firstValue = [NSNull null];
+		id secondValue = resultSet[1];
+		if (!secondValue)
+			secondValue = [NSNull null];
+		
+		[arrayOfTuples addObject:[NSMutableArray arrayWithObjects:firstValue, secondValue, nil]];
+	}
+	[resultSet close];
+	if (arrayOfTuples.count == 0)
+		return YES;
+	
+	AutoFieldType newType = types[1].integerValue;
+	[classObject migrateTable:tableName column:columnName oldType:types[0].integerValue newType:newType values:arrayOfTuples];
+	
+	//only save if the values are of the new type
+	id firstObject = nil;
+	for (NSArray *tuple in arrayOfTuples)
+	{
+		if (tuple[1] != [NSNull null])
+		{
+			firstObject = tuple[1];
+			break;
+		}
+	}
+	BOOL correctType = NO;
+	switch (newType)
+	{
+		case AutoFieldTypeBlob:
+			correctType = [firstObject isKindOfClass:[NSData class]];
+			break;
+		case AutoFieldTypeDate:
+			correctType = [firstObject isKindOfClass:[NSNumber class]];
+			break;
+		case AutoFieldTypeText:
+			correctType = [firstObject isKindOfClass:[NSString class]];
+			break;
+		case AutoFieldTypeDouble:
+		case AutoFieldTypeInteger:
+		case AutoFieldTypeNumber:
+			correctType = [firstObject isKindOfClass:[NSNumber class]];
+			break;
+		default:
+			break;
+	}
+	if (!correctType)
+		return YES;
+	
+	NSString *update = [NSString stringWithFormat:@"UPDATE %@ SET %@ = ? WHERE id = ?", copyName, columnName];
+	for (NSArray *tuple in arrayOfTuples)
+	{
+		if ([db executeUpdate:update, tuple[1], tuple[0]] == NO)
+			return NO;
+	}
+	return YES;
+}
+
+- (NSString*) generateTableSyntax:(NSString*)tableName
+{
+	return [self generateTableSyntax:tableName named:tableName];
+}
+
+///Create statement for the syntax of tableName, creating a table with a different name (e.g. a copy during migration).
+- (NSString*) generateTableSyntax:(NSString*)tableName named:(NSString*)createName
+{
+	NSDictionary *syntax = tableSyntax[tableName];
+	NSMutableArray *columns = [NSMutableArray array];
+	NSMutableSet *allowNull = syntax[@"ALLOW_NULL"];
+	NSArray *fieldNames = AUTO_SQLITE_FIELD_NAMES;
+	
+	//start with default values now.
+	NSDictionary *defaultValues = syntax[@"DEFAULT"];
+	
+	[syntax[AUTO_COLUMN_KEY] enumerateKeysAndObjectsUsingBlock:^(NSString *columnName, NSNumber *columnType, BOOL *stop)
+	{
+		 NSString *primaryKey = @"";
+		 NSString *nullRestriction = @" NOT NULL";
 		 NSString *defaultValue = defaultValues[columnName];
 		 AutoFieldType columnTypeInt = columnType.integerValue;
 		 
@@ -909,28 +1378,364 @@ static AutoDB *sharedInstance = nil;
 	}
 	
 	//Remember that all numbers become REAL since it cannot know what type of number an NSNumber is.
-	NSString *createTable = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ \n( \n%@ \n);", tableName, [columns componentsJoinedByString:@",\n"]];
+	NSString *createTable = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ \n( \n%@ \n);", createName, [columns componentsJoinedByString:@",\n"]];
 	//NSLog(@"createTable %@", createTable);
 	return createTable;
 }
 
 ///Create one index for each relation. If you want to add special indexed columns, after super has completed, this would be an ideal place to do so.
+///Missing indexes on an empty table are created at once, on a table with rows they are queued and built in the background after setup (see buildPendingIndexesInQueue:). So a new index never delays launch, queries just don't use it until it's built.
 - (BOOL) createIndexInTable:(NSString*)tableName inDB:(AFMDatabase *)db
 {
-	BOOL needsMigration = NO;
 	NSDictionary *syntax = tableSyntax[tableName];
-	NSMutableSet *indexes = syntax[@"INDEX"];
-	for (NSString *column in indexes)
+	NSMutableDictionary <NSString*, NSString*>*createIndexes = [NSMutableDictionary new];
+	for (NSString *column in syntax[@"INDEX"])
+	{
+		NSString *name = [NSString stringWithFormat:@"%@_index", column];
+		createIndexes[name] = [NSString stringWithFormat:@"CREATE INDEX IF NOT EXISTS %@ ON %@ (%@);", name, tableName, column];
+	}
+	[syntax[AUTO_INDEX_SPECIFIC] enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *definition, BOOL *stop)
 	{
-		NSString *createIndex = [NSString stringWithFormat:@"CREATE INDEX IF NOT EXISTS %@_index ON %@ (%@);", column, tableName, column];
-		if ([db executeUpdate:createIndex] == NO)
+		createIndexes[name] = [NSString stringWithFormat:@"CREATE INDEX IF NOT EXISTS %@ ON %@ %@;", name, tableName, definition];
+	}];
+	[self dropStaleIndexesInTable:tableName inDB:db];
+	
+	//only build those that are missing
+	AFMResultSet *result = [db executeQuery:@"SELECT name FROM sqlite_master WHERE type = 'index' AND tbl_name = ?", tableName];
+	while ([result next])
+	{
+		[createIndexes removeObjectForKey:[result stringForColumnIndex:0]];
+	}
+	[result close];
+	if (createIndexes.count == 0)
+		return NO;
+	
+	result = [db executeQuery:[NSString stringWithFormat:@"SELECT 1 FROM %@ LIMIT 1", tableName]];
+	BOOL hasRows = [result next];
+	[result close];
+	if (!hasRows)
+	{
+		__block BOOL needsMigration = NO;
+		[createIndexes enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *createIndex, BOOL *stop)
 		{
+			if ([db executeUpdate:createIndex] == NO)
+			{
+				//either the definition is wrong or the columns does not exist yet.
+				if (DEBUG) NSLog(@"could not create index %@ on %@: %@", name, tableName, db.lastErrorMessage);
+				needsMigration = YES;
+			}
+		}];
+		return needsMigration;
+	}
+	
+	//couldn't add index - a column does not exist yet. We come back here after migration, the others are queued now.
+	//Compiling the statement resolves its columns (also those of expressions and WHERE) without building anything.
+	BOOL needsMigration = NO;
+	for (NSString *name in createIndexes.allKeys)
+	{
+		result = [db executeQuery:[@"EXPLAIN " stringByAppendingString:createIndexes[name]]];
+		if (!result)
+		{
+			if (DEBUG) NSLog(@"could not queue index %@ on %@: %@", name, tableName, db.lastErrorMessage);
+			[createIndexes removeObjectForKey:name];
 			needsMigration = YES;
+			continue;
 		}
+		[result close];
 	}
+	
+	NSString *createStatus = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ (name TEXT PRIMARY KEY, table_name TEXT NOT NULL, statement TEXT NOT NULL, status INTEGER NOT NULL, updated REAL NOT NULL)", AUTO_INDEX_STATUS_TABLE];
+	NSString *queueIndex = [NSString stringWithFormat:@"INSERT OR REPLACE INTO %@ (name, table_name, statement, status, updated) VALUES (?, ?, ?, %i, ?)", AUTO_INDEX_STATUS_TABLE, (int)AutoIndexStatusPending];
+	[db executeUpdate:createStatus];
+	[createIndexes enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *createIndex, BOOL *stop)
+	{
+		if ([db executeUpdate:queueIndex, name, tableName, createIndex, @([NSDate timeIntervalSinceReferenceDate])] == NO)
+			NSLog(@"could not queue index %@: %@", name, db.lastErrorMessage);
+	}];
 	return needsMigration;
 }
 
+///YES if the whole string is enclosed by one pair of parentheses, like "(a, b)" but not "(a+b), c".
+- (BOOL) isParenthesizedGroup:(NSString*)columnList
+{
+	if ([columnList hasPrefix:@"("] == NO)
+		return NO;
+	NSInteger depth = 0;
+	for (NSUInteger i = 0; i < columnList.length; i++)
+	{
+		unichar character = [columnList characterAtIndex:i];
+		if (character == '(')
+			depth++;
+		else if (character == ')')
+		{
+			depth--;
+			//the first parenthesis closes here, so it must be the end.
+			if (depth == 0)
+				return i == columnList.length - 1;
+		}
+	}
+	return NO;
+}
+
+///The name of a specific index is derived from its definition, so a changed definition gets a new name and the old one can be dropped.
+- (NSString*) specificIndexName:(NSString*)definition table:(NSString*)tableName
+{
+	//FNV-1a, NSString's hash is not guaranteed to be stable between launches.
+	uint32_t hash = 2166136261u;
+	const char *bytes = definition.UTF8String;
+	while (*bytes)
+	{
+		hash ^= (uint8_t)*bytes++;
+		hash *= 16777619u;
+	}
+	return [NSString stringWithFormat:@"%@_auto_index_%08x", tableName, hash];
+}
+
+///Drop indexes from AUTO_INDEX_SPECIFIC that we have created before but are no longer defined.
+- (void) dropStaleIndexesInTable:(NSString*)tableName inDB:(AFMDatabase *)db
+{
+	NSDictionary <NSString*, NSString*>*specificIndexes = tableSyntax[tableName][AUTO_INDEX_SPECIFIC];
+	NSString *prefix = [NSString stringWithFormat:@"%@_auto_index_", tableName];
+	NSMutableArray <NSString*>*staleIndexes = [NSMutableArray new];
+	AFMResultSet *result = [db executeQuery:@"SELECT name FROM sqlite_master WHERE type = 'index' AND tbl_name = ?", tableName];
+	while ([result next])
+	{
+		NSString *name = [result stringForColumnIndex:0];
+		if ([name hasPrefix:prefix] && specificIndexes[name] == nil)
+			[staleIndexes addObject:name];
+	}
+	[result close];
+	
+	for (NSString *name in staleIndexes)
+	{
+		if ([db executeUpdate:[NSString stringWithFormat:@"DROP INDEX IF EXISTS %@", name]] == NO)
+			NSLog(@"could not drop index %@: %@", name, db.lastErrorMessage);
+	}
+	
+	//and those queued but not built yet, so they are never built.
+	if ([self hasIndexStatusInDB:db] == NO)
+		return;
+	NSMutableArray <NSString*>*declaredNames = [NSMutableArray new];
+	for (NSString *column in tableSyntax[tableName][@"INDEX"])
+	{
+		[declaredNames addObject:[NSString stringWithFormat:@"%@_index", column]];
+	}
+	[declaredNames addObjectsFromArray:specificIndexes.allKeys];
+	NSString *deletePending = [NSString stringWithFormat:@"DELETE FROM %@ WHERE table_name = ?", AUTO_INDEX_STATUS_TABLE];
+	if (declaredNames.count)
+		deletePending = [deletePending stringByAppendingFormat:@" AND name NOT IN (%@)", [AutoModel questionMarks:declaredNames.count]];
+	[declaredNames insertObject:tableName atIndex:0];
+	if ([db executeUpdate:deletePending withArgumentsInArray:declaredNames] == NO)
+		NSLog(@"could not remove stale indexes of %@: %@", tableName, db.lastErrorMessage);
+}
+
+- (BOOL) hasIndexStatusInDB:(AFMDatabase *)db
+{
+	AFMResultSet *result = [db executeQuery:@"SELECT name FROM sqlite_master WHERE type = 'table' AND name = ?", AUTO_INDEX_STATUS_TABLE];
+	BOOL hasStatus = [result next];
+	[result close];
+	return hasStatus;
+}
+
+///Build queued indexes one at a time on a connection of their own, like the table copy, so queries to the file only wait for the index being committed.
+- (void) buildPendingIndexesInQueue:(AFMDatabaseQueue*)queue
+{
+	NSString *path = queue.path;
+	int openFlags = queue.openFlags;
+	[queue.thread syncPerformBlock:^{
+		[queue.database setRetryTimeout:AUTO_MIGRATION_BUSY_TIMEOUT];
+	}];
+	dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+		
+		AFMDatabase *db = [AFMDatabase databaseWithPath:path];
+		db.busyTimeout = AUTO_MIGRATION_BUSY_TIMEOUT;
+		if ([db openWithFlags:openFlags] == NO)
+		{
+			NSLog(@"could not open %@ to build indexes", path);
+			return;
+		}
+		while ([self hasIndexStatusInDB:db])
+		{
+			AFMResultSet *result = [db executeQuery:[NSString stringWithFormat:@"SELECT name, statement FROM %@ WHERE status = %i LIMIT 1", AUTO_INDEX_STATUS_TABLE, (int)AutoIndexStatusPending]];
+			NSString *name = nil, *createIndex = nil;
+			if ([result next])
+			{
+				name = [result stringForColumnIndex:0];
+				createIndex = [result stringForColumnIndex:1];
+			}
+			[result close];
+			if (!name)
+				break;
+			
+			AutoIndexStatus status = AutoIndexStatusBuilt;
+			if ([db executeUpdate:createIndex] == NO)
+			{
+				//queries work without it, we try again after the next migration.
+				NSLog(@"could not build index %@: %@", name, db.lastErrorMessage);
+				status = AutoIndexStatusFailed;
+			}
+			if ([db executeUpdate:[NSString stringWithFormat:@"UPDATE %@ SET status = ?, updated = ? WHERE name = ?", AUTO_INDEX_STATUS_TABLE], @(status), @([NSDate timeIntervalSinceReferenceDate]), name] == NO)
+			{
+				NSLog(@"could not update status of index %@: %@", name, db.lastErrorMessage);
+				break;
+			}
+		}
+		[db close];
+	});
+}
+
+- (NSArray <NSString*>*) pendingIndexesForClass:(Class)classObject
+{
+	NSMutableArray <NSString*>*pendingIndexes = [NSMutableArray new];
+	[classObject inDatabase:^(AFMDatabase * _Nonnull db) {
+		
+		if ([self hasIndexStatusInDB:db] == NO)
+			return;
+		AFMResultSet *result = [db executeQuery:[NSString stringWithFormat:@"SELECT name FROM %@ WHERE table_name = ? AND status = %i", AUTO_INDEX_STATUS_TABLE, (int)AutoIndexStatusPending], NSStringFromClass(classObject)];
+		while ([result next])
+		{
+			[pendingIndexes addObject:[result stringForColumnIndex:0]];
+		}
+		[result close];
+	}];
+	return pendingIndexes;
+}
+
+#pragma mark - schema fingerprint
+
+///Identifies the binaries defining our model classes (and AutoDB itself), if they are unchanged so is the table syntax.
+- (NSString*) buildIdentifierForTables:(NSArray <NSString*>*)tableNames
+{
+	NSMutableOrderedSet <NSBundle*>*bundles = [NSMutableOrderedSet orderedSetWithObject:[NSBundle bundleForClass:AutoDB.class]];
+	for (NSString *tableName in tableNames)
+	{
+		[bundles addObject:[NSBundle bundleForClass:NSClassFromString(tableName)]];
+	}
+	NSMutableArray *parts = [NSMutableArray arrayWithObject:@(AUTO_METADATA_VERSION)];
+	for (NSBundle *bundle in bundles)
+	{
+		NSDictionary *attributes = [NSFileManager.defaultManager attributesOfItemAtPath:bundle.executablePath error:nil];
+		[parts addObject:[NSString stringWithFormat:@"%@:%@:%@:%.3f", bundle.bundleIdentifier, bundle.infoDictionary[@"CFBundleVersion"], attributes[NSFileSize], [attributes[NSFileModificationDate] timeIntervalSince1970]]];
+	}
+	[parts addObject:[[tableNames sortedArrayUsingSelector:@selector(compare:)] componentsJoinedByString:@","]];
+	return [parts componentsJoinedByString:@"|"];
+}
+
+///A description that does not depend on the order of dictionaries and sets, so it can be hashed.
+- (NSString*) canonicalDescription:(id)object
+{
+	if ([object isKindOfClass:NSDictionary.class])
+	{
+		NSMutableArray *parts = [NSMutableArray new];
+		for (id key in [[object allKeys] sortedArrayUsingSelector:@selector(compare:)])
+		{
+			[parts addObject:[NSString stringWithFormat:@"%@:%@", key, [self canonicalDescription:object[key]]]];
+		}
+		return [NSString stringWithFormat:@"{%@}", [parts componentsJoinedByString:@","]];
+	}
+	if ([object isKindOfClass:NSSet.class] || [object isKindOfClass:NSArray.class])
+	{
+		NSMutableArray *parts = [NSMutableArray new];
+		for (id member in object)
+		{
+			[parts addObject:[self canonicalDescription:member]];
+		}
+		if ([object isKindOfClass:NSSet.class])
+			[parts sortUsingSelector:@selector(compare:)];
+		return [NSString stringWithFormat:@"[%@]", [parts componentsJoinedByString:@","]];
+	}
+	return [object description];
+}
+
+///Hash and archive the syntax of these tables, call this before checking for migration since that adds temporary keys.
+- (NSDictionary *) schemaMetadataForTables:(NSArray <NSString*>*)tableNames buildIdentifier:(NSString*)buildIdentifier
+{
+	NSMutableDictionary *fileSyntax = [NSMutableDictionary new];
+	NSMutableDictionary *relations = [NSMutableDictionary new];	//join tables depend on the relations, not the syntax
+	for (NSString *tableName in tableNames)
+	{
+		if (tableSyntax[tableName])
+			fileSyntax[tableName] = tableSyntax[tableName];
+		relations[tableName] = [NSClassFromString(tableName) relations] ?: @{};
+	}
+	
+	//FNV-1a 64 bit, like the index names it must be stable between launches.
+	uint64_t hash = 14695981039346656037ull;
+	const char *bytes = [self canonicalDescription:@[fileSyntax, relations]].UTF8String;
+	while (*bytes)
+	{
+		hash ^= (uint8_t)*bytes++;
+		hash *= 1099511628211ull;
+	}
+	
+	NSError *error = nil;
+	NSData *archive = [NSKeyedArchiver archivedDataWithRootObject:fileSyntax requiringSecureCoding:YES error:&error];
+	if (!archive)
+		NSLog(@"AutoDB: cannot archive table syntax, setup will not be cached: %@", error);
+	return @{ AUTO_METADATA_BUILD : buildIdentifier, AUTO_METADATA_HASH : [NSString stringWithFormat:@"%016llx", hash], AUTO_METADATA_SYNTAX : archive ?: [NSData data] };
+}
+
+- (BOOL) loadTableSyntax:(nullable NSData*)archive tables:(NSArray <NSString*>*)tableNames
+{
+	if (archive.length == 0)
+		return NO;
+	NSSet *allowedClasses = [NSSet setWithObjects:NSDictionary.class, NSArray.class, NSSet.class, NSString.class, NSNumber.class, NSDate.class, NSData.class, NSNull.class, nil];
+	NSError *error = nil;
+	NSDictionary *fileSyntax = [NSKeyedUnarchiver unarchivedObjectOfClasses:allowedClasses fromData:archive error:&error];
+	if (![fileSyntax isKindOfClass:NSDictionary.class])
+	{
+		NSLog(@"AutoDB: stored table syntax is unreadable, checking all tables: %@", error);
+		return NO;
+	}
+	for (NSString *tableName in tableNames)
+	{
+		if (![fileSyntax[tableName] isKindOfClass:NSDictionary.class])
+			return NO;
+	}
+	for (NSString *tableName in tableNames)
+	{
+		tableSyntax[tableName] = [fileSyntax[tableName] mutableCopy];
+	}
+	return YES;
+}
+
+- (NSDictionary*) schemaMetadataInDB:(AFMDatabase *)db
+{
+	NSMutableDictionary *metadata = [NSMutableDictionary new];
+	AFMResultSet *result = [db executeQuery:@"SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?", AUTO_METADATA_TABLE];
+	BOOL exists = [result next];
+	[result close];
+	if (!exists)
+		return metadata;
+	
+	result = [db executeQuery:[NSString stringWithFormat:@"SELECT key, value FROM %@", AUTO_METADATA_TABLE]];
+	while ([result next])
+	{
+		id value = result[1];
+		if (value && value != [NSNull null])
+			metadata[[result stringForColumnIndex:0]] = value;
+	}
+	[result close];
+	return metadata;
+}
+
+- (void) storeSchemaMetadata:(NSDictionary*)metadata inDB:(AFMDatabase *)db
+{
+	NSString *createTable = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ (key TEXT PRIMARY KEY NOT NULL, value)", AUTO_METADATA_TABLE];
+	NSString *insert = [NSString stringWithFormat:@"INSERT OR REPLACE INTO %@ (key, value) VALUES (?, ?)", AUTO_METADATA_TABLE];
+	if ([db executeUpdate:createTable] == NO)
+	{
+		NSLog(@"AutoDB: cannot store schema metadata: %@", db.lastErrorMessage);
+		return;
+	}
+	[metadata enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop)
+	{
+		[db executeUpdate:insert, key, value];
+	}];
+}
+
+#pragma mark - table syntax
+
 //This is called once for each class
 - (void) createTableSyntax:(Class)classObject
 {
@@ -957,6 +1762,26 @@ static AutoDB *sharedInstance = nil;
 	{
 		[indexes addObjectsFromArray:dict[AUTO_INDEX_COLUMN]];
 	}
+	if (dict && dict[AUTO_INDEX_SPECIFIC])
+	{
+		NSMutableDictionary <NSString*, NSString*>*specificIndexes = [NSMutableDictionary new];
+		for (NSString *definition in dict[AUTO_INDEX_SPECIFIC])
+		{
+			//allow the shorthand "a, b" or "a, b WHERE condition" for composite and partial indexes, only the columns go inside the parentheses. A list that already is one parenthesized group is left as it is.
+			NSString *trimmed = [definition stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+			NSRange where = [trimmed rangeOfString:@"\\sWHERE\\s" options:NSRegularExpressionSearch | NSCaseInsensitiveSearch];
+			NSString *columnList = where.location == NSNotFound ? trimmed : [[trimmed substringToIndex:where.location] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+			if ([self isParenthesizedGroup:columnList] == NO)
+			{
+				if (where.location == NSNotFound)
+					trimmed = [NSString stringWithFormat:@"(%@)", trimmed];
+				else
+					trimmed = [NSString stringWithFormat:@"(%@)%@", columnList, [trimmed substringFromIndex:where.location]];
+			}
+			specificIndexes[[self specificIndexName:trimmed table:classString]] = trimmed;
+		}
+		syntax[AUTO_INDEX_SPECIFIC] = specificIndexes;
+	}
 	NSArray *uniqueColumns = [classObject uniqueConstraints];
 	if (uniqueColumns)
 		syntax[AUTO_UNIQUE_COLUMNS] = uniqueColumns;
@@ -1113,16 +1938,24 @@ static AutoDB *sharedInstance = nil;
 //column syntax is a dict on the form columnName: type
 - (NSDictionary <NSString *, NSNumber *>*) columnSyntaxForClass:(Class)classObject
 {
-	AUTO_WAIT_FOR_SETUP
+	AUTO_WAIT_FOR_TABLE_SYNTAX
 	
 	NSDictionary *syntax = tableSyntax[NSStringFromClass(classObject)];
 	return syntax[AUTO_COLUMN_KEY];
 }
 
 //TODO: we should make all our function use this instead, so access can be controlled
+- (nullable NSProgress*) migrationProgressForTable:(NSString*)tableName
+{
+	@synchronized (migrationProgress)
+	{
+		return migrationProgress[tableName];
+	}
+}
+
 - (NSArray <NSString *>*) columnNamesForClass:(Class)classObject
 {
-	AUTO_WAIT_FOR_SETUP
+	AUTO_WAIT_FOR_TABLE_SYNTAX
 	
 	NSDictionary *syntax = tableSyntax[NSStringFromClass(classObject)];
 	return [syntax[AUTO_COLUMN_KEY] allKeys];
@@ -1130,14 +1963,14 @@ static AutoDB *sharedInstance = nil;
 
 - (NSDictionary <NSString*, NSDictionary*> *) tableSyntaxForClass:(NSString*)classString
 {
-	AUTO_WAIT_FOR_SETUP
+	AUTO_WAIT_FOR_TABLE_SYNTAX
 	
 	return tableSyntax[classString];
 }
 
 - (nonnull NSArray *) tableNames
 {
-	AUTO_WAIT_FOR_SETUP
+	AUTO_WAIT_FOR_TABLE_SYNTAX
 	
 	return [tableSyntax allKeys];
 }
@@ -1167,38 +2000,88 @@ static AutoDB *sharedInstance = nil;
 	return relations;
 }
 
+static char selectKey;
 - (NSString*) selectQuery:(Class)classObject
 {
-	static char selectKey;
 	NSString *selectQuery = objc_getAssociatedObject(classObject, &selectKey);
 	if (!selectQuery)
 	{
-		AUTO_WAIT_FOR_SETUP
+		AUTO_WAIT_FOR_TABLE_SYNTAX
 		
 		NSString *classString = NSStringFromClass(classObject);
 		NSDictionary *syntax = tableSyntax[classString];
 		NSArray *columns = [syntax[AUTO_COLUMN_KEY] allKeys];
 		
 		selectQuery = [NSString stringWithFormat:@"SELECT %@ FROM %@ ", [columns componentsJoinedByString:@","], classString];
-		objc_setAssociatedObject(classObject, &selectKey, selectQuery, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+		objc_setAssociatedObject(classObject, &selectKey, selectQuery, OBJC_ASSOCIATION_RETAIN);
 	}
 	return selectQuery;
 }
 
+///Replace the select query of a class while its table is copied, nil generates it again. The statements built from it go as well.
+- (void) setSelectQuery:(nullable NSString*)selectQuery forClass:(Class)classObject
+{
+	objc_setAssociatedObject(classObject, &selectKey, selectQuery, OBJC_ASSOCIATION_RETAIN);
+	[[classObject queryCache] removeAllObjects];
+}
+
 - (NSMutableDictionary <NSNumber*, NSMutableDictionary*> *) valuesForColumns:(NSMutableDictionary<NSNumber*, NSMutableSet*> *)idsWithColumns class:(Class)classObject translateDates:(BOOL)translateDates
 {
-	NSMutableDictionary <NSNumber*, NSMutableDictionary*> *values = [NSMutableDictionary new];
-	NSMutableDictionary *columnsToFetch = [NSMutableDictionary new];
+	//give each column a bit, then ids are grouped by integers instead of by their sets. Past the last bit columns share it, so a few extra may be fetched.
+	NSMutableArray <NSString*>*maskColumns = [NSMutableArray new];
+	NSMutableDictionary <NSString*, NSNumber*>*bits = [NSMutableDictionary new];
+	NSMutableDictionary <NSNumber*, NSNumber*>*idsWithMasks = [[NSMutableDictionary alloc] initWithCapacity:idsWithColumns.count];
+	[idsWithColumns enumerateKeysAndObjectsUsingBlock:^(NSNumber * _Nonnull idValue, NSMutableSet * _Nonnull columns, BOOL * _Nonnull stop) {
+		
+		unsigned long long mask = 0;
+		for (NSString *column in columns)
+		{
+			NSNumber *bit = bits[column];
+			if (!bit)
+			{
+				bit = @(MIN(maskColumns.count, AUTO_COLUMN_MASK_LAST_BIT));
+				bits[column] = bit;
+				[maskColumns addObject:column];
+			}
+			mask |= 1ULL << bit.unsignedIntegerValue;
+		}
+		idsWithMasks[idValue] = @(mask);
+	}];
+	return [self valuesForColumnMasks:idsWithMasks columns:maskColumns class:classObject translateDates:translateDates];
+}
+
+- (NSArray <NSString*>*) columnsForMask:(unsigned long long)mask maskColumns:(NSArray<NSString*> *)maskColumns
+{
+	NSMutableArray <NSString*>*columns = [NSMutableArray new];
+	for (NSUInteger index = 0; index < maskColumns.count; index++)
+	{
+		if (mask & (1ULL << MIN(index, AUTO_COLUMN_MASK_LAST_BIT)))
+			[columns addObject:maskColumns[index]];
+	}
+	return columns;
+}
+
+- (NSMutableDictionary <NSNumber*, NSMutableDictionary*> *) valuesForColumnMasks:(NSDictionary<NSNumber*, NSNumber*> *)idsWithMasks columns:(NSArray<NSString*> *)maskColumns class:(Class)classObject translateDates:(BOOL)translateDates
+{
+	NSMutableDictionary <NSNumber*, NSMutableDictionary*> *values = [[NSMutableDictionary alloc] initWithCapacity:idsWithMasks.count];
+	NSMutableDictionary <NSNumber*, NSMutableArray <NSNumber*>*> *idsToFetch = [NSMutableDictionary new];
+	NSMutableDictionary <NSNumber*, NSArray <NSString*>*> *columnsForMask = [NSMutableDictionary new];
 	AutoConcurrentMapTable *tableCache = [classObject tableCache];
 	[tableCache syncPerformBlock:^(NSMapTable * _Nonnull table) {
 		
-		[idsWithColumns enumerateKeysAndObjectsUsingBlock:^(NSNumber * _Nonnull idValue, NSMutableSet * _Nonnull columns, BOOL * _Nonnull stop) {
+		[idsWithMasks enumerateKeysAndObjectsUsingBlock:^(NSNumber * _Nonnull idValue, NSNumber * _Nonnull mask, BOOL * _Nonnull stop) {
 			
+			NSArray <NSString*>*columns = columnsForMask[mask];
+			if (!columns)
+			{
+				columns = [self columnsForMask:mask.unsignedLongLongValue maskColumns:maskColumns];
+				columnsForMask[mask] = columns;
+			}
 			//if the object exist in cache we don't need to fetch it
 			AutoModel *object = [table objectForKey:idValue];
 			if (object)
 			{
-				NSMutableDictionary *result = [NSMutableDictionary new];
+				NSMutableDictionary *result = [[NSMutableDictionary alloc] initWithCapacity:columns.count + 1];
 				for (NSString *column in columns)
 				{
 					id value = [object valueForKey:column];
@@ -1213,51 +2096,61 @@ static AutoDB *sharedInstance = nil;
 			}
 			else
 			{
-				//we group all ids by their columns, to fetch as few times as possible.
-				if (!columnsToFetch[columns])
-					columnsToFetch[columns] = [NSMutableArray arrayWithObject:idValue];
+				//we group all ids by their mask, to fetch as few times as possible.
+				if (!idsToFetch[mask])
+					idsToFetch[mask] = [NSMutableArray arrayWithObject:idValue];
 				else
-					[columnsToFetch[columns] addObject:idValue];
+					[idsToFetch[mask] addObject:idValue];
 			}
 		}];
 	}];
 	
 	//now loop through all and fetch them!
 	NSString *classString = NSStringFromClass(classObject);
-	NSDictionary <NSString*, NSNumber*> *columnSyntax;
+	NSDictionary <NSString *, NSNumber *> *columnSyntax;
 	if (translateDates)
 		columnSyntax = [self columnSyntaxForClass:classObject];
 	[classObject inDatabase:^(AFMDatabase * _Nonnull db) {
 
-		[columnsToFetch enumerateKeysAndObjectsUsingBlock:^(NSMutableSet* columnSet, NSArray *ids, BOOL * _Nonnull stop) {
+		[idsToFetch enumerateKeysAndObjectsUsingBlock:^(NSNumber * _Nonnull mask, NSMutableArray <NSNumber*>* ids, BOOL * _Nonnull stop) {
 			
-			//sometimes columnSet looses its mutability...
-			NSMutableArray *columns = columnSet.allObjects.mutableCopy;
+			NSMutableArray *columns = columnsForMask[mask].mutableCopy;
 			[columns insertObject:@"id" atIndex:0];
-			NSString *selectQuery = [NSString stringWithFormat:@"SELECT %@ FROM %@ WHERE id IN (%@)", [columns componentsJoinedByString:@","], classString, [AutoModel questionMarks:ids.count]];
-			
-			AFMResultSet *resultSet = [db executeQuery:selectQuery withArgumentsInArray:ids];
-			while ([resultSet next])
+			//every chunk has the same width, so each mask has one prepared statement.
+			NSString *selectQuery = [NSString stringWithFormat:@"SELECT %@ FROM %@ WHERE id IN (%@)", [columns componentsJoinedByString:@","], classString, [AutoModel questionMarks:AUTO_VALUES_FETCH_IDS]];
+			[db cacheStatementForQuery:selectQuery];
+			NSMutableArray *arguments = [[NSMutableArray alloc] initWithCapacity:AUTO_VALUES_FETCH_IDS];
+			for (NSUInteger index = 0; index < ids.count; index += AUTO_VALUES_FETCH_IDS)
 			{
-				NSMutableDictionary *result = [[NSMutableDictionary alloc] initWithCapacity:columns.count];
-				[columns enumerateObjectsUsingBlock:^(id column, NSUInteger index, BOOL *stop)
+				[arguments setArray:[ids subarrayWithRange:NSMakeRange(index, MIN(AUTO_VALUES_FETCH_IDS, ids.count - index))]];
+				//the last chunk repeats its last id, which matches the same row.
+				while (arguments.count < AUTO_VALUES_FETCH_IDS)
+					[arguments addObject:arguments.lastObject];
+				
+				AFMResultSet *resultSet = [db executeQuery:selectQuery withArgumentsInArray:arguments];
+				while ([resultSet next])
 				{
-					id value = resultSet[(int)index];
-					if (!value)
-					{
-						//here we must introduce an extra data type.
-						value = [NSNull null];
-					}
-					else if (translateDates && columnSyntax[column].integerValue == AutoFieldTypeDate)
-					{
-						value = [NSDate dateWithTimeIntervalSince1970:[value doubleValue]];
-					}
-					result[column] = value;
-					if (index == 0)
+					NSMutableDictionary *result = [[NSMutableDictionary alloc] initWithCapacity:columns.count];
+					[columns enumerateObjectsUsingBlock:^(id column, NSUInteger index, BOOL *stop)
 					{
-						values[value] = result;
-					}
-				}];
+						id value = resultSet[(int)index];
+						if (!value)
+						{
+							//here we must introduce an extra data type.
+							value = [NSNull null];
+						}
+						else if (translateDates && columnSyntax[column].integerValue == AutoFieldTypeDate)
+						{
+							value = [NSDate dateWithTimeIntervalSince1970:[value doubleValue]];
+						}
+						result[column] = value;
+						if (index == 0)
+						{
+							values[value] = result;
+						}
+					}];
+				}
+				[resultSet close];
 			}
 		}];
 	}];
@@ -49,6 +49,29 @@ NS_ASSUME_NONNULL_BEGIN
 
 @end
 
+///A keyset cursor for paging through large ordered results. It remembers the sort value and id of the last fetched row, so the next page can seek directly to it using an index instead of walking past all previous rows with OFFSET.
+///Keep it around (or archive it) to continue where you left off.
+@interface AutoPageCursor : NSObject <NSSecureCoding, NSCopying>
+
+///Create a cursor positioned before the first page. The condition is written without "WHERE", e.g. @"parent_id = ? AND is_deleted = 0", supply nil to page through all rows.
+///@note Rows where the sort column is NULL are never returned, so only sort on NOT NULL columns.
++ (instancetype) cursorWithSortColumn:(NSString*)sortColumn ascending:(BOOL)ascending pageSize:(NSUInteger)pageSize condition:(nullable NSString*)condition arguments:(nullable NSArray*)arguments;
+
+@property (nonatomic, readonly) NSString *sortColumn;
+@property (nonatomic, readonly) BOOL ascending;
+@property (nonatomic) NSUInteger pageSize;
+@property (nonatomic, readonly, nullable) NSString *condition;
+@property (nonatomic, readonly, nullable) NSArray *arguments;
+
+///The raw (as stored in db) sort value of the last fetched row, nil before the first page.
+@property (nonatomic, readonly, nullable) id lastSortValue;
+///The id of the last fetched row, nil before the first page.
+@property (nonatomic, readonly, nullable) NSNumber *lastId;
+///Set when a page returned fewer rows than pageSize, there is nothing more to fetch.
+@property (nonatomic, readonly) BOOL isAtEnd;
+
+@end
+
 
 #define AUTO_COLUMN_KEY @"COLUMNS"
 #define AUTO_RELATIONS_PARENT_ID_KEY @"auto_parent_id"
@@ -59,6 +82,7 @@ NS_ASSUME_NONNULL_BEGIN
 #define AUTO_RELATIONS_WEAK_OBJECT_KEY @"auto_weak_object"
 #define AUTO_RELATIONS_MANY_ID_KEY @"auto_many_ids"
 #define AUTO_RELATIONS_MANY_CONTAINER_KEY @"auto_many_container"
+#define AUTO_RELATIONS_MANY_JOIN_KEY @"auto_many_join"
 
 #define AUTO_INDEX_COLUMN @"COLUMN_INDEX"
 #define AUTO_INDEX_SPECIFIC @"SPECIFIC_INDEX"
@@ -128,8 +152,9 @@ u_int64_t generateRandomAutoId(void);
 ///@note Will not work for dates or objects that may be null - just how sqlite works.
 + (nullable NSDictionary*) defaultValues;
 
-///Supply arrays of indexes, use AUTO_INDEX_COLUMN to set an index on a single column. (To be implemented is advanced index statements, AUTO_INDEX_SPECIFIC, a string where you can specify the index yourself).
-///@example: return @{ AUTO_INDEX_COLUMN : @[@"indexed_column_name"]};
+///Supply arrays of indexes, use AUTO_INDEX_COLUMN to set an index on a single column. Use AUTO_INDEX_SPECIFIC for composite, partial, covering or expression indexes, each string is what follows "ON table" in CREATE INDEX. Columns without parentheses are wrapped for you, also before a WHERE: "a, b WHERE a > 0".
+///Specific indexes are named after their definition, so changing one drops the old index and creates the new during setup.
+///@example: return @{ AUTO_INDEX_COLUMN : @[@"indexed_column_name"], AUTO_INDEX_SPECIFIC : @[@"(parent_id, date) WHERE is_deleted = 0", @"(lower(name))"]};
 + (nullable NSDictionary <NSString*, NSArray <NSString*>*>*) columnIndex;
 
 ///Supply arrays of unique constraints, the array one or more arrays with one or more strings. one string make that column unique, otherwise they are unique together.
@@ -141,11 +166,14 @@ u_int64_t generateRandomAutoId(void);
 
 ///If keys from this dictionary exists as columns in the table, they are migrated to the new property. You can switch datatypes with this method, but the old values in the table will not be converted automatically. SQLite clames to have dynamic variables, so I don't think it should be an issue.
 + (nullable NSDictionary*) migrateParameters;
-///When migrating columns with one type to another, you can convert existing values of one type to another by looping overt the arrayOfTuples [(id, columnValue), ...] and modifying them as you see fit.
+///When migrating columns with one type to another, you can convert existing values of one type to another by looping overt the arrayOfTuples [(id, columnValue), ...] and modifying them as you see fit. Large tables are converted in chunks, so this is called once for every few thousand rows.
 + (void) migrateTable:(NSString*)table column:(NSString*)column oldType:(AutoFieldType)oldType newType:(AutoFieldType)newType values:(NSMutableArray*)arrayOfTuples;
 
 - (void) setHasFetchedRelations:(BOOL)hasFetched;
 - (BOOL) hasFetchedRelations;
+///Relation properties fetched one at a time by prefetchRelations, fetchRelations only loads the others.
+- (void) setFetchedRelations:(nullable NSSet <NSString*>*)fetchedRelations;
+- (nullable NSSet <NSString*>*) fetchedRelations;
 
 #pragma mark - create instances
 
@@ -177,10 +205,16 @@ u_int64_t generateRandomAutoId(void);
 ///List all columns containing an id to another object
 + (nullable NSSet*) relationsIdColumns;
 
-///Fetch relations for a group of objects, this must be called manually if auto-relations are used.
+///Return YES to let relation properties load on first access instead of calling fetchRelations. The first access loads the relations of every object fetched in the same AutoResult, one query per relation instead of one per object. Default is NO.
++ (BOOL) faultRelations;
+///Fetch relations for a group of objects, this must be called manually if auto-relations are used (unless faultRelations is YES).
 + (void) fetchRelations:(NSArray*)objects;
 ///Fetch relations for this object, this must be called manually if auto-relations are used.
 - (void) fetchRelations;
+///Fetch relations several levels deep by following relation properties, e.g. @[@"documents.attachments", @"owner"]. Each level is fetched with one batch per class, independent classes are fetched concurrently.
++ (void) prefetchRelations:(NSArray*)objects keyPaths:(NSArray<NSString*>*)keyPaths;
+///Fetch all objects of parentClass that has this object in their AUTO_RELATIONS_MANY_JOIN_KEY container. This is one indexed lookup in the join table, no scanning of id strings.
+- (nullable AutoResult <__kindof AutoModel*>*) fetchJoinedParents:(Class)parentClass;
 
 #pragma mark - fetching
 
@@ -234,6 +268,8 @@ u_int64_t generateRandomAutoId(void);
 - (NSNumber*) idValue;
 ///Fast access to each tables cache
 + (AutoConcurrentMapTable *) tableCache;
+///Statements prepared for this table, keyed by the query they were made for.
++ (NSCache*) queryCache;
 
 #pragma mark - perform changes manually
 
@@ -259,6 +295,17 @@ u_int64_t generateRandomAutoId(void);
  */
 + (void) fetchQuery:(nullable NSString*)whereQuery arguments:(nullable NSArray*)arguments resultBlock:(AutoResultBlock)resultBlock;
 
+#pragma mark - paging
+
+/**
+ Blocking method to fetch the next page for a cursor, using an indexed seek - WHERE (sort, id) > (?, ?) - instead of OFFSET. Every page takes the same time no matter how deep you have scrolled. The cursor is moved to the last row of the returned page.
+ Returns nil when there are no more rows.
+ @note For constant time you need an index that matches the sort, e.g. AUTO_INDEX_SPECIFIC : @[@"(date, id)"], or with your condition columns first: @[@"(parent_id, date, id)"].
+ */
++ (nullable AutoResult <__kindof AutoModel*>*) fetchNextPage:(AutoPageCursor*)cursor;
+///Non-blocking version of fetchNextPage:, don't use the same cursor for two fetches at the same time.
++ (void) fetchNextPage:(AutoPageCursor*)cursor resultBlock:(AutoResultBlock)resultBlock;
+
 #pragma mark - fetch with ids
 
 ///Fetch objects from cache only
@@ -292,6 +339,7 @@ u_int64_t generateRandomAutoId(void);
  Supply a query which results in only one column of results (the id column), then AutoModel fetches the objects for those ids. There is no error checking, supply the wrong query and get no results.
  The point of this is when you want some more advanced queries. One example to use like a join:
  we have users and groups - you want to fetch users from a certain group. The query is then: "SELECT user_id FROM groups WHERE id = 2" BUT you send this to the user class so it can take those id values resulting from the groups-query and populate a list with model objects.
+ The id query is used as a sub-query (WHERE id IN (idQuery)), so everything is fetched in one statement - there is no limit to how many ids it may produce.
  @note Don't use this to fetch objects for known ids, like an array of ids. Then use fetchIds: instead.
  */
 + (nullable AutoResult<__kindof AutoModel*>*) fetchWithIdQuery:(NSString *)idQuery arguments:(nullable NSArray*)arguments;
@@ -327,6 +375,9 @@ u_int64_t generateRandomAutoId(void);
  */
 + (BOOL) preventObservingProperties;
 
+///Tables are created and migrated when first used, the rest are warmed up in the background in this order - higher first. Default is 0, give the tables your first screen needs a higher priority.
++ (NSInteger) setupPriority;
+
 /**
  base-method to handle fetch results. It populates objects from DB-resultSets and adds/inserts to a dictionary and array, the array keeps the order and the dictionary gives fast lookup with keys.
  It always uses cached objects if those exists.
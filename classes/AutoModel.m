@@ -10,6 +10,7 @@
 #import "AutoModelRelation.h"
 #import "AutoDB.h"
 #import "AFMResultSet.h"
+#import "AutoThread.h"
 
 @import ObjectiveC;
 
@@ -17,6 +18,45 @@
 	#define DEBUG 0
 #endif
 
+NS_ASSUME_NONNULL_BEGIN
+
+@interface AutoPageCursor ()
+
+@property (nonatomic, readwrite) NSString *sortColumn;
+@property (nonatomic, readwrite) BOOL ascending;
+@property (nonatomic, readwrite, nullable) NSString *condition;
+@property (nonatomic, readwrite, nullable) NSArray *arguments;
+@property (nonatomic, readwrite, nullable) id lastSortValue;
+@property (nonatomic, readwrite, nullable) NSNumber *lastId;
+@property (nonatomic, readwrite) BOOL isAtEnd;
+
+- (void) moveToSortValue:(nullable id)sortValue lastId:(nullable NSNumber*)lastId rowCount:(NSUInteger)rowCount;
+
+@end
+
+NS_ASSUME_NONNULL_END
+
+///Objects fetched in the same batch share one fault, so the first relation access loads relations for all of them.
+@interface AutoRelationFault : NSObject
+@property (nonatomic, readonly) NSHashTable *siblings;
+///Guards the faults of the siblings, and is signaled when their relations are fetched.
+@property (nonatomic, readonly) NSCondition *condition;
+///The thread fetching for the siblings, nil until someone fires the fault.
+@property (nonatomic, nullable) NSThread *fetchingThread;
+@end
+
+@implementation AutoRelationFault
+
+- (instancetype) init
+{
+	self = [super init];
+	_siblings = [NSHashTable weakObjectsHashTable];
+	_condition = [NSCondition new];
+	return self;
+}
+
+@end
+
 NSString *const primaryKeyName = @"id";
 NSString *const AutoModelPrimaryKeyChangeNotification = @"AutoModelPrimaryKeyChangeNotification";  //sent when the primary key changes
 NSString *const AutoModelUpdateNotification = @"AutoModelUpdateNotification";	//sent when at least one object have been updated, created or deleted
@@ -24,6 +64,8 @@ NSString *const AutoModelUpdateNotification = @"AutoModelUpdateNotification";	//
 @implementation AutoModel
 {
 	BOOL hasFetchedRelations, toBeInserted, isAwake;
+	AutoRelationFault *relationFault;
+	NSSet <NSString*>*fetchedRelations;
 }
 
 #pragma mark - deprication 
@@ -31,12 +73,12 @@ NSString *const AutoModelUpdateNotification = @"AutoModelUpdateNotification";	//
 
 + (void) fetchAllWithOffset:(NSUInteger)offset limit:(NSUInteger)limit resultBlock:(AutoModelResultBlock)resultBlock
 {
-	NSLog(@"error! use fetchQuery:arguments: instead!");
+	NSLog(@"error! use fetchNextPage: or fetchQuery:arguments: instead!");
 }
 
 + (NSMutableDictionary*) fetchAllWithOffset:(NSUInteger)offset limit:(NSUInteger)limit
 {
-    NSLog(@"error! use fetchQuery:arguments: instead!");
+    NSLog(@"error! use fetchNextPage: or fetchQuery:arguments: instead!");
     
     return nil;
 }
@@ -85,6 +127,8 @@ static NSMutableDictionary *tablesWithChanges;
 		NSLog(@"error no queue for class %@ %p", self, self);
 		assert(NO);
 	}
+	//the first use of a table creates and migrates it, if the warm-up hasn't reached it yet. It runs before anything we queue.
+	[[AutoDB sharedInstance] queueSetupOfTable:self];
 	return queue;
 }
 
@@ -383,6 +427,11 @@ u_int64_t generateRandomAutoId()
 	[AutoModelRelation fetchRelations:objects_in queue:self.databaseQueue];
 }
 
++ (void) prefetchRelations:(NSArray*)objects keyPaths:(NSArray<NSString*>*)keyPaths
+{
+	[AutoModelRelation prefetchRelations:objects keyPaths:keyPaths];
+}
+
 - (void) fetchRelations
 {
 	if (!hasFetchedRelations)
@@ -391,6 +440,144 @@ u_int64_t generateRandomAutoId()
 	}
 }
 
++ (BOOL) faultRelations
+{
+	return NO;
+}
+
++ (NSInteger) setupPriority
+{
+	return 0;
+}
+
++ (void) setupRelationFaults
+{
+	NSDictionary *relations = [self relations];
+	if (!relations || [self faultRelations] == NO)
+		return;
+	
+	//only properties that are filled by fetching our relations, weak references are set when the other side fetches.
+	NSMutableSet <NSString*>*propertyNames = [NSMutableSet new];
+	for (NSString *relationKey in @[AUTO_RELATIONS_CHILD_CONTAINER_KEY, AUTO_RELATIONS_STRONG_OBJECT_KEY, AUTO_RELATIONS_MANY_CONTAINER_KEY, AUTO_RELATIONS_MANY_JOIN_KEY])
+	{
+		[propertyNames addObjectsFromArray:[relations[relationKey] allValues]];
+	}
+	
+	for (NSString *propertyName in propertyNames)
+	{
+		objc_property_t property = class_getProperty(self, propertyName.UTF8String);
+		char *getter = property ? property_copyAttributeValue(property, "G") : NULL;	//G means custom Getter
+		SEL originalSel = getter ? sel_registerName(getter) : NSSelectorFromString(propertyName);
+		free(getter);
+		Method originalMethod = class_getInstanceMethod(self, originalSel);
+		if (!originalMethod)
+		{
+			NSLog(@"AutoDB: cannot fault relation %@ of %@, no getter", propertyName, self);
+			continue;
+		}
+		
+		//Same as with observing properties, the class is changed once - objects without a fault only pays for one nil-check.
+		IMP originalImplementation = method_getImplementation(originalMethod);
+		IMP newMethodIMP = imp_implementationWithBlock(^id(AutoModel *objectSelf){
+			
+			if (objectSelf->relationFault && [objectSelf.fetchedRelations containsObject:propertyName] == NO)
+				[objectSelf fireRelationFault];
+			id (*func)(id, SEL) = (void *)originalImplementation;
+			return func(objectSelf, originalSel);
+		});
+		class_replaceMethod(self, originalSel, newMethodIMP, method_getTypeEncoding(originalMethod));
+		
+		//setting the relation fires the fault first, otherwise the fetch would overwrite the value later.
+		char *setter = property ? property_copyAttributeValue(property, "S") : NULL;
+		SEL originalSetterSel = setter ? sel_registerName(setter) : NSSelectorFromString([NSString stringWithFormat:@"set%@%@:", [propertyName substringToIndex:1].uppercaseString, [propertyName substringFromIndex:1]]);
+		free(setter);
+		Method originalSetter = class_getInstanceMethod(self, originalSetterSel);
+		if (!originalSetter)
+			continue;
+		IMP originalSetterImplementation = method_getImplementation(originalSetter);
+		IMP newSetterIMP = imp_implementationWithBlock(^(AutoModel *objectSelf, id value){
+			
+			if (objectSelf->relationFault && [objectSelf.fetchedRelations containsObject:propertyName] == NO)
+				[objectSelf fireRelationFault];
+			void (*func)(id, SEL, id) = (void *)originalSetterImplementation;
+			func(objectSelf, originalSetterSel, value);
+		});
+		class_replaceMethod(self, originalSetterSel, newSetterIMP, method_getTypeEncoding(originalSetter));
+	}
+}
+
+- (void) fireRelationFault
+{
+	AutoRelationFault *fault = relationFault;
+	if (!fault)
+		return;
+	
+	//the first sibling to get here fetches for everyone, the others wait and then find their relations in place. The faults are cleared after the fetch, so a sibling's getter can't pass its fault (without the lock) before its relations are set.
+	//The lock is not held during the fetch, it needs the database threads and those may be the ones waiting.
+	NSCondition *condition = fault.condition;
+	NSMutableArray *objects = nil;
+	[condition lock];
+	if (relationFault == nil || [fault.fetchingThread isEqual:NSThread.currentThread])
+	{
+		//we are inside the fetch, it is setting our relations.
+		[condition unlock];
+		return;
+	}
+	if (!fault.fetchingThread)
+	{
+		if (hasFetchedRelations)
+		{
+			//fetchRelations has been called manually, don't load everyone else just because of that.
+			relationFault = nil;
+			[condition unlock];
+			return;
+		}
+		objects = [NSMutableArray arrayWithObject:self];
+		for (AutoModel *sibling in fault.siblings)
+		{
+			if (sibling != self && sibling->relationFault == fault)
+				[objects addObject:sibling];
+		}
+		[fault.siblings removeAllObjects];
+		fault.fetchingThread = NSThread.currentThread;
+	}
+	[condition unlock];
+	
+	if (objects)
+	{
+		[self.class fetchRelations:objects];
+		[condition lock];
+		for (AutoModel *object in objects)
+		{
+			object->relationFault = nil;
+		}
+		[condition broadcast];
+		[condition unlock];
+		return;
+	}
+	
+	//someone else is fetching. A database thread keeps running its queued blocks while waiting, since the fetch may need them.
+	BOOL isDatabaseThread = [NSThread.currentThread isKindOfClass:AutoThread.class];
+	[condition lock];
+	while (relationFault)
+	{
+		if (!isDatabaseThread)
+		{
+			[condition wait];
+			continue;
+		}
+		[condition unlock];
+		[NSRunLoop.currentRunLoop runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+		[condition lock];
+	}
+	[condition unlock];
+}
+
+- (nullable AutoResult*) fetchJoinedParents:(Class)parentClass
+{
+	return [AutoModelRelation fetchJoinedParentsOf:self parentClass:parentClass];
+}
+
 - (BOOL) hasFetchedRelations
 {
 	if (!hasFetchedRelations)
@@ -408,6 +595,22 @@ u_int64_t generateRandomAutoId()
 	hasFetchedRelations = hasFetched;
 }
 
+- (void) setFetchedRelations:(NSSet<NSString *> *)fetched
+{
+	@synchronized (self)
+	{
+		fetchedRelations = fetched;
+	}
+}
+
+- (NSSet<NSString *> *) fetchedRelations
+{
+	@synchronized (self)
+	{
+		return fetchedRelations;
+	}
+}
+
 
 #pragma mark - table state
 
@@ -679,98 +882,7 @@ u_int64_t generateRandomAutoId()
 	}
 	isAwake = YES;
 	*/
-	/*
-	 Method swizzling does work, but should we use it for fetching relations?
-	 
-	NSArray *propertyNames = [self.class relationPropertyNamesOfType:YES];
-	if (propertyNames.count && [self.class useMethodSwizzling]) //either method swizzling is so good and well tested that we can use it always - or not good enough.
-	{
-		
-		if (!swizzledMethods)
-		{
-			swizzledMethods = [NSMutableDictionary new];
-		}
-		else
-		{
-			NSLog(@"Error. Calling awakeFromFetch twice.");
-			return;
-		}
-		
-		 
-		 For each relationship to another object, we change the implementation to first fetch relationships - then return the value(s). So, do this:
-		 1, Swizzle each method to use a block instead.
-		 2, When the block is called, switch back to the original method.
-		 3, Fetch the relation-objects.
-		 4, return the object(s) for the relation that was called.
-		 
-		 Multi-threading: If several faulting relation properties are called at the same time, this should happen:
-		 1, the orginal method will be set several times (first replacing the swizzled method, then replacing the original method). This should all work fine (it just sets a function pointer, should not need to be an intermidiate stage where half-a-pointer might be called - however it should be tested or not used in production code).
-		 2, the first call will get the db-lock and the other will have to wait until the first is complete.
-		 3, The first will return the values, the rest will skip fetching since already fetched, and thus return the values.
-		 4, Any call after this should use the original method.
-		
-	 
-		NSMutableDictionary* __weak weakSwizzledMethods = swizzledMethods;
-		for (NSString *methodName in propertyNames)
-		{
-			SEL originalSel = NSSelectorFromString(methodName);
-			
-			
-			Method originalMethod = class_getInstanceMethod(self.class, originalSel);
-			IMP originalImplementation = method_getImplementation(originalMethod);
-			NSValue *methodValue = [NSValue valueWithPointer:originalMethod];
-			NSValue *implementationValue = [NSValue valueWithPointer:originalImplementation];
-			
-			//store the original method and the new block so they won't go away
-			NSMutableDictionary *blockAndMethods = [NSMutableDictionary new];
-			blockAndMethods[@"methodValue"] = methodValue;
-			blockAndMethods[@"implementationValue"] = implementationValue;
-			[swizzledMethods setObject:blockAndMethods forKey:methodName];
-			
-			//HELLO! object is SELF in this call!
-			dynamicFunctionBlock newMethod = (id)^(id object, SEL _cmd)
-			{
-				//we need to swizzle the methods and fetch in sequence, otherwise calls following this may access non-fetched values, asuming it to be fetched.
-				
-				//NSLog(@"wokrs?");
-				//NSValue *pointerValue = swizzledMethods[methodName];
-				//IMP originalImplementation = pointerValue.pointerValue;
-				
-				//IMP originalImplementation = method_getImplementation(originalMethod);
-				//IMP swizzlingImplementation = method_getImplementation(relationSwizzlingMethods);
-				
-				//before fetching relations, we need to switch back all implementations.
-				
-				for (NSDictionary *blockAndMethods in weakSwizzledMethods.allValues)
-				{
-					NSValue *methodValue = blockAndMethods[@"methodValue"];
-					NSValue *implementationValue = blockAndMethods[@"implementationValue"];
-					
-					IMP originalImplementation = implementationValue.pointerValue;
-					Method originalMethod = methodValue.pointerValue;
-					
-					method_setImplementation(originalMethod, originalImplementation);
-				}
-				[weakSwizzledMethods removeAllObjects];
-				
-				[AutoModelRelation fetchRelations:@[object] queue:databaseQueue];
-				
-				id (*func)(id, SEL) = (void *)originalImplementation;
-				id result = func(object, originalSel);
-				
-				return result;
-			};
-			
-			//copy block from heap to be extra safe/work on iOS 5.
-			dynamicFunctionBlock blockSecuredByCopy = [newMethod copy];
-			blockAndMethods[@"block"] = blockSecuredByCopy;
-			IMP newMethodIMP = imp_implementationWithBlock(blockSecuredByCopy);
-			//class_addMethod(self.class, originalSel, newMethodIMP, "v@:");
-			method_setImplementation(originalMethod, newMethodIMP);
-		}
-	 
-	}
-	  */
+	//relations are faulted by swizzling the getters once per class instead, see setupRelationFaults.
 }
 
 #pragma mark - cache status
@@ -829,6 +941,86 @@ u_int64_t generateRandomAutoId()
 	}];
 }
 
+#pragma mark - paging
+
++ (nullable AutoResult*) fetchNextPage:(AutoPageCursor*)cursor
+{
+	if (cursor.isAtEnd || cursor.pageSize == 0)
+		return nil;
+	
+	NSString *sortColumn = cursor.sortColumn;
+	NSInteger sortIndex = [[AutoDB.sharedInstance columnNamesForClass:self] indexOfObject:sortColumn];
+	if (sortIndex == NSNotFound)
+	{
+		NSLog(@"error: cannot page %@ on unknown column %@", self, sortColumn);
+		return nil;
+	}
+	BOOL sortById = [sortColumn isEqualToString:primaryKeyName];
+	
+	NSMutableArray *arguments = cursor.arguments ? cursor.arguments.mutableCopy : [NSMutableArray new];
+	NSMutableArray <NSString*>*conditions = [NSMutableArray new];
+	if (cursor.condition.length)
+		[conditions addObject:[NSString stringWithFormat:@"(%@)", cursor.condition]];
+	
+	//seek past the last row, the id makes the ordering total so we never skip or repeat rows with equal sort values.
+	NSString *comparison = cursor.ascending ? @">" : @"<";
+	if (cursor.lastId)
+	{
+		if (sortById)
+		{
+			[conditions addObject:[NSString stringWithFormat:@"%@ %@ ?", primaryKeyName, comparison]];
+		}
+		else
+		{
+			[conditions addObject:[NSString stringWithFormat:@"(%@, %@) %@ (?, ?)", sortColumn, primaryKeyName, comparison]];
+			[arguments addObject:cursor.lastSortValue];
+		}
+		[arguments addObject:cursor.lastId];
+	}
+	
+	NSString *direction = cursor.ascending ? @"" : @" DESC";
+	NSMutableString *whereQuery = [NSMutableString new];
+	if (conditions.count)
+		[whereQuery appendFormat:@"WHERE %@ ", [conditions componentsJoinedByString:@" AND "]];
+	if (sortById)
+		[whereQuery appendFormat:@"ORDER BY %@%@ LIMIT ?", primaryKeyName, direction];
+	else
+		[whereQuery appendFormat:@"ORDER BY %@%@, %@%@ LIMIT ?", sortColumn, direction, primaryKeyName, direction];
+	[arguments addObject:@(cursor.pageSize)];
+	
+	//the where-part is the same for every page except the first, so the statement stays cached.
+	NSString *query = [self cachedQuery:whereQuery].query;
+	if (!query)
+		return nil;
+	
+	__block AutoResult *page = nil;
+	__block id lastSortValue = nil;
+	[self inDatabase:^(AFMDatabase *db)
+	{
+		AFMResultSet *result = [db executeQuery:query withArgumentsInArray:arguments];
+		if (result == nil)
+		{
+			if ([db lastErrorCode]) NSLog(@"DB query: %@", query);
+			return;
+		}
+		id lastValue = nil;
+		page = [self handleFetchResult:result lastValue:&lastValue column:sortIndex];
+		lastSortValue = lastValue;
+	}];
+	
+	[cursor moveToSortValue:lastSortValue lastId:[(AutoModel*)page.rows.lastObject idValue] rowCount:page.rows.count];
+	return page;
+}
+
++ (void) fetchNextPage:(AutoPageCursor*)cursor resultBlock:(AutoResultBlock)resultBlock
+{
+	[self executeInDatabase:^(AFMDatabase *db) {
+		
+		AutoResult *result = [self fetchNextPage:cursor];
+		dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(void){ resultBlock(result); });
+	}];
+}
+
 #pragma mark - fetchWithId
 
 + (instancetype) fetchId:(NSNumber*)id_field
@@ -994,27 +1186,22 @@ static NSString* fetchAllSignature = @"fetchAllIds";
 
 + (nullable AutoResult*) fetchWithIdQuery:(NSString *)idQuery arguments:(nullable NSArray*)arguments
 {
+	//Let sqlite resolve the ids in the same statement, instead of collecting them and binding one parameter per id in a second query. Cached objects are still preferred by handleFetchResult:
+	NSString *whereQuery = [NSString stringWithFormat:@"WHERE %@ IN (%@) AND is_deleted = 0", primaryKeyName, idQuery];
+	NSString *query = [self cachedQuery:whereQuery].query;
+	if (!query)
+		return nil;
+	
 	__block AutoResult* result;
 	[self.databaseQueue inDatabase:^(AFMDatabase *db){
 		
-		//first fetch the ids we are interested in
-		AFMResultSet *resultSet = [db executeQuery:idQuery withArgumentsInArray:arguments];
-		if (result == nil && [db lastErrorCode])
+		AFMResultSet *resultSet = [db executeQuery:query withArgumentsInArray:arguments];
+		if (resultSet == nil && [db lastErrorCode])
 		{
 			NSLog(@"DB query: %@ has error code: %i", idQuery, [db lastErrorCode]);
 			return;
 		}
-		if ([resultSet next])
-		{
-			NSMutableArray *ids = [NSMutableArray new];
-			do
-			{
-				[ids addObject:[resultSet objectForColumnIndex:0]];
-			} while ([resultSet next]);
-			
-			//then fetch the objects
-			result = [self fetchIds:ids];
-		}
+		result = [self handleFetchResult:resultSet];
 	}];
 	return result;
 }
@@ -1038,6 +1225,12 @@ static NSString* fetchAllSignature = @"fetchAllIds";
 
 ///Build objects from a result-set and return both dictionary and array, for flexibility, wrapped up in one AutoResult object.
 + (AutoResult *) handleFetchResult:(AFMResultSet *)result
+{
+	return [self handleFetchResult:result lastValue:NULL column:0];
+}
+
+///Same as handleFetchResult: but also gives you the raw db-value of one column from the last row, since cached objects may have unsaved changes.
++ (AutoResult *) handleFetchResult:(AFMResultSet *)result lastValue:(id _Nullable __autoreleasing * _Nullable)lastValue column:(NSInteger)valueIndex
 {
 	if ([result next])
 	{
@@ -1059,6 +1252,11 @@ static NSString* fetchAllSignature = @"fetchAllIds";
 				NSLog(@"cannot fetch no id! %@", result);
 				return nil;
 			}
+			if (lastValue)
+			{
+				id value = result[(int)valueIndex];
+				*lastValue = value == [NSNull null] ? nil : value;
+			}
 			AutoModel *object = [tableCache objectForKey:id_field];
 			if (object)
 			{
@@ -1094,9 +1292,17 @@ static NSString* fetchAllSignature = @"fetchAllIds";
 			[tableCache setObject:object forKey:id_field];
 		} while ([result next]);
 		
+		//objects that haven't got their relations yet will load them together, when first needed.
+		AutoRelationFault *fault = [self faultRelations] ? [AutoRelationFault new] : nil;
+		
 		//we must call awakeFromFetch outside of the result, in case they also need to fetch
 		for (AutoModel *object in resultReturner.rows)
 		{
+			if (fault && object.hasFetchedRelations == NO)
+			{
+				[fault.siblings addObject:object];
+				object->relationFault = fault;
+			}
 			if (!object->isAwake)
 			{
 				[object awakeFromFetch];
@@ -1216,6 +1422,7 @@ static NSString* fetchAllSignature = @"fetchAllIds";
 		{
 			NSLog(@"Could not delete objects for %@ error: %@", classString, db.lastError);
 		}
+		[AutoModelRelation deleteJoinRowsForIds:ids ofClass:self inDatabase:db];
 	}];
 	//Post notifications so others can remove these objects too.
 	dispatch_async(dispatch_get_main_queue(), ^(void){
@@ -1463,7 +1670,13 @@ static NSMutableDictionary <NSString*, NSNumber*>* throttleKeys;
 		
 		NSError *createError = [insertStatement insertObjects:createObjects objectsWithoutId:createObjectsWithoutId updateObjects:updateObjects inDatabase:db];
 		if (createError) error = createError;
-	
+		
+		//many-to-many relations in join tables are not columns, write their changes after the objects have their ids.
+		if ([self relations][AUTO_RELATIONS_MANY_JOIN_KEY])
+		{
+			NSError *joinError = [AutoModelRelation saveJoinTablesForObjects:collection ofClass:self inDatabase:db];
+			if (joinError) error = joinError;
+		}
 	}];
     return error;
 }
@@ -2279,3 +2492,79 @@ static NSMutableDictionary *statements;
 }
 
 @end
+
+#pragma mark - AutoPageCursor, keyset paging
+
+@implementation AutoPageCursor
+
++ (instancetype) cursorWithSortColumn:(NSString*)sortColumn ascending:(BOOL)ascending pageSize:(NSUInteger)pageSize condition:(nullable NSString*)condition arguments:(nullable NSArray*)arguments
+{
+	AutoPageCursor *cursor = [self new];
+	cursor.sortColumn = sortColumn;
+	cursor.ascending = ascending;
+	cursor.pageSize = pageSize;
+	cursor.condition = condition;
+	cursor.arguments = arguments.copy;
+	return cursor;
+}
+
+- (void) moveToSortValue:(nullable id)sortValue lastId:(nullable NSNumber*)lastId rowCount:(NSUInteger)rowCount
+{
+	if (rowCount < _pageSize)
+		_isAtEnd = YES;
+	if (!lastId)
+		return;
+	if (!sortValue && [_sortColumn isEqualToString:primaryKeyName] == NO)
+	{
+		//(NULL, id) > (?, ?) is never true, we cannot continue from here.
+		NSLog(@"error: sort column %@ is NULL for id %@, cannot page further", _sortColumn, lastId);
+		_isAtEnd = YES;
+	}
+	_lastSortValue = sortValue;
+	_lastId = lastId;
+}
+
++ (BOOL) supportsSecureCoding
+{
+	return YES;
+}
+
+- (void) encodeWithCoder:(NSCoder *)coder
+{
+	[coder encodeObject:_sortColumn forKey:@"sortColumn"];
+	[coder encodeBool:_ascending forKey:@"ascending"];
+	[coder encodeInteger:_pageSize forKey:@"pageSize"];
+	[coder encodeObject:_condition forKey:@"condition"];
+	[coder encodeObject:_arguments forKey:@"arguments"];
+	[coder encodeObject:_lastSortValue forKey:@"lastSortValue"];
+	[coder encodeObject:_lastId forKey:@"lastId"];
+	[coder encodeBool:_isAtEnd forKey:@"isAtEnd"];
+}
+
+- (nullable instancetype) initWithCoder:(NSCoder *)coder
+{
+	self = [super init];
+	NSSet *valueClasses = [NSSet setWithObjects:NSArray.class, NSNumber.class, NSString.class, NSData.class, NSDate.class, NSNull.class, nil];
+	_sortColumn = [coder decodeObjectOfClass:NSString.class forKey:@"sortColumn"];
+	_ascending = [coder decodeBoolForKey:@"ascending"];
+	_pageSize = [coder decodeIntegerForKey:@"pageSize"];
+	_condition = [coder decodeObjectOfClass:NSString.class forKey:@"condition"];
+	_arguments = [coder decodeObjectOfClasses:valueClasses forKey:@"arguments"];
+	_lastSortValue = [coder decodeObjectOfClasses:valueClasses forKey:@"lastSortValue"];
+	_lastId = [coder decodeObjectOfClass:NSNumber.class forKey:@"lastId"];
+	_isAtEnd = [coder decodeBoolForKey:@"isAtEnd"];
+	if (!_sortColumn)
+		return nil;
+	return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+	AutoPageCursor *copy = [AutoPageCursor cursorWithSortColumn:_sortColumn ascending:_ascending pageSize:_pageSize condition:_condition arguments:_arguments];
+	copy.lastSortValue = _lastSortValue;
+	copy.lastId = _lastId;
+	copy.isAtEnd = _isAtEnd;
+	return copy;
+}
+
+@end
@@ -8,13 +8,31 @@
 
 #import <Foundation/Foundation.h>
 #import "AutoModel.h"
-@class AFMDatabaseQueue;
+@class AFMDatabaseQueue, AFMDatabase;
+
+///Records which objects have been added to or removed from a collection since it was last saved, so relations in join tables can be updated row by row instead of rewritten.
+@interface AutoDBMembershipChanges : NSObject
+
++ (instancetype) changesForOwner:(AutoModel*)owner;
+
+///The owner is marked as changed when the collection changes, so saveAllWithChanges will find it.
+@property (nonatomic, weak) AutoModel *owner;
+@property (nonatomic, readonly) NSMutableSet *addedObjects;
+@property (nonatomic, readonly) NSMutableSet *removedObjects;
+
+- (void) objectAdded:(id)object;
+- (void) objectRemoved:(id)object;
+
+@end
 
 //These classes can be used to store to-many relationships, and you can implement any other you like as long as they follow the AutoDBCollection.
 
 @protocol AutoDBCollection <NSObject>
 @property (nonatomic) BOOL hasChanges;
 @property (nonatomic, weak) AutoModel *owner;
+@optional
+///Set on containers of AUTO_RELATIONS_MANY_JOIN_KEY relations when fetched or saved. Containers without it have all their rows rewritten when saved.
+@property (nonatomic) AutoDBMembershipChanges *membershipChanges;
 @end
 
 @interface AutoDBArray<ObjectType> : NSMutableArray<ObjectType> <AutoDBCollection>
@@ -37,5 +55,22 @@
 
 
 + (void) fetchRelations:(NSArray*)objects_in queue:(AFMDatabaseQueue *)databaseQueue;
+///Fetch only the relations stored in these properties, or all relations if properties is nil. The objects remember what has been fetched so it isn't fetched again.
++ (void) fetchRelations:(NSArray*)objects_in properties:(NSSet <NSString*>*)properties queue:(AFMDatabaseQueue *)databaseQueue;
+///Fetch relations along relation key paths, one level at a time. All objects at a level are fetched in one batch per class, and classes at the same level are fetched concurrently unless we are called from a database thread.
++ (void) prefetchRelations:(NSArray*)objects keyPaths:(NSArray<NSString*>*)keyPaths;
+
+///Compile the relations of a class into descriptors used when fetching relations. AutoDB does this during setup, other classes are compiled when first fetched.
++ (NSArray*) compileRelationsForClass:(Class)classObject;
+
+///The name of the join table used for an AUTO_RELATIONS_MANY_JOIN_KEY relation, it lives in the parent's database file.
++ (NSString*) joinTableForClass:(Class)parentClass childClass:(NSString*)childClassString;
+///Create join tables for a class during setup, and move the ids from id string columns still on disk into them the first time.
++ (void) createJoinTablesForClass:(Class)parentClass inDB:(AFMDatabase*)db;
+///Remove the join rows of deleted parents, must be called inside the parent's database queue.
++ (void) deleteJoinRowsForIds:(NSArray*)ids ofClass:(Class)parentClass inDatabase:(AFMDatabase*)db;
+///Write added and removed objects of join table containers, must be called inside the parent's database queue.
++ (NSError*) saveJoinTablesForObjects:(NSArray<AutoModel*>*)objects ofClass:(Class)parentClass inDatabase:(AFMDatabase*)db;
++ (AutoResult*) fetchJoinedParentsOf:(AutoModel*)child parentClass:(Class)parentClass;
 
 @end
@@ -10,8 +10,99 @@
 #import "AutoModelRelation.h"
 #import "AFMDatabaseQueue.h"
 #import "AFMDatabase.h"
+#import "AutoThread.h"
 
 @import ObjectiveC;
+#import <objc/message.h>
+
+//Relations are fetched this many ids per statement, so large graphs don't run into SQLite's limit on arguments.
+#define AUTO_RELATION_FETCH_IDS 500
+
+typedef NS_ENUM(NSUInteger, AutoRelationKind)
+{
+	AutoRelationKindChildren,
+	AutoRelationKindStrong,
+	AutoRelationKindManyIds,
+	AutoRelationKindManyJoin
+};
+
+///One relation from +relations, compiled when the db is setup so fetching never has to walk the relation dictionaries, look up classes or use KVC.
+@interface AutoRelationDescriptor : NSObject
+{
+	@public	//these are read in tight loops, and never changed after compiling
+	AutoRelationKind kind;
+	Class relatedClass;
+	NSString *propertyKey;					//the container or strong object of the main class
+	SEL propertyGetter, propertySetter;
+	Class containerClass;					//nil if the container should not be created before fetching
+	NSString *idKey;						//the strong id or id string of the main class, or the child's parent id
+	SEL idGetter;
+	char idType;
+	SEL inverseSetter;						//the child's parent object, or the weak object of the strong class
+	NSString *queryPrefix;					//ends with "IN (" for the fetch
+}
+@end
+
+@implementation AutoRelationDescriptor
+@end
+
+static inline id autoGetObject(id object, SEL getter)
+{
+	return ((id (*)(id, SEL))objc_msgSend)(object, getter);
+}
+
+static inline void autoSetObject(id object, SEL setter, id value)
+{
+	((void (*)(id, SEL, id))objc_msgSend)(object, setter, value);
+}
+
+static NSNumber *autoGetId(id object, AutoRelationDescriptor *descriptor)
+{
+	SEL getter = descriptor->idGetter;
+	switch (descriptor->idType)
+	{
+		case 'q': return @(((long long (*)(id, SEL))objc_msgSend)(object, getter));
+		case 'Q': return @(((unsigned long long (*)(id, SEL))objc_msgSend)(object, getter));
+		case 'i': return @(((int (*)(id, SEL))objc_msgSend)(object, getter));
+		case 'I': return @(((unsigned int (*)(id, SEL))objc_msgSend)(object, getter));
+		case '@': return ((id (*)(id, SEL))objc_msgSend)(object, getter);
+		default: return [object valueForKey:descriptor->idKey];
+	}
+}
+
+///Resolve getter, setter and type of a property, returns NO if it does not exist.
+static BOOL autoResolveProperty(Class classObject, NSString *propertyName, SEL *getter, SEL *setter, char *type)
+{
+	objc_property_t property = class_getProperty(classObject, propertyName.UTF8String);
+	if (!property)
+		return NO;
+	if (getter)
+	{
+		char *customGetter = property_copyAttributeValue(property, "G");
+		*getter = customGetter ? sel_registerName(customGetter) : NSSelectorFromString(propertyName);
+		free(customGetter);
+	}
+	if (setter)
+	{
+		char *customSetter = property_copyAttributeValue(property, "S");
+		*setter = customSetter ? sel_registerName(customSetter) : NSSelectorFromString([NSString stringWithFormat:@"set%@%@:", [[propertyName substringToIndex:1] uppercaseString], [propertyName substringFromIndex:1]]);
+		free(customSetter);
+	}
+	if (type)
+	{
+		char *typeEncoding = property_copyAttributeValue(property, "T");
+		*type = typeEncoding ? typeEncoding[0] : 0;
+		//long is q on 64 bit, but be explicit about 32 bit ints.
+		if (*type == 'l') *type = sizeof(long) == 8 ? 'q' : 'i';
+		if (*type == 'L') *type = sizeof(long) == 8 ? 'Q' : 'I';
+		free(typeEncoding);
+	}
+	return YES;
+}
+
+@interface AutoModelRelation ()
+@property (nonatomic) NSArray <AutoRelationDescriptor*>*descriptors;
+@end
 
 @implementation AutoModelRelation
 
@@ -30,23 +121,48 @@
 
 + (void) fetchRelations:(NSArray*)objects_in queue:(AFMDatabaseQueue *)databaseQueue
 {
-    //first setup the relation object by taking all un-fetched objects, loop over by class. Everything will be released when done.
+	[self fetchRelations:objects_in properties:nil queue:databaseQueue];
+}
+
++ (void) fetchRelations:(NSArray*)objects_in properties:(NSSet <NSString*>*)properties queue:(AFMDatabaseQueue *)databaseQueue
+{
+    //first setup the relation object by taking all un-fetched objects, loop over by class and the relations they are missing. Everything will be released when done.
     NSMutableDictionary *classRelations = [NSMutableDictionary dictionary];
     for (AutoModel *object in objects_in)
 	{
-		if (![object hasFetchedRelations])
-        {
-            NSString *classString = NSStringFromClass(object.class);
-            AutoModelRelation *relation = classRelations[classString];
-            if (!relation)
-            {
-                relation = [AutoModelRelation new];
-                classRelations[classString] = relation;
-                relation.mainClass = object.class;
-            }
-            relation.mainObjects[object.idValue] = object; //Don't store objects in different dictionaries, we need to check this at every step anyway.
-            object.hasFetchedRelations = YES;
-        }
+		if ([object hasFetchedRelations])
+			continue;
+		NSArray <AutoRelationDescriptor*>*descriptors = [self descriptorsForClass:object.class];
+		NSMutableSet <NSString*>*fetched = [object.fetchedRelations mutableCopy] ?: [NSMutableSet new];
+		NSMutableArray <AutoRelationDescriptor*>*missing = [NSMutableArray new];
+		NSMutableString *relationKey = [NSStringFromClass(object.class) mutableCopy];
+		for (AutoRelationDescriptor *descriptor in descriptors)
+		{
+			if ((properties && [properties containsObject:descriptor->propertyKey] == NO) || [fetched containsObject:descriptor->propertyKey])
+				continue;
+			[missing addObject:descriptor];
+			[fetched addObject:descriptor->propertyKey];
+			[relationKey appendFormat:@".%@", descriptor->propertyKey];
+		}
+		if (fetched.count == descriptors.count)
+		{
+			object.hasFetchedRelations = YES;
+			object.fetchedRelations = nil;
+		}
+		else
+			object.fetchedRelations = fetched;
+		if (missing.count == 0)
+			continue;
+		
+		AutoModelRelation *relation = classRelations[relationKey];
+		if (!relation)
+		{
+			relation = [AutoModelRelation new];
+			classRelations[relationKey] = relation;
+			relation.mainClass = object.class;
+			relation.descriptors = missing;
+		}
+		relation.mainObjects[object.idValue] = object; //Don't store objects in different dictionaries, we need to check this at every step anyway.
 	}
 	
 	for (AutoModelRelation *relation in classRelations.allValues)
@@ -60,6 +176,7 @@
 		//they never will - one parent has many children, those children never has other parents!
 		[relation fetchChildrenFromDb];
 		[relation fetchManyFromDb];
+		[relation fetchManyFromJoinTables];
 		[relation fetchStrongFromCache];
 		[relation fetchStrongFromDb];
 		[relation.mainObjects removeAllObjects];
@@ -68,152 +185,546 @@
 	[classRelations removeAllObjects];
 }
 
+#pragma mark - descriptors
+
++ (NSArray*) compileRelationsForClass:(Class)classObject
+{
+	NSDictionary *relations = [classObject relations];
+	NSString *classString = NSStringFromClass(classObject);
+	NSMutableArray <AutoRelationDescriptor*>*descriptors = [NSMutableArray new];
+	NSArray *relationKinds = @[AUTO_RELATIONS_CHILD_CONTAINER_KEY, AUTO_RELATIONS_STRONG_ID_KEY, AUTO_RELATIONS_MANY_CONTAINER_KEY, AUTO_RELATIONS_MANY_JOIN_KEY];
+	for (NSUInteger kind = AutoRelationKindChildren; kind <= AutoRelationKindManyJoin; kind++)
+	{
+		NSDictionary *relationsOfKind = relations[relationKinds[kind]];
+		for (NSString *relatedClassString in relationsOfKind)
+		{
+			AutoRelationDescriptor *descriptor = [AutoRelationDescriptor new];
+			descriptor->kind = kind;
+			descriptor->relatedClass = NSClassFromString(relatedClassString);
+			if (!descriptor->relatedClass)
+			{
+				NSLog(@"AutoDB: relation from %@ to unknown class %@", classString, relatedClassString);
+				continue;
+			}
+			NSDictionary *relatedRelations = [descriptor->relatedClass relations];
+			NSString *propertyKey = relationsOfKind[relatedClassString];
+			
+			if (kind == AutoRelationKindStrong)
+			{
+				descriptor->idKey = propertyKey;
+				autoResolveProperty(classObject, propertyKey, &descriptor->idGetter, NULL, &descriptor->idType);
+				propertyKey = relations[AUTO_RELATIONS_STRONG_OBJECT_KEY][relatedClassString];
+				NSString *weakKey = relatedRelations[AUTO_RELATIONS_WEAK_OBJECT_KEY][classString];
+				if (weakKey)
+					autoResolveProperty(descriptor->relatedClass, weakKey, NULL, &descriptor->inverseSetter, NULL);
+			}
+			else if (kind == AutoRelationKindChildren)
+			{
+				descriptor->idKey = relatedRelations[AUTO_RELATIONS_PARENT_ID_KEY][classString];
+				if (!descriptor->idKey || !autoResolveProperty(descriptor->relatedClass, descriptor->idKey, &descriptor->idGetter, NULL, &descriptor->idType))
+				{
+					NSLog(@"AutoDB:Could not fetch relation of %@ (child) to %@ (parent) due to missing key (likely you misspelled the AUTO_RELATIONS_PARENT_ID_KEY key).", relatedClassString, classString);
+					continue;
+				}
+				NSString *parentObjectKey = relatedRelations[AUTO_RELATIONS_PARENT_OBJECT_KEY][classString];
+				if (parentObjectKey)
+					autoResolveProperty(descriptor->relatedClass, parentObjectKey, NULL, &descriptor->inverseSetter, NULL);
+				descriptor->queryPrefix = [NSString stringWithFormat:@"WHERE %@ IN (", descriptor->idKey];
+			}
+			else if (kind == AutoRelationKindManyIds)
+			{
+				descriptor->idKey = relations[AUTO_RELATIONS_MANY_ID_KEY][relatedClassString];
+				if (!descriptor->idKey || !autoResolveProperty(classObject, descriptor->idKey, &descriptor->idGetter, NULL, &descriptor->idType))
+				{
+					NSLog(@"AutoDB: missing AUTO_RELATIONS_MANY_ID_KEY for %@ in %@", relatedClassString, classString);
+					continue;
+				}
+			}
+			else
+			{
+				NSString *joinTable = [self joinTableForClass:classObject childClass:relatedClassString];
+				descriptor->queryPrefix = [NSString stringWithFormat:@"SELECT parent_id, child_id FROM %@ WHERE parent_id IN (", joinTable];
+			}
+			
+			if (!propertyKey || !autoResolveProperty(classObject, propertyKey, &descriptor->propertyGetter, &descriptor->propertySetter, NULL))
+			{
+				NSLog(@"AutoDB: %@ has no property for its relation to %@", classString, relatedClassString);
+				continue;
+			}
+			descriptor->propertyKey = propertyKey;
+			if (kind != AutoRelationKindStrong)
+			{
+				descriptor->containerClass = [self containerClassForProperty:propertyKey ofClass:classObject];
+				if (kind == AutoRelationKindManyIds && descriptor->containerClass == NSMutableArray.class)
+				{
+					//when fetching an array, we use that instead of building it like this.
+					descriptor->containerClass = nil;
+				}
+			}
+			[descriptors addObject:descriptor];
+		}
+	}
+	
+	NSArray *compiled = descriptors.copy;
+	objc_setAssociatedObject(classObject, @selector(compileRelationsForClass:), compiled, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+	return compiled;
+}
+
++ (NSArray <AutoRelationDescriptor*>*) descriptorsForClass:(Class)classObject
+{
+	NSArray *descriptors = objc_getAssociatedObject(classObject, @selector(compileRelationsForClass:));
+	if (!descriptors)
+	{
+		//classes outside the db setup are compiled when first used.
+		descriptors = [self compileRelationsForClass:classObject];
+	}
+	return descriptors;
+}
+
++ (Class) containerClassForProperty:(NSString*)propertyKey ofClass:(Class)classObject
+{
+	objc_property_t property = class_getProperty(classObject, propertyKey.UTF8String);
+	char *typeEncoding = property_copyAttributeValue(property, "T");    //T means, type of property
+	Class valueClass = nil;
+	if (typeEncoding && typeEncoding[0] == '@' && strlen(typeEncoding) >= 3)
+	{
+		char *className = strndup(typeEncoding + 2, strlen(typeEncoding) - 3);
+		NSString *name = @(className);
+		NSRange range = [name rangeOfString:@"<"];
+		if (range.location != NSNotFound)
+		{
+			name = [name substringToIndex:range.location];
+		}
+		valueClass = NSClassFromString(name);
+		if (!valueClass)
+		{
+			NSLog(@"could not get class (%@) from property. Will likely crash and burn now.", name);
+		}
+		free(className);
+	}
+	free(typeEncoding);
+	return valueClass;
+}
+
+#pragma mark - prefetch
+
++ (void) prefetchRelations:(NSArray*)objects keyPaths:(NSArray<NSString*>*)keyPaths
+{
+	//build the graph, @[@"documents.attachments", @"documents.owner"] becomes { documents : { attachments : {}, owner : {} } }
+	NSMutableDictionary *graph = [NSMutableDictionary new];
+	for (NSString *keyPath in keyPaths)
+	{
+		NSMutableDictionary *node = graph;
+		for (NSString *key in [keyPath componentsSeparatedByString:@"."])
+		{
+			if (!node[key])
+				node[key] = [NSMutableDictionary new];
+			node = node[key];
+		}
+	}
+	
+	//each level is a list of objects and the part of the graph that should be followed from them.
+	NSMutableArray <NSArray*>*level = [NSMutableArray new];
+	if (objects.count && graph.count)
+		[level addObject:@[objects, graph]];
+	BOOL concurrent = [NSThread.currentThread isKindOfClass:AutoThread.class] == NO;	//from a db thread, other threads might wait for us.
+	while (level.count)
+	{
+		//one batch for each class, no matter how many parents pointed us here. Only the relations named in the key paths are fetched.
+		NSMutableDictionary <NSString*, NSMutableArray*>*objectsByClass = [NSMutableDictionary new];
+		NSMutableDictionary <NSString*, NSMutableSet*>*propertiesByClass = [NSMutableDictionary new];
+		for (NSArray *node in level)
+		{
+			NSDictionary *subGraph = node[1];
+			for (AutoModel *object in node[0])
+			{
+				if (object.hasFetchedRelations)
+					continue;
+				NSString *classString = NSStringFromClass(object.class);
+				if (!objectsByClass[classString])
+				{
+					objectsByClass[classString] = [NSMutableArray new];
+					propertiesByClass[classString] = [NSMutableSet new];
+				}
+				[objectsByClass[classString] addObject:object];
+				[propertiesByClass[classString] addObjectsFromArray:subGraph.allKeys];
+			}
+		}
+		
+		NSArray <NSString*>*classStrings = objectsByClass.allKeys;
+		void (^fetchBatch)(NSString *classString) = ^(NSString *classString)
+		{
+			NSArray *batch = objectsByClass[classString];
+			[AutoModelRelation fetchRelations:batch properties:propertiesByClass[classString] queue:[[batch.firstObject class] databaseQueue]];
+		};
+		if (concurrent && classStrings.count > 1)
+		{
+			dispatch_apply(classStrings.count, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t index)
+			{
+				fetchBatch(classStrings[index]);
+			});
+		}
+		else
+		{
+			for (NSString *classString in classStrings)
+				fetchBatch(classString);
+		}
+		
+		//now all relations at this level is in place, collect the next.
+		NSMutableArray <NSArray*>*nextLevel = [NSMutableArray new];
+		for (NSArray *node in level)
+		{
+			NSDictionary *subGraph = node[1];
+			for (NSString *key in subGraph)
+			{
+				NSDictionary *nextGraph = subGraph[key];
+				if (nextGraph.count == 0)
+					continue;	//the leaf is already fetched
+				NSMutableArray *nextObjects = [NSMutableArray new];
+				for (AutoModel *object in node[0])
+				{
+					id value = [object valueForKey:key];
+					if ([value isKindOfClass:AutoModel.class])
+						[nextObjects addObject:value];
+					else if ([value conformsToProtocol:@protocol(NSFastEnumeration)])
+					{
+						for (id related in value)
+							[nextObjects addObject:related];
+					}
+				}
+				if (nextObjects.count)
+					[nextLevel addObject:@[nextObjects, nextGraph]];
+			}
+		}
+		level = nextLevel;
+	}
+}
+
+#pragma mark - join tables
+
++ (NSString*) joinTableForClass:(Class)parentClass childClass:(NSString*)childClassString
+{
+	return [NSString stringWithFormat:@"%@_%@_join", NSStringFromClass(parentClass), childClassString];
+}
+
++ (void) createJoinTablesForClass:(Class)parentClass inDB:(AFMDatabase*)db
+{
+	NSDictionary *relations = [parentClass relations];
+	NSDictionary *joinContainers = relations[AUTO_RELATIONS_MANY_JOIN_KEY];
+	for (NSString *childClassString in joinContainers)
+	{
+		NSString *joinTable = [self joinTableForClass:parentClass childClass:childClassString];
+		AFMResultSet *result = [db executeQuery:@"SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?", joinTable];
+		BOOL exists = [result next];
+		[result close];
+		if (exists)
+			continue;
+		
+		//the primary key is our index when fetching children, the second index is used when fetching parents.
+		NSString *createTable = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ (parent_id INTEGER NOT NULL, child_id INTEGER NOT NULL, PRIMARY KEY(parent_id, child_id))", joinTable];
+		NSString *createIndex = [NSString stringWithFormat:@"CREATE INDEX IF NOT EXISTS %@_child_index ON %@ (child_id, parent_id)", joinTable, joinTable];
+		if ([db executeUpdate:createTable] == NO || [db executeUpdate:createIndex] == NO)
+		{
+			NSLog(@"AutoDB: could not create join table %@: %@", joinTable, [db lastErrorMessage]);
+			continue;
+		}
+		
+		//if this relation used to be stored as an id string, move those ids into the new table. The id string is usually no longer declared, so look for it in the table on disk: either the id key that is still declared, or an old column that migrateParameters renames to the join container.
+		NSMutableSet *idStringKeys = [NSMutableSet new];
+		if (relations[AUTO_RELATIONS_MANY_ID_KEY][childClassString])
+			[idStringKeys addObject:relations[AUTO_RELATIONS_MANY_ID_KEY][childClassString]];
+		[[parentClass migrateParameters] enumerateKeysAndObjectsUsingBlock:^(NSString *oldName, NSString *newName, BOOL *stop)
+		{
+			if ([newName isEqualToString:joinContainers[childClassString]])
+				[idStringKeys addObject:oldName];
+		}];
+		for (NSString *manyIdKey in [self columnsInDB:idStringKeys table:NSStringFromClass(parentClass) inDB:db])
+			[self migrateIdString:manyIdKey parentClass:parentClass joinTable:joinTable inDB:db];
+	}
+}
+
+///The columns of the table on disk that are among columnNames.
++ (NSArray <NSString*>*) columnsInDB:(NSSet <NSString*>*)columnNames table:(NSString*)tableName inDB:(AFMDatabase*)db
+{
+	NSMutableArray *columns = [NSMutableArray new];
+	if (columnNames.count == 0)
+		return columns;
+	AFMResultSet *result = [db executeQuery:[NSString stringWithFormat:@"PRAGMA table_info(%@);", tableName]];
+	while ([result next])
+	{
+		if ([columnNames containsObject:result[1]])
+			[columns addObject:result[1]];
+	}
+	[result close];
+	return columns;
+}
+
++ (void) migrateIdString:(NSString*)manyIdKey parentClass:(Class)parentClass joinTable:(NSString*)joinTable inDB:(AFMDatabase*)db
+{
+	NSString *tableName = NSStringFromClass(parentClass);
+	BOOL ownTransaction = [db inTransaction] == NO && [db beginTransaction];
+	NSString *insertQuery = [NSString stringWithFormat:@"INSERT OR IGNORE INTO %@ (parent_id, child_id) VALUES (?, ?)", joinTable];
+	AFMResultSet *result = [db executeQuery:[NSString stringWithFormat:@"SELECT id, %@ FROM %@ WHERE %@ IS NOT NULL AND %@ != ''", manyIdKey, tableName, manyIdKey, manyIdKey]];
+	while ([result next])
+	{
+		NSNumber *parentId = result[0];
+		for (NSString *idValue in [[result stringForColumnIndex:1] componentsSeparatedByString:@","])
+		{
+			long long childId = idValue.longLongValue;
+			if (childId && [db executeUpdate:insertQuery, parentId, @(childId)] == NO)
+				NSLog(@"AutoDB: could not move ids into %@: %@", joinTable, [db lastErrorMessage]);
+		}
+	}
+	[result close];
+	if (ownTransaction)
+		[db commit];
+}
+
++ (void) deleteJoinRowsForIds:(NSArray*)ids ofClass:(Class)parentClass inDatabase:(AFMDatabase*)db
+{
+	for (NSString *childClassString in [parentClass relations][AUTO_RELATIONS_MANY_JOIN_KEY])
+	{
+		NSString *joinTable = [self joinTableForClass:parentClass childClass:childClassString];
+		NSString *deleteQuery = [NSString stringWithFormat:@"DELETE FROM %@ WHERE parent_id IN (%@)", joinTable, [parentClass questionMarks:ids.count]];
+		if ([db executeUpdate:deleteQuery withArgumentsInArray:ids] == NO)
+			NSLog(@"AutoDB: could not delete rows from %@: %@", joinTable, [db lastErrorMessage]);
+	}
+}
+
++ (NSError*) saveJoinTablesForObjects:(NSArray<AutoModel*>*)objects ofClass:(Class)parentClass inDatabase:(AFMDatabase*)db
+{
+	NSError *error = nil;
+	BOOL ownTransaction = [db inTransaction] == NO && [db beginTransaction];
+	for (AutoRelationDescriptor *descriptor in [self descriptorsForClass:parentClass])
+	{
+		if (descriptor->kind != AutoRelationKindManyJoin)
+			continue;
+		NSString *joinTable = [self joinTableForClass:parentClass childClass:NSStringFromClass(descriptor->relatedClass)];
+		NSString *insertQuery = [NSString stringWithFormat:@"INSERT OR IGNORE INTO %@ (parent_id, child_id) VALUES (?, ?)", joinTable];
+		NSString *deleteQuery = [NSString stringWithFormat:@"DELETE FROM %@ WHERE parent_id = ? AND child_id = ?", joinTable];
+		NSString *clearQuery = [NSString stringWithFormat:@"DELETE FROM %@ WHERE parent_id = ?", joinTable];
+		
+		for (AutoModel *parent in objects)
+		{
+			if (parent.is_deleted || parent.id == 0)
+				continue;
+			id container = autoGetObject(parent, descriptor->propertyGetter);
+			if (!container)
+				continue;
+			
+			BOOL canTrack = [container respondsToSelector:@selector(setMembershipChanges:)];
+			AutoDBMembershipChanges *changes = canTrack ? [container membershipChanges] : nil;
+			NSArray *addedObjects, *removedObjects = nil;
+			if (changes)
+			{
+				@synchronized (changes)
+				{
+					addedObjects = changes.addedObjects.allObjects;
+					removedObjects = changes.removedObjects.allObjects;
+					[changes.addedObjects removeAllObjects];
+					[changes.removedObjects removeAllObjects];
+				}
+			}
+			else
+			{
+				//we don't know what has changed, so write everything.
+				if ([db executeUpdate:clearQuery, parent.idValue] == NO)
+					error = db.lastError;
+				NSMutableArray *allObjects = [NSMutableArray new];
+				for (AutoModel *child in container)
+					[allObjects addObject:child];
+				addedObjects = allObjects;
+			}
+			
+			for (AutoModel *child in removedObjects)
+			{
+				if (child.id && [db executeUpdate:deleteQuery, parent.idValue, child.idValue] == NO)
+					error = db.lastError;
+			}
+			NSMutableArray *pendingObjects = nil;
+			for (AutoModel *child in addedObjects)
+			{
+				if (child.id == 0)
+				{
+					//a child without id cannot be stored, wait until it has been saved.
+					if (!pendingObjects) pendingObjects = [NSMutableArray new];
+					[pendingObjects addObject:child];
+				}
+				else if ([db executeUpdate:insertQuery, parent.idValue, child.idValue] == NO)
+					error = db.lastError;
+			}
+			
+			if (canTrack && !changes)
+			{
+				changes = [AutoDBMembershipChanges changesForOwner:parent];
+				[container setOwner:parent];
+				[container setMembershipChanges:changes];
+			}
+			for (AutoModel *child in pendingObjects)
+				[changes objectAdded:child];
+		}
+	}
+	if (ownTransaction && [db commit] == NO)
+		error = db.lastError;
+	if (error)
+		NSLog(@"AutoDB: could not save join tables for %@: %@", parentClass, error);
+	return error;
+}
+
++ (AutoResult*) fetchJoinedParentsOf:(AutoModel*)child parentClass:(Class)parentClass
+{
+	NSString *joinTable = [self joinTableForClass:parentClass childClass:NSStringFromClass(child.class)];
+	if (child.id == 0 || [parentClass relations][AUTO_RELATIONS_MANY_JOIN_KEY][NSStringFromClass(child.class)] == nil)
+		return nil;
+	NSString *idQuery = [NSString stringWithFormat:@"SELECT parent_id FROM %@ WHERE child_id = ?", joinTable];
+	return [parentClass fetchWithIdQuery:idQuery arguments:@[child.idValue]];
+}
+
 - (void) fetchStrongFromDb
 {
-    NSDictionary *relations = self.relationDictionary;
-    NSString *thisClassString = NSStringFromClass(self.mainClass);
-    
-    //Find strong-weak relations, one class at a time
-    for (NSString *strongClassString in [relations[AUTO_RELATIONS_STRONG_ID_KEY] allKeys])
-    {
-        NSString *strongRelationKey = relations[AUTO_RELATIONS_STRONG_ID_KEY][strongClassString];
-        NSString *strongRelationObjectKey = relations[AUTO_RELATIONS_STRONG_OBJECT_KEY][strongClassString];
-        
-        //coalesce all ids
-        NSMutableArray *strongRelationIds = [NSMutableArray array];
-        for (AutoModel *hasStrongRelation in self.mainObjects.allValues)
-        {
-            if ([hasStrongRelation valueForKey:strongRelationObjectKey])
-            {
-                //don't fetch/insert objects that already exists. (it will lead to data corruption)
-                continue;
-            }
-            NSNumber* strongRelationId = [hasStrongRelation valueForKey:strongRelationKey];
-            if (strongRelationId.integerValue)
-            {
-                [strongRelationIds addObject:strongRelationId];
-            }
-        }
-        
-        if (strongRelationIds.count == 0)
-        {
-            //no relationship objects here.
-            continue;
-        }
-        
-        //fetch the data and create objects from them
-        Class strongClass = NSClassFromString(strongClassString);
-        NSDictionary *fetchedObjects = [strongClass fetchIds:strongRelationIds].dictionary;
-        
-        //when setting the strong relation, check if the want a corresponding weak relation back to us
-        NSDictionary *weakRelations = [strongClass relations];
-        id weakObjectKey = nil;
-        if (weakRelations[AUTO_RELATIONS_WEAK_OBJECT_KEY])
-        {
-            weakObjectKey = weakRelations[AUTO_RELATIONS_WEAK_OBJECT_KEY][thisClassString];
-        }
-        
-        //now set these objects to where they belong
-        for (AutoModel *hasStrongRelation in self.mainObjects.allValues)
-        {
-            if ([hasStrongRelation valueForKey:strongRelationObjectKey])
-            {
-                //don't fetch/insert objects that already exists. (it will lead to data corruption)
-                continue;
-            }
-            id strongRelation = [hasStrongRelation valueForKey:strongRelationKey];
-            if (strongRelation)
-            {
-                AutoModel *strongObject = fetchedObjects[strongRelation];
-                if (strongObject)
-                {
-                    [hasStrongRelation setValue:strongObject forKey:strongRelationObjectKey];
-                    if (weakObjectKey)
-                    {
-                        //it had a weak reference back to us. Set it.
-                        [strongObject setValue:hasStrongRelation forKey:weakObjectKey];
-                    }
-                }
-                else
-                {
-                    NSLog(@"We are missing object for relation (%@), %@ = %@", strongClassString, strongRelationKey, strongRelation);
-                }
-            }
-        }
-    }
+	//Find strong-weak relations, one class at a time
+	for (AutoRelationDescriptor *descriptor in self.descriptors)
+	{
+		if (descriptor->kind != AutoRelationKindStrong)
+			continue;
+		
+		//coalesce all ids
+		NSMutableArray *strongRelationIds = [NSMutableArray array];
+		for (AutoModel *hasStrongRelation in self.mainObjects.allValues)
+		{
+			if (autoGetObject(hasStrongRelation, descriptor->propertyGetter))
+			{
+				//don't fetch/insert objects that already exists. (it will lead to data corruption)
+				continue;
+			}
+			NSNumber* strongRelationId = autoGetId(hasStrongRelation, descriptor);
+			if (strongRelationId.integerValue)
+			{
+				[strongRelationIds addObject:strongRelationId];
+			}
+		}
+		
+		if (strongRelationIds.count == 0)
+		{
+			//no relationship objects here.
+			continue;
+		}
+		
+		//fetch the data and create objects from them
+		NSDictionary *fetchedObjects = [self fetchIds:strongRelationIds ofClass:descriptor->relatedClass];
+		
+		//now set these objects to where they belong
+		for (AutoModel *hasStrongRelation in self.mainObjects.allValues)
+		{
+			if (autoGetObject(hasStrongRelation, descriptor->propertyGetter))
+			{
+				//don't fetch/insert objects that already exists. (it will lead to data corruption)
+				continue;
+			}
+			NSNumber *strongRelation = autoGetId(hasStrongRelation, descriptor);
+			if (strongRelation.integerValue)
+			{
+				AutoModel *strongObject = fetchedObjects[strongRelation];
+				if (strongObject)
+				{
+					autoSetObject(hasStrongRelation, descriptor->propertySetter, strongObject);
+					if (descriptor->inverseSetter)
+					{
+						//it had a weak reference back to us. Set it.
+						autoSetObject(strongObject, descriptor->inverseSetter, hasStrongRelation);
+					}
+				}
+				else
+				{
+					NSLog(@"We are missing object for relation (%@), %@ = %@", descriptor->relatedClass, descriptor->idKey, strongRelation);
+				}
+			}
+		}
+	}
 }
 
 - (void) fetchChildrenFromDb
 {
-    NSDictionary *relations = self.relationDictionary;
-    NSString *parentClassString = NSStringFromClass(self.mainClass);
-    
-    //find parent-children relations
-    for (NSString *childClassString in [relations[AUTO_RELATIONS_CHILD_CONTAINER_KEY] allKeys])
-    {
-        Class childClass = NSClassFromString(childClassString);
-        NSDictionary *childRelations = [childClass relations];
-        NSString *keyName = childRelations[AUTO_RELATIONS_PARENT_ID_KEY][parentClassString];
-        if (!keyName)
-        {
-            NSLog(@"AutoDB:Could not fetch relation of %@ (child) to %@ (parent) due to missing key (likely you misspelled the AUTO_RELATIONS_PARENT_ID_KEY key).", childClass, parentClassString);
-            continue;
-        }
+	//find parent-children relations
+	for (AutoRelationDescriptor *descriptor in self.descriptors)
+	{
+		if (descriptor->kind != AutoRelationKindChildren)
+			continue;
 		
 		//create a query to fetch all children refering to our parent.
-		NSString *questionMarks = [AutoModel questionMarks:self.mainObjects.count];
-		NSString *whereQuery = [NSString stringWithFormat:@"WHERE %@ IN (%@)", keyName, questionMarks];
-		NSArray *resultArray = [childClass fetchQuery:whereQuery arguments:self.mainObjects.allKeys].rows;
+		NSMutableArray *resultArray = [NSMutableArray new];
+		[self enumerateChunksOfIds:self.mainObjects.allKeys block:^(NSArray *ids)
+		{
+			NSString *whereQuery = [descriptor->queryPrefix stringByAppendingFormat:@"%@)", [AutoModel questionMarks:ids.count]];
+			[resultArray addObjectsFromArray:[descriptor->relatedClass fetchQuery:whereQuery arguments:ids].rows];
+		}];
 		
 		for (AutoModel *child in resultArray)
 		{
 			//we must also set the child to the parent (otherwise it will be dealloced).
-			NSDictionary *childRelations = [child.class relations];
-			NSString *parentIdProperty = childRelations[AUTO_RELATIONS_PARENT_ID_KEY][parentClassString];
-			NSNumber* parentId = [child valueForKey:parentIdProperty];
-			
-			AutoModel *parent = self.mainObjects[parentId];
+			AutoModel *parent = self.mainObjects[autoGetId(child, descriptor)];
 			if (parent)
 			{
 				//set the parent at the child
-				NSString *objectKeyName = childRelations[AUTO_RELATIONS_PARENT_OBJECT_KEY][parentClassString];
-				if (objectKeyName)
+				if (descriptor->inverseSetter)
 				{
 					//We should check that this is a weak property OR that the container does not exist.
-					[child setValue:parent forKey:objectKeyName];
+					autoSetObject(child, descriptor->inverseSetter, parent);
 				}
 				
 				//set the child at the parent
-				NSString *arrayPropertyKeyName = relations[AUTO_RELATIONS_CHILD_CONTAINER_KEY][childClassString];
-				id container = [parent valueForKey:arrayPropertyKeyName];
-				[container addObject:child];
+				[autoGetObject(parent, descriptor->propertyGetter) addObject:child];
 			}
 		}
-    }
+	}
 }
 
 - (void) fetchManyFromDb
 {
-	NSDictionary *relations = self.relationDictionary;
-	NSDictionary *manyContainers = relations[AUTO_RELATIONS_MANY_CONTAINER_KEY];
-	
 	//find parent-children relations
-	for (NSString *childClassString in manyContainers)
+	for (AutoRelationDescriptor *descriptor in self.descriptors)
 	{
-		Class childClass = NSClassFromString(childClassString);
-		NSString *containerKey = manyContainers[childClassString];
-		NSString *manyIdKey = relations[AUTO_RELATIONS_MANY_ID_KEY][childClassString];
+		if (descriptor->kind != AutoRelationKindManyIds)
+			continue;
 		
+		//collect all ids first, so we only need one fetch for all our objects instead of one each.
+		NSMutableDictionary <NSNumber*, NSArray <NSNumber*>*>*idsForObject = [NSMutableDictionary new];
+		NSMutableSet <NSNumber*>*allIds = [NSMutableSet new];
 		for (AutoModel *model in self.mainObjects.allValues)
 		{
-			NSString *idString = [model valueForKey:manyIdKey];
-			if (!idString)
+			NSString *idString = autoGetObject(model, descriptor->idGetter);
+			if (idString.length == 0)
 				continue;
-			NSArray *rows = [childClass fetchIds:[idString componentsSeparatedByString:@","]].rows;
-			NSMutableSet *container = [model valueForKey:containerKey];
+			NSMutableArray <NSNumber*>*ids = [NSMutableArray new];
+			for (NSString *idValue in [idString componentsSeparatedByString:@","])
+			{
+				long long childId = idValue.longLongValue;
+				if (childId)
+					[ids addObject:@(childId)];
+			}
+			idsForObject[model.idValue] = ids;
+			[allIds addObjectsFromArray:ids];
+		}
+		if (allIds.count == 0)
+			continue;
+		
+		NSDictionary <NSNumber*, AutoModel*>*fetchedObjects = [self fetchIds:allIds.allObjects ofClass:descriptor->relatedClass];
+		[idsForObject enumerateKeysAndObjectsUsingBlock:^(NSNumber *modelId, NSArray <NSNumber*>*ids, BOOL *stop)
+		{
+			//keep the order of the id string
+			AutoModel *model = self.mainObjects[modelId];
+			NSMutableArray *rows = [NSMutableArray arrayWithCapacity:ids.count];
+			for (NSNumber *childId in ids)
+			{
+				AutoModel *child = fetchedObjects[childId];
+				if (child)
+					[rows addObject:child];
+			}
+			
+			NSMutableSet *container = autoGetObject(model, descriptor->propertyGetter);
 			if (container == nil)
 			{
-				[model setValue:rows forKey:containerKey];	//this was a mutable array, those are not created.
+				autoSetObject(model, descriptor->propertySetter, rows);	//this was a mutable array, those are not created.
 			}
 			else
 			{
@@ -229,41 +740,103 @@
 					}
 				}
 			}
+		}];
+	}
+}
+
+- (void) fetchManyFromJoinTables
+{
+	for (AutoRelationDescriptor *descriptor in self.descriptors)
+	{
+		if (descriptor->kind != AutoRelationKindManyJoin)
+			continue;
+		//read all rows for all our parents at once, then fetch the children in one go. A parent is only in one chunk, so its rows keep their order.
+		NSMutableArray <NSArray <NSNumber*>*>*rows = [NSMutableArray new];
+		NSMutableSet <NSNumber*>*allIds = [NSMutableSet new];
+		[self.mainClass inDatabase:^(AFMDatabase *db)
+		{
+			[self enumerateChunksOfIds:self.mainObjects.allKeys block:^(NSArray *ids)
+			{
+				NSString *query = [descriptor->queryPrefix stringByAppendingFormat:@"%@) ORDER BY rowid", [AutoModel questionMarks:ids.count]];
+				AFMResultSet *result = [db executeQuery:query withArgumentsInArray:ids];
+				while ([result next])
+				{
+					NSNumber *childId = result[1];
+					[rows addObject:@[result[0], childId]];
+					[allIds addObject:childId];
+				}
+				[result close];
+			}];
+		}];
+		
+		NSDictionary <NSNumber*, AutoModel*>*fetchedObjects = allIds.count ? [self fetchIds:allIds.allObjects ofClass:descriptor->relatedClass] : nil;
+		for (NSArray <NSNumber*>*row in rows)
+		{
+			AutoModel *child = fetchedObjects[row[1]];
+			AutoModel *parent = self.mainObjects[row[0]];
+			if (child && parent)
+				[autoGetObject(parent, descriptor->propertyGetter) addObject:child];
+		}
+		
+		//start tracking after filling, so only changes made from now on are written when saving.
+		for (AutoModel *parent in self.mainObjects.allValues)
+		{
+			id container = autoGetObject(parent, descriptor->propertyGetter);
+			if ([container respondsToSelector:@selector(setMembershipChanges:)])
+			{
+				[container setOwner:parent];
+				[container setMembershipChanges:[AutoDBMembershipChanges changesForOwner:parent]];
+			}
 		}
 	}
 }
 
+- (void) enumerateChunksOfIds:(NSArray *)ids block:(void (^)(NSArray *ids))block
+{
+	for (NSUInteger index = 0; index < ids.count; index += AUTO_RELATION_FETCH_IDS)
+	{
+		block([ids subarrayWithRange:NSMakeRange(index, MIN(AUTO_RELATION_FETCH_IDS, ids.count - index))]);
+	}
+}
+
+- (NSDictionary <NSNumber*, AutoModel*>*) fetchIds:(NSArray *)ids ofClass:(Class)relatedClass
+{
+	if (ids.count <= AUTO_RELATION_FETCH_IDS)
+		return [relatedClass fetchIds:ids].dictionary;
+	NSMutableDictionary <NSNumber*, AutoModel*>*fetchedObjects = [NSMutableDictionary new];
+	[self enumerateChunksOfIds:ids block:^(NSArray *chunk)
+	{
+		[fetchedObjects addEntriesFromDictionary:[relatedClass fetchIds:chunk].dictionary];
+	}];
+	return fetchedObjects;
+}
+
 - (void) fetchStrongFromCache
 {
-    NSDictionary *relations = self.relationDictionary;
-    
-    //check the cache for weak-strong relations
-    for (NSString *strongClassString in [relations[AUTO_RELATIONS_STRONG_ID_KEY] allKeys])
-    {
-		Class strongClass = NSClassFromString(strongClassString);
-		AutoConcurrentMapTable *tableCache = [strongClass tableCache];
-        for (AutoModel *hasStrongRelation in self.mainObjects.allValues)
-        {
-            //check if there are strong relations by finding the strong_id_key.
-            id strongIdKey = relations[AUTO_RELATIONS_STRONG_ID_KEY][strongClassString];
-            id strongId = [hasStrongRelation valueForKey:strongIdKey];
-            id object = [tableCache objectForKey:strongId];
-            if (strongId && object)
-            {
-                //set the object to the relation-property.
-                id strongObjectKey = relations[AUTO_RELATIONS_STRONG_OBJECT_KEY][strongClassString];
-                [hasStrongRelation setValue:object forKey:strongObjectKey];
-                
-                //check if the object has a coresponding weak-relationship
-                NSDictionary *reverseRelations = [strongClass relations];
-                id weakPropertyName = reverseRelations[AUTO_RELATIONS_WEAK_OBJECT_KEY][NSStringFromClass(hasStrongRelation.class)];
-                if (weakPropertyName)
-                {
-                    [object setValue:hasStrongRelation forKey:weakPropertyName];
-                }
-            }
-        }
-    }
+	//check the cache for weak-strong relations
+	for (AutoRelationDescriptor *descriptor in self.descriptors)
+	{
+		if (descriptor->kind != AutoRelationKindStrong)
+			continue;
+		AutoConcurrentMapTable *tableCache = [descriptor->relatedClass tableCache];
+		for (AutoModel *hasStrongRelation in self.mainObjects.allValues)
+		{
+			//check if there are strong relations by finding the strong_id_key.
+			NSNumber *strongId = autoGetId(hasStrongRelation, descriptor);
+			id object = strongId.integerValue ? [tableCache objectForKey:strongId] : nil;
+			if (object)
+			{
+				//set the object to the relation-property.
+				autoSetObject(hasStrongRelation, descriptor->propertySetter, object);
+				
+				//check if the object has a coresponding weak-relationship
+				if (descriptor->inverseSetter)
+				{
+					autoSetObject(object, descriptor->inverseSetter, hasStrongRelation);
+				}
+			}
+		}
+	}
 }
 
 - (void) fetchChildrenFromCache
@@ -314,67 +887,32 @@
 
 - (void) setupContainers
 {
-    NSDictionary *relations = self.relationDictionary;
-	NSDictionary *childContainers = relations[AUTO_RELATIONS_CHILD_CONTAINER_KEY];
-	NSDictionary *manyContainers = relations[AUTO_RELATIONS_MANY_CONTAINER_KEY];
-	
-    //setup the parent for storing the child - all child relations for each parent
-    for (NSString *childClassString in childContainers)
-    {
-		//only when we have the child container key, will our objects be parents - so we know all our mainObjects are parents.
-        for (AutoModel *parent in self.mainObjects.allValues)
-        {
-            NSString *arrayPropertyKeyName = childContainers[childClassString];
-			[self setupContainerForParent:parent propertyKey:arrayPropertyKeyName ignoreArray:NO];
-        }
-    }
-	
-	for (NSString *childClassString in manyContainers)
+	//only when we have containers will our objects be parents - so we know all our mainObjects are parents.
+	for (AutoRelationDescriptor *descriptor in self.descriptors)
 	{
-		//only when we have the child container key, will our objects be parents - so we know all our mainObjects are parents.
+		if (descriptor->kind == AutoRelationKindStrong)
+			continue;
 		for (AutoModel *parent in self.mainObjects.allValues)
 		{
-			NSString *arrayPropertyKeyName = manyContainers[childClassString];
-			[self setupContainerForParent:parent propertyKey:arrayPropertyKeyName ignoreArray:YES];
+			[self setupContainerForParent:parent descriptor:descriptor];
 		}
 	}
 }
 
-- (void) setupContainerForParent:(AutoModel *)parent propertyKey:(NSString*)arrayPropertyKeyName ignoreArray:(BOOL)ignoreArray
+- (void) setupContainerForParent:(AutoModel *)parent descriptor:(AutoRelationDescriptor*)descriptor
 {
-	NSMutableArray* container = [parent valueForKey:arrayPropertyKeyName];
+	NSMutableArray* container = autoGetObject(parent, descriptor->propertyGetter);
+	if ([container respondsToSelector:@selector(setMembershipChanges:)])
+		[(id <AutoDBCollection>)container setMembershipChanges:nil];	//tracking starts again when the relation has been fetched.
 	if (!container)    //create the container (array or set)
 	{
-		objc_property_t property = class_getProperty(self.mainClass, [arrayPropertyKeyName UTF8String]);
-		
-		char *typeEncoding = property_copyAttributeValue(property, "T");    //T means, type of property
-		
-		if (typeEncoding[0] == '@' && strlen(typeEncoding) >= 3)
+		if (!descriptor->containerClass)
 		{
-			char *className = strndup(typeEncoding + 2, strlen(typeEncoding) - 3);
-			NSString *name = @(className);
-			NSRange range = [name rangeOfString:@"<"];
-			if (range.location != NSNotFound)
-			{
-				name = [name substringToIndex:range.location];
-			}
-			if (ignoreArray && [name isEqualToString:@"NSMutableArray"])
-			{
-				//when fetching an array, we use that instead of building it like this.
-				free(typeEncoding);
-				free(className);
-				return;
-			}
-			Class valueClass = NSClassFromString(name);
-			if (!valueClass)
-			{
-				NSLog(@"could not get class (%@) from property. Will likely crash and burn now.", name);
-			}
-			container = [valueClass new];
-			[parent setValue:container forKey:arrayPropertyKeyName];
-			free(typeEncoding);
-			free(className);
+			//when fetching an array, we use that instead of building it like this.
+			return;
 		}
+		container = [descriptor->containerClass new];
+		autoSetObject(parent, descriptor->propertySetter, container);
 	}
 	else if (container.count > 0)
 	{
@@ -416,11 +954,55 @@
 
 #pragma mark - Storage implementations
 
+@implementation AutoDBMembershipChanges
+
++ (instancetype) changesForOwner:(AutoModel*)owner
+{
+	AutoDBMembershipChanges *changes = [self new];
+	changes.owner = owner;
+	return changes;
+}
+
+- (instancetype) init
+{
+	self = [super init];
+	_addedObjects = [NSMutableSet new];
+	_removedObjects = [NSMutableSet new];
+	return self;
+}
+
+- (void) objectAdded:(id)object
+{
+	@synchronized (self)
+	{
+		//adding something we just removed means the stored row is still correct.
+		if ([_removedObjects containsObject:object])
+			[_removedObjects removeObject:object];
+		else
+			[_addedObjects addObject:object];
+	}
+	self.owner.hasChanges = YES;
+}
+
+- (void) objectRemoved:(id)object
+{
+	@synchronized (self)
+	{
+		if ([_addedObjects containsObject:object])
+			[_addedObjects removeObject:object];
+		else
+			[_removedObjects addObject:object];
+	}
+	self.owner.hasChanges = YES;
+}
+
+@end
+
 @implementation AutoDBArray
 {
 	NSMutableArray *storage;
 }
-@synthesize hasChanges, owner;
+@synthesize hasChanges, owner, membershipChanges;
 
 - (void)setHasChanges:(BOOL)hasChanges_
 {
@@ -463,31 +1045,54 @@
 - (void)insertObject:(id)anObject atIndex:(NSUInteger)index
 {
 	hasChanges = YES;
+	[self objectAdded:anObject];
 	[storage insertObject:anObject atIndex:index];
 }
 
 - (void)removeObjectAtIndex:(NSUInteger)index
 {
 	hasChanges = YES;
+	id object = storage[index];
 	[storage removeObjectAtIndex:index];
+	[self objectRemoved:object];
 }
 
 - (void)addObject:(id)anObject
 {
 	hasChanges = YES;
+	[self objectAdded:anObject];
 	[storage addObject:anObject];
 }
 
 - (void)removeLastObject
 {
 	hasChanges = YES;
+	id object = storage.lastObject;
 	[storage removeLastObject];
+	if (object) [self objectRemoved:object];
 }
 
 - (void)replaceObjectAtIndex:(NSUInteger)index withObject:(id)anObject
 {
 	hasChanges = YES;
+	id object = storage[index];
+	[self objectAdded:anObject];
 	[storage replaceObjectAtIndex:index withObject:anObject];
+	[self objectRemoved:object];
+}
+
+///Another copy of an object that is already here has its row, adding it must not hide that row from a later removal.
+- (void) objectAdded:(id)object
+{
+	if (membershipChanges && [storage indexOfObject:object] == NSNotFound)
+		[membershipChanges objectAdded:object];
+}
+
+///The join table has one row per child, so it may only be removed when the last copy of it is gone.
+- (void) objectRemoved:(id)object
+{
+	if (membershipChanges && [storage indexOfObject:object] == NSNotFound)
+		[membershipChanges objectRemoved:object];
 }
 @end
 
@@ -495,7 +1100,7 @@
 {
 	NSMutableSet *storage;
 }
-@synthesize hasChanges, owner;
+@synthesize hasChanges, owner, membershipChanges;
 
 - (void)setHasChanges:(BOOL)hasChanges_
 {
@@ -528,12 +1133,14 @@
 - (void)addObject:(id)object
 {
 	hasChanges = YES;
+	if (membershipChanges && [storage containsObject:object] == NO) [membershipChanges objectAdded:object];
 	[storage addObject:object];
 }
 
 - (void)removeObject:(id)object
 {
 	hasChanges = YES;
+	if (membershipChanges && [storage containsObject:object]) [membershipChanges objectRemoved:object];
 	[storage removeObject:object];
 }
 
@@ -558,7 +1165,7 @@
 {
 	NSMutableOrderedSet *storage;
 }
-@synthesize hasChanges, owner;
+@synthesize hasChanges, owner, membershipChanges;
 
 - (void)setHasChanges:(BOOL)hasChanges_
 {
@@ -591,12 +1198,14 @@
 - (void)addObject:(id)object
 {
 	hasChanges = YES;
+	if (membershipChanges && [storage containsObject:object] == NO) [membershipChanges objectAdded:object];
 	[storage addObject:object];
 }
 
 - (void)removeObject:(id)object
 {
 	hasChanges = YES;
+	if (membershipChanges && [storage containsObject:object]) [membershipChanges objectRemoved:object];
 	[storage removeObject:object];
 }
 
@@ -623,18 +1232,25 @@
 - (void)insertObject:(id)anObject atIndex:(NSUInteger)index
 {
 	hasChanges = YES;
+	if (membershipChanges && [storage containsObject:anObject] == NO) [membershipChanges objectAdded:anObject];
 	[storage insertObject:anObject atIndex:index];
 }
 
 - (void)removeObjectAtIndex:(NSUInteger)index
 {
 	hasChanges = YES;
+	if (membershipChanges) [membershipChanges objectRemoved:storage[index]];
 	[storage removeObjectAtIndex:index];
 }
 
 - (void)replaceObjectAtIndex:(NSUInteger)index withObject:(id)anObject
 {
 	hasChanges = YES;
+	if (membershipChanges && [storage containsObject:anObject] == NO)
+	{
+		[membershipChanges objectRemoved:storage[index]];
+		[membershipChanges objectAdded:anObject];
+	}
 	[storage replaceObjectAtIndex:index withObject:anObject];
 }
 
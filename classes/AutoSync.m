@@ -130,6 +130,13 @@
 	if (translate.singleJSONKey)
 	{
 		//if we have a single data JSON key it means that ALL the rest of the columns goes into the JSON.
+		//Compact codecs send the columns as they are (blobs too), otherwise they are packed into a JSON string.
+		id<AutoSyncPayloadCodec> codec = [AutoSyncHandler sharedInstance].payloadCodec;
+		if (codec.encodesNestedValues)
+		{
+			result[translate.singleJSONKey] = dataColumns;
+			return result;
+		}
 		//NOTE: TODO: If a column is data, just apply a string-transform.
 		@try
 		{
@@ -23,11 +23,55 @@ typedef NS_ENUM(NSUInteger, SyncState)
 	SyncStateRegular = 1,
 	SyncStateResendActions = 1 << 1,
 	SyncStateInit = 1 << 2,
+	///Asks the server how much of the last batch it stored, after a round trip without reply.
+	SyncStateResume = 1 << 3,
 };
 
 NS_ASSUME_NONNULL_BEGIN
 
-@class AutoUser;
+///Encodes the body of sync requests. Set one on AutoSyncHandler.payloadCodec to change the wire format, your server must understand it.
+@protocol AutoSyncPayloadCodec <NSObject>
+
+///Content-Type header of the encoded body.
+@property (nonatomic, readonly) NSString *contentType;
+///Content-Encoding header of the encoded body, nil if it is not compressed.
+@property (nonatomic, readonly, nullable) NSString *contentEncoding;
+///YES if columns packed by syncDataToServer: can be sent as a nested dictionary (with blobs as data), instead of a JSON string.
+@property (nonatomic, readonly) BOOL encodesNestedValues;
+
+- (nullable NSData*) encodePayload:(NSDictionary*)payload error:(NSError**)error;
+
+@optional
+- (nullable id) decodePayload:(NSData*)data error:(NSError**)error;
+
+@end
+
+/**
+ Compact binary encoding compressed with deflate (zlib). Arrays of rows are sent as tables with their column names once, integers (like ids) as varints and blobs as raw bytes.
+ Values are a type byte followed by: nothing (null, false, true, missing), a zigzag varint (integer), 8 bytes little endian (double, dates as seconds since 1970), a varint length and bytes (string as UTF-8, data), a varint count and values (array), a varint count and key-value pairs (map) or a varint column count with column names followed by a varint row count and one value per column and row (table).
+ */
+@interface AutoSyncBinaryCodec : NSObject <AutoSyncPayloadCodec>
+
+///Defaults to Z_DEFAULT_COMPRESSION, use 0 to turn off compression.
+@property (nonatomic) int compressionLevel;
+
++ (nullable NSData*) deflate:(NSData*)data level:(int)level;
++ (nullable NSData*) inflate:(NSData*)data;
+
+@end
+
+///Carries sync requests to the server, set one on AutoSyncHandler.transport to sync without ADBackgroundDownload (e.g. against AutoSyncLocalServer).
+@protocol AutoSyncTransport <NSObject>
+
+/**
+ Send a sync request and call completion with the raw reply body, on any thread.
+ @param payload The request before encoding: { "autoSync": { "id": change_id, SyncType: { server_table_name: rows or ids } } }
+ */
+- (void) sendRequest:(NSURLRequest*)request payload:(NSDictionary*)payload completion:(void (^)(NSData * _Nullable reply, NSInteger statusCode, NSError * _Nullable error))completion;
+
+@end
+
+@class AutoUser, AutoSyncWindow;
 /**
 
 */
@@ -43,6 +87,14 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic) BOOL preventAutoSync;
 ///tell us if we are syncing
 @property (nonatomic, readonly) BOOL isSyncing, isInitSyncing;
+///How sync requests are encoded, nil (default) sends them as JSON parameters through ADBackgroundDownload.
+@property (nonatomic, nullable) id<AutoSyncPayloadCodec> payloadCodec;
+///Where sync requests are sent, nil (default) uses ADBackgroundDownload.
+@property (nonatomic, nullable) id<AutoSyncTransport> transport;
+///How many groups (database files) are read and applied at the same time, 1 handles them one after the other. Defaults to 4.
+@property (nonatomic) NSUInteger maxConcurrentGroups;
+///The byte budget for sync batches, adapts to throughput and failures. Change its targets to tune how much is sent per request.
+@property (nonatomic, readonly, nullable) AutoSyncWindow *syncWindow;
 @property (nonatomic) AutoUser *currentUser;	//here only for testing
 
 + (instancetype) sharedInstance;
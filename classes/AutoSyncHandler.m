@@ -26,6 +26,992 @@
 
 #import "AutoDB.h"
 #import "AutoSyncRecord.h"
+#import <zlib.h>
+
+//Server rows are applied this many at a time, each batch in its own transaction and autorelease pool.
+#define AUTO_SYNC_APPLY_BATCH 500
+//Replies are read from their stream in chunks of this size.
+#define AUTO_SYNC_READ_CHUNK 65536
+//Default for maxConcurrentGroups.
+#define AUTO_SYNC_CONCURRENT_GROUPS 4
+//Tombstones are purged this many rows per block, so queries to the same file never wait for a whole purge.
+#define AUTO_SYNC_PURGE_BATCH 500
+//Batches smaller than this don't resize the sync window, their round trip is mostly latency.
+#define AUTO_SYNC_MEASURE_MIN_BYTES 4096
+
+///A batch read from the log and translated into sync-format, ready to be sent.
+@interface AutoSyncBatch : NSObject
+
+@property (nonatomic) AutoSyncLogBatch *logBatch;
+///The create and update actions: { SyncType: { server_table_name: [rows] } }
+@property (nonatomic) NSMutableDictionary *actions;
+///{ className: @[approx bytes, rows] }
+@property (nonatomic) NSMutableDictionary <NSString*, NSArray <NSNumber*>*> *measures;
+///Every row in the batch: { className: {1,2,3} }
+@property (nonatomic) NSMutableDictionary <NSString*, NSMutableSet <NSNumber*>*> *ids;
+///Sent as "batch", the last seq of the log batch. It stays the same while the batch is resent.
+@property (nonatomic) long long batchId;
+///The ids of the sent rows in request order, so acknowledged counts can be mapped to rows: { className: { SyncType: [ids] } }
+@property (nonatomic) NSMutableDictionary <NSString*, NSMutableDictionary <NSNumber*, NSArray <NSNumber*>*>*> *sentIds;
+
+@end
+
+@implementation AutoSyncBatch
+@end
+
+//New rows are inserted this many per statement, so every full batch reuses one prepared statement.
+#define AUTO_SYNC_INSERT_ROWS 100
+
+///How server rows are written for one class. Columns and their types are resolved once and reused for every batch.
+@interface AutoSyncApplyPlan : NSObject
+
+@property (nonatomic, readonly) NSString *className;
+@property (nonatomic, readonly) NSDictionary <NSString *, NSNumber *>*columnSyntax;
+///Columns written when creating rows, all except preventSyncColumns.
+@property (nonatomic, readonly) NSArray <NSString*>*insertColumns;
+@property (nonatomic, readonly) NSUInteger insertRows;
+@property (nonatomic, readonly, nullable) NSSet <NSString*>*presidentColumns;
+
+- (instancetype) initWithClass:(Class)tableClass className:(NSString*)className;
+///Append the values of a new row in insertColumns order.
+- (void) addInsertValues:(NSDictionary*)values to:(NSMutableArray*)arguments;
+///Insert rows from addInsertValues: in fixed-width statements.
+- (BOOL) insertValues:(NSArray*)values inDB:(AFMDatabase*)db;
+///Update existing rows with only the columns each one has, rows with the same columns share one prepared statement. Rows we don't have are not affected.
+- (BOOL) updateRows:(NSDictionary <NSNumber*, NSDictionary*>*)rows markCreated:(BOOL)markCreated inDB:(AFMDatabase*)db;
+///Set the values on an object without marking it as changed.
+- (void) patchObject:(AutoSync*)object values:(NSDictionary*)values;
+
+@end
+
+@implementation AutoSyncApplyPlan
+{
+	NSString *fullInsertQuery;
+}
+
+- (instancetype) initWithClass:(Class)tableClass className:(NSString*)className
+{
+	self = [super init];
+	_className = className;
+	_columnSyntax = [AutoDB.sharedInstance columnSyntaxForClass:tableClass];
+	NSMutableArray *columns = _columnSyntax.allKeys.mutableCopy;
+	NSSet *preventSyncColumns = [tableClass preventSyncColumns];
+	if (preventSyncColumns)
+	{
+		[columns removeObjectsInArray:[preventSyncColumns allObjects]];
+	}
+	_insertColumns = columns;
+	//AFMDatabase allows 500000 variables per statement.
+	_insertRows = MAX(1, MIN(AUTO_SYNC_INSERT_ROWS, 500000 / MAX(1, columns.count)));
+	fullInsertQuery = [self insertQueryForRows:_insertRows];
+	_presidentColumns = [tableClass localColumnsTakesSyncingPresident];
+	return self;
+}
+
+- (NSString*) insertQueryForRows:(NSUInteger)rows
+{
+	NSString *columnString = [_insertColumns componentsJoinedByString:@","];
+	return [NSString stringWithFormat:@"INSERT OR REPLACE INTO %@ (%@) VALUES %@", _className, columnString, [AutoModel questionMarksForQueriesWithObjects:rows columns:_insertColumns.count]];
+}
+
+///Values as they are stored, dates are timestamps.
+- (id) databaseValue:(id)value column:(NSString*)column
+{
+	if (!value)
+		return [NSNull null];
+	if (value != [NSNull null] && _columnSyntax[column].integerValue == AutoFieldTypeDate && ![value isKindOfClass:[NSNumber class]])
+		return @([value doubleValue]);
+	return value;
+}
+
+- (void) addInsertValues:(NSDictionary*)values to:(NSMutableArray*)arguments
+{
+	for (NSString* column in _insertColumns)
+	{
+		[arguments addObject:[self databaseValue:values[column] column:column]];
+	}
+}
+
+- (BOOL) insertValues:(NSArray*)values inDB:(AFMDatabase*)db
+{
+	NSUInteger columnCount = _insertColumns.count;
+	NSUInteger rowCount = columnCount ? values.count / columnCount : 0;
+	if (rowCount >= _insertRows)
+		[db cacheStatementForQuery:fullInsertQuery];
+	
+	//only the last statement is shorter than the rest.
+	for (NSUInteger row = 0; row < rowCount; row += _insertRows)
+	{
+		NSUInteger rows = MIN(_insertRows, rowCount - row);
+		NSString *query = rows == _insertRows ? fullInsertQuery : [self insertQueryForRows:rows];
+		NSArray *arguments = [values subarrayWithRange:NSMakeRange(row * columnCount, rows * columnCount)];
+		if (![db executeUpdate:query withArgumentsInArray:arguments])
+		{
+			NSLog(@"could not create %@ objects! Sync will fail forever! %@", _className, [db lastError]);
+			return NO;
+		}
+	}
+	return YES;
+}
+
+- (BOOL) updateRows:(NSDictionary <NSNumber*, NSDictionary*>*)rows markCreated:(BOOL)markCreated inDB:(AFMDatabase*)db
+{
+	__block BOOL success = YES;
+	[rows enumerateKeysAndObjectsUsingBlock:^(NSNumber * _Nonnull idValue, NSDictionary * _Nonnull values, BOOL * _Nonnull stop) {
+		
+		NSMutableArray <NSString*>*columns = [[NSMutableArray alloc] initWithCapacity:values.count];
+		for (NSString *column in values)
+		{
+			if (self->_columnSyntax[column] == nil)
+				NSLog(@"error, trying to set a column that don't exist: %@ value: %@", column, values[column]);
+			else if (![column isEqualToString:@"id"])
+				[columns addObject:column];
+		}
+		if (columns.count == 0 && !markCreated)
+			return;
+		
+		//sorted so the same columns always give the same statement.
+		[columns sortUsingSelector:@selector(compare:)];
+		NSMutableArray *arguments = [[NSMutableArray alloc] initWithCapacity:columns.count + 1];
+		NSMutableArray *assignments = [[NSMutableArray alloc] initWithCapacity:columns.count + 1];
+		for (NSString *column in columns)
+		{
+			[assignments addObject:[column stringByAppendingString:@" = ?"]];
+			[arguments addObject:[self databaseValue:values[column] column:column]];
+		}
+		if (markCreated)
+			[assignments addObject:@"sync_state = 0"];
+		[arguments addObject:idValue];
+		
+		NSString *query = [NSString stringWithFormat:@"UPDATE %@ SET %@ WHERE id = ?", self->_className, [assignments componentsJoinedByString:@", "]];
+		[db cacheStatementForQuery:query];
+		if (![db executeUpdate:query withArgumentsInArray:arguments])
+		{
+			NSLog(@"could not update %@ objects! %@", self->_className, [db lastError]);
+			success = NO;
+			*stop = YES;
+		}
+	}];
+	return success;
+}
+
+- (void) patchObject:(AutoSync*)object values:(NSDictionary*)values
+{
+	for (NSString *column in values)
+	{
+		NSNumber *syntax = _columnSyntax[column];
+		if (!syntax)
+			continue;
+		id value = values[column];
+		if (value == [NSNull null])
+			[object setPrimitiveValue:nil forKey:column];
+		else if (syntax.integerValue == AutoFieldTypeDate)
+			[object setPrimitiveValue:[NSDate dateWithTimeIntervalSince1970:[value doubleValue]] forKey:column];
+		else
+			[object setPrimitiveValue:value forKey:column];
+	}
+}
+
+@end
+
+//Created rows are read this many ids per statement, so every full batch reuses one prepared statement.
+#define AUTO_SYNC_CREATE_IDS 100
+
+///How created rows of one class are read and translated into sync-format. The AutoSyncTranslate of the class is compiled into a server key per column, so each row goes from the statement straight into its sync-format in one pass.
+@interface AutoSyncEncodePlan : NSObject
+
+@property (nonatomic, readonly) NSString *className;
+///Selects the rows of AUTO_SYNC_CREATE_IDS ids that are not deleted, only the columns that are sent.
+@property (nonatomic, readonly) NSString *query;
+///NO when the class translates its rows with its own syncDataToServer:, those rows are read as dictionaries and handed to it.
+@property (nonatomic, readonly) BOOL compiled;
+///Packed columns are a nested dictionary instead of a JSON string, see AutoSyncPayloadCodec.encodesNestedValues.
+@property (nonatomic, readonly) BOOL nested;
+
+- (instancetype) initWithClass:(Class)tableClass className:(NSString*)className nested:(BOOL)nested;
+///Read the rows of these ids and translate them, rowBlock gets each row in statement order. Deleted rows and rows syncDataToServer: drops are left out.
+- (void) encodeIds:(NSArray <NSNumber*>*)ids inDB:(AFMDatabase*)db rowBlock:(void (^)(NSNumber *idValue, NSDictionary *row))rowBlock;
+
+@end
+
+///Append UTF-8 text as a JSON string.
+static void appendJSONString(NSMutableData *data, const unsigned char *bytes, int length)
+{
+	static const char hex[] = "0123456789abcdef";
+	[data appendBytes:"\"" length:1];
+	int start = 0;
+	for (int index = 0; index < length; index++)
+	{
+		unsigned char byte = bytes[index];
+		if (byte >= 0x20 && byte != '"' && byte != '\\')
+			continue;
+		[data appendBytes:bytes + start length:index - start];
+		if (byte == '"' || byte == '\\')
+		{
+			char escaped[2] = { '\\', (char)byte };
+			[data appendBytes:escaped length:2];
+		}
+		else
+		{
+			char escaped[6] = { '\\', 'u', '0', '0', hex[byte >> 4], hex[byte & 0xF] };
+			[data appendBytes:escaped length:6];
+		}
+		start = index + 1;
+	}
+	[data appendBytes:bytes + start length:length - start];
+	[data appendBytes:"\"" length:1];
+}
+
+@implementation AutoSyncEncodePlan
+{
+	Class tableClass;
+	NSArray <NSString*>*columns;
+	//per column: its server key, or NSNull if it is packed into singleJSONKey.
+	NSArray *serverKeys;
+	//per packed column its JSON key with colon, e.g. "title":
+	NSArray <NSData*>*packedKeys;
+	NSString *singleJSONKey;
+	NSUInteger idIndex;
+}
+
+- (instancetype) initWithClass:(Class)classObject className:(NSString*)className nested:(BOOL)nested
+{
+	self = [super init];
+	_className = className;
+	_nested = nested;
+	tableClass = classObject;
+	NSMutableArray *syncColumns = [[AutoDB sharedInstance] columnNamesForClass:tableClass].mutableCopy;
+	NSSet *preventColumns = [tableClass preventSyncColumns];
+	if (preventColumns)
+	{
+		[syncColumns removeObjectsInArray:preventColumns.allObjects];
+	}
+
+	//only the default syncDataToServer: can be compiled, it does nothing but follow the translation.
+	AutoSyncTranslate *translate = [tableClass syncTranslate];
+	_compiled = translate && [tableClass methodForSelector:@selector(syncDataToServer:)] == [AutoSync methodForSelector:@selector(syncDataToServer:)];
+	if (_compiled)
+	{
+		//without a singleJSONKey only translated columns are sent, like syncDataToServer: does.
+		singleJSONKey = translate.singleJSONKey;
+		NSMutableArray <NSString*>*sentColumns = [NSMutableArray new];
+		NSMutableArray *keys = [NSMutableArray new];
+		NSMutableArray <NSData*>*jsonKeys = [NSMutableArray new];
+		for (NSString *column in syncColumns)
+		{
+			NSString *serverKey = [column isEqualToString:@"id"] ? column : translate.clientToServer[column];
+			if (!serverKey && !singleJSONKey)
+				continue;	//without a JSON to pack it into, the column is not sent.
+
+			[sentColumns addObject:column];
+			[keys addObject:serverKey ?: [NSNull null]];
+			NSMutableData *jsonKey = [NSMutableData new];
+			NSData *name = [column dataUsingEncoding:NSUTF8StringEncoding];
+			appendJSONString(jsonKey, name.bytes, (int)name.length);
+			[jsonKey appendBytes:":" length:1];
+			[jsonKeys addObject:jsonKey];
+		}
+		syncColumns = sentColumns;
+		serverKeys = keys;
+		packedKeys = jsonKeys;
+	}
+	columns = syncColumns;
+	idIndex = [columns indexOfObject:@"id"];
+	_query = [NSString stringWithFormat:@"SELECT %@ FROM %@ WHERE id IN (%@) AND is_deleted = 0", [columns componentsJoinedByString:@","], className, [AutoModel questionMarks:AUTO_SYNC_CREATE_IDS]];
+	return self;
+}
+
+- (void) encodeIds:(NSArray <NSNumber*>*)ids inDB:(AFMDatabase*)db rowBlock:(void (^)(NSNumber *idValue, NSDictionary *row))rowBlock
+{
+	if (idIndex == NSNotFound)
+	{
+		NSLog(@"%@ has no id column to sync", _className);
+		return;
+	}
+	[db cacheStatementForQuery:_query];
+	NSMutableArray *arguments = [[NSMutableArray alloc] initWithCapacity:AUTO_SYNC_CREATE_IDS];
+	NSMutableData *buffer = [NSMutableData new];
+	for (NSUInteger index = 0; index < ids.count; index += AUTO_SYNC_CREATE_IDS)
+	{
+		[arguments setArray:[ids subarrayWithRange:NSMakeRange(index, MIN(AUTO_SYNC_CREATE_IDS, ids.count - index))]];
+		//the last chunk repeats its last id, which matches the same row.
+		while (arguments.count < AUTO_SYNC_CREATE_IDS)
+			[arguments addObject:arguments.lastObject];
+
+		AFMResultSet *resultSet = [db executeQuery:_query withArgumentsInArray:arguments];
+		while ([resultSet next])
+		{
+			@autoreleasepool
+			{
+				NSNumber *idValue = resultSet[(int)idIndex];
+				NSDictionary *row = nil;
+				if (_compiled)
+					row = [self rowFromResultSet:resultSet buffer:buffer];
+				if (!row)
+					row = [tableClass syncDataToServer:[resultSet.resultDictionary mutableCopy]];
+				if (row && idValue)
+					rowBlock(idValue, row);
+			}
+		}
+		[resultSet close];
+	}
+}
+
+///The current row in sync-format. Packed columns are written as JSON straight from the statement into buffer. Returns nil if they can't be JSON (blobs, infinite numbers), those rows take the regular syncDataToServer: route.
+- (nullable NSDictionary*) rowFromResultSet:(AFMResultSet*)resultSet buffer:(NSMutableData*)buffer
+{
+	sqlite3_stmt *statement = resultSet.statement.statement;
+	NSMutableDictionary *row = [[NSMutableDictionary alloc] initWithCapacity:serverKeys.count];
+	NSMutableDictionary *packed = _nested && singleJSONKey ? [NSMutableDictionary new] : nil;
+	buffer.length = 0;
+	[buffer appendBytes:"{" length:1];
+	BOOL first = YES;
+	char number[32];
+	int columnCount = (int)columns.count;
+	for (int index = 0; index < columnCount; index++)
+	{
+		//null columns are left out, just like resultDictionary does.
+		int type = sqlite3_column_type(statement, index);
+		if (type == SQLITE_NULL)
+			continue;
+		NSString *serverKey = serverKeys[index];
+		if (serverKey != (id)[NSNull null])
+		{
+			row[serverKey] = [resultSet objectForColumnIndex:index];
+			continue;
+		}
+		if (packed)
+		{
+			packed[columns[index]] = [resultSet objectForColumnIndex:index];
+			continue;
+		}
+
+		if (!first)
+			[buffer appendBytes:"," length:1];
+		first = NO;
+		[buffer appendData:packedKeys[index]];
+		if (type == SQLITE_INTEGER)
+		{
+			int length = snprintf(number, sizeof(number), "%lld", sqlite3_column_int64(statement, index));
+			[buffer appendBytes:number length:length];
+		}
+		else if (type == SQLITE_FLOAT)
+		{
+			double value = sqlite3_column_double(statement, index);
+			if (!isfinite(value))
+				return nil;
+			int length = snprintf(number, sizeof(number), "%.17g", value);
+			[buffer appendBytes:number length:length];
+		}
+		else if (type == SQLITE_TEXT)
+		{
+			appendJSONString(buffer, sqlite3_column_text(statement, index), sqlite3_column_bytes(statement, index));
+		}
+		else
+		{
+			return nil;
+		}
+	}
+
+	if (packed)
+	{
+		row[singleJSONKey] = packed;
+	}
+	else if (singleJSONKey)
+	{
+		[buffer appendBytes:"}" length:1];
+		NSString *json = [[NSString alloc] initWithBytes:buffer.bytes length:buffer.length encoding:NSUTF8StringEncoding];
+		if (!json)
+			return nil;
+		row[singleJSONKey] = json;
+	}
+	return row;
+}
+
+@end
+
+///Reads the reply object one top-level section at a time, so only one table of a large reply is parsed and in memory at once.
+@interface AutoSyncReplyReader : NSObject
+
+@property (nonatomic, readonly, nullable) NSError *error;
+
+- (instancetype) initWithStream:(NSInputStream*)stream;
+///For replies that are already parsed, each section is released when it has been read.
+- (instancetype) initWithDictionary:(NSDictionary*)reply;
+///Read the next key and its parsed value, NO when the reply is done or on error.
+- (BOOL) nextKey:(NSString * _Nullable __autoreleasing * _Nonnull)key value:(id _Nullable __autoreleasing * _Nonnull)value;
+
+@end
+
+@implementation AutoSyncReplyReader
+{
+	NSInputStream *stream;
+	NSMutableData *buffer;
+	NSUInteger position;
+	BOOL started, finished;
+	
+	NSMutableDictionary *sections;
+	NSEnumerator *keyEnumerator;
+}
+
+- (instancetype) initWithStream:(NSInputStream*)inputStream
+{
+	self = [super init];
+	stream = inputStream;
+	buffer = [NSMutableData new];
+	return self;
+}
+
+- (instancetype) initWithDictionary:(NSDictionary*)reply
+{
+	self = [super init];
+	sections = [reply isKindOfClass:[NSMutableDictionary class]] ? (NSMutableDictionary*)reply : reply.mutableCopy;
+	keyEnumerator = [sections.allKeys objectEnumerator];
+	return self;
+}
+
+- (BOOL) nextKey:(NSString * _Nullable __autoreleasing * _Nonnull)key value:(id _Nullable __autoreleasing * _Nonnull)value
+{
+	if (sections)
+	{
+		NSString *nextKey = keyEnumerator.nextObject;
+		if (!nextKey)
+			return NO;
+		*key = nextKey;
+		*value = sections[nextKey];
+		[sections removeObjectForKey:nextKey];
+		return YES;
+	}
+	if (finished || _error)
+		return NO;
+	if (!started)
+	{
+		started = YES;
+		if (stream.streamStatus == NSStreamStatusNotOpen)
+			[stream open];
+		if (![self skipWhitespace] || [self byteAt:position] != '{')
+			return [self failWithReason:@"Sync reply is not an object"];
+		position++;
+	}
+	if (![self skipWhitespace])
+		return [self failWithReason:@"Sync reply ended too soon"];
+	uint8_t byte = [self byteAt:position];
+	if (byte == '}')
+	{
+		finished = YES;
+		[stream close];
+		return NO;
+	}
+	if (byte == ',')
+	{
+		position++;
+		if (![self skipWhitespace])
+			return [self failWithReason:@"Sync reply ended too soon"];
+	}
+	
+	NSUInteger end = [self endOfValueFrom:position];
+	id parsedKey = end == NSNotFound ? nil : [self parseFrom:position to:end];
+	if (![parsedKey isKindOfClass:[NSString class]])
+		return [self failWithReason:@"Sync reply has a broken key"];
+	position = end;
+	if (![self skipWhitespace] || [self byteAt:position] != ':')
+		return [self failWithReason:@"Sync reply has a key without value"];
+	position++;
+	if (![self skipWhitespace])
+		return [self failWithReason:@"Sync reply ended too soon"];
+	end = [self endOfValueFrom:position];
+	id parsedValue = end == NSNotFound ? nil : [self parseFrom:position to:end];
+	if (!parsedValue)
+		return [self failWithReason:[NSString stringWithFormat:@"Sync reply has a broken value for %@", parsedKey]];
+	position = end;
+	
+	//drop what we have read, the buffer only holds the current section.
+	[buffer replaceBytesInRange:NSMakeRange(0, position) withBytes:NULL length:0];
+	position = 0;
+	*key = parsedKey;
+	*value = parsedValue;
+	return YES;
+}
+
+- (BOOL) failWithReason:(NSString*)reason
+{
+	NSLog(@"%@", reason);
+	_error = stream.streamError ?: [ADBackgroundDownload createErrorWithCode:AutoErrorCodeClientError defaultString:reason additionalInfo:nil];
+	[stream close];
+	return NO;
+}
+
+///Make sure the buffer holds the byte at index, reading more of the stream if needed.
+- (BOOL) hasByteAt:(NSUInteger)index
+{
+	uint8_t chunk[AUTO_SYNC_READ_CHUNK];
+	while (index >= buffer.length)
+	{
+		NSInteger read = [stream read:chunk maxLength:AUTO_SYNC_READ_CHUNK];
+		if (read <= 0)
+			return NO;
+		[buffer appendBytes:chunk length:read];
+	}
+	return YES;
+}
+
+- (uint8_t) byteAt:(NSUInteger)index
+{
+	return ((const uint8_t*)buffer.bytes)[index];
+}
+
+- (BOOL) skipWhitespace
+{
+	while ([self hasByteAt:position])
+	{
+		uint8_t byte = [self byteAt:position];
+		if (byte != ' ' && byte != '\n' && byte != '\r' && byte != '\t')
+			return YES;
+		position++;
+	}
+	return NO;
+}
+
+///Find where the JSON value starting at start ends, without parsing it.
+- (NSUInteger) endOfValueFrom:(NSUInteger)start
+{
+	NSInteger depth = 0;
+	BOOL inString = NO;
+	const uint8_t *bytes = buffer.bytes;
+	NSUInteger length = buffer.length;
+	for (NSUInteger index = start; ; index++)
+	{
+		if (index >= length)
+		{
+			if (![self hasByteAt:index])
+				return NSNotFound;
+			bytes = buffer.bytes;
+			length = buffer.length;
+		}
+		uint8_t byte = bytes[index];
+		if (inString)
+		{
+			if (byte == '\\')
+				index++;
+			else if (byte == '"')
+			{
+				inString = NO;
+				if (depth == 0)
+					return index + 1;
+			}
+		}
+		else if (byte == '"')
+			inString = YES;
+		else if (byte == '{' || byte == '[')
+			depth++;
+		else if (byte == '}' || byte == ']')
+		{
+			if (depth == 0)
+				return index;	//a number or literal that ends with the enclosing object
+			depth--;
+			if (depth == 0)
+				return index + 1;
+		}
+		else if (depth == 0 && (byte == ',' || byte == ':' || byte == ' ' || byte == '\n' || byte == '\r' || byte == '\t'))
+			return index;
+	}
+}
+
+- (nullable id) parseFrom:(NSUInteger)start to:(NSUInteger)end
+{
+	NSData *slice = [NSData dataWithBytesNoCopy:(void*)((const uint8_t*)buffer.bytes + start) length:end - start freeWhenDone:NO];
+	return [NSJSONSerialization JSONObjectWithData:slice options:NSJSONReadingMutableContainers | NSJSONReadingAllowFragments error:nil];
+}
+
+@end
+
+typedef NS_ENUM(uint8_t, AutoSyncBinaryType)
+{
+	AutoSyncBinaryTypeNull,
+	AutoSyncBinaryTypeFalse,
+	AutoSyncBinaryTypeTrue,
+	AutoSyncBinaryTypeInteger,
+	AutoSyncBinaryTypeDouble,
+	AutoSyncBinaryTypeString,
+	AutoSyncBinaryTypeData,
+	AutoSyncBinaryTypeArray,
+	AutoSyncBinaryTypeMap,
+	AutoSyncBinaryTypeTable,
+	AutoSyncBinaryTypeMissing,	//a row in a table without this column
+};
+//Every body starts with these bytes, the last one is the version.
+static const uint8_t AutoSyncBinaryMagic[4] = { 'A', 'S', 'B', 1 };
+//Decoded in place of table values that are missing, never returned.
+static NSObject *AutoSyncBinaryMissingValue;
+
+@implementation AutoSyncBinaryCodec
+
++ (void) initialize
+{
+	if (self == [AutoSyncBinaryCodec class])
+		AutoSyncBinaryMissingValue = [NSObject new];
+}
+
+- (instancetype) init
+{
+	self = [super init];
+	_compressionLevel = Z_DEFAULT_COMPRESSION;
+	return self;
+}
+
+- (NSString *)contentType
+{
+	return @"application/x-autosync-binary";
+}
+
+- (NSString *)contentEncoding
+{
+	return _compressionLevel == 0 ? nil : @"deflate";
+}
+
+- (BOOL)encodesNestedValues
+{
+	return YES;
+}
+
+- (nullable NSData*) encodePayload:(NSDictionary*)payload error:(NSError**)error
+{
+	NSMutableData *body = [NSMutableData dataWithBytes:AutoSyncBinaryMagic length:sizeof(AutoSyncBinaryMagic)];
+	if (![self encodeValue:payload into:body])
+	{
+		if (error) *error = [ADBackgroundDownload createErrorWithCode:AutoErrorCodeClientError defaultString:@"Sync payload has values that cannot be encoded" additionalInfo:nil];
+		return nil;
+	}
+	if (_compressionLevel == 0)
+		return body;
+	NSData *compressed = [AutoSyncBinaryCodec deflate:body level:_compressionLevel];
+	if (!compressed && error)
+		*error = [ADBackgroundDownload createErrorWithCode:AutoErrorCodeClientError defaultString:@"Could not compress sync payload" additionalInfo:nil];
+	return compressed;
+}
+
+- (nullable id) decodePayload:(NSData*)data error:(NSError**)error
+{
+	NSData *body = data;
+	if (_compressionLevel != 0)
+		body = [AutoSyncBinaryCodec inflate:data];
+	const uint8_t *bytes = body.bytes;
+	NSUInteger position = sizeof(AutoSyncBinaryMagic);
+	id result = nil;
+	if (body.length >= position && memcmp(bytes, AutoSyncBinaryMagic, position) == 0)
+		result = [self decodeValueFrom:bytes length:body.length position:&position];
+	if (!result && error)
+		*error = [ADBackgroundDownload createErrorWithCode:AutoErrorCodeClientError defaultString:@"Broken sync payload" additionalInfo:nil];
+	return result;
+}
+
+#pragma mark - encoding
+
+static inline void appendVarint(NSMutableData *data, uint64_t value)
+{
+	uint8_t bytes[10];
+	NSUInteger length = 0;
+	do
+	{
+		uint8_t byte = value & 0x7F;
+		value >>= 7;
+		bytes[length++] = value ? byte | 0x80 : byte;
+	} while (value);
+	[data appendBytes:bytes length:length];
+}
+
+static inline void appendType(NSMutableData *data, AutoSyncBinaryType type)
+{
+	[data appendBytes:&type length:1];
+}
+
+- (void) encodeString:(NSString*)string into:(NSMutableData*)data
+{
+	NSUInteger length = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+	appendVarint(data, length);
+	NSUInteger start = data.length;
+	[data increaseLengthBy:length];
+	[string getBytes:(uint8_t*)data.mutableBytes + start maxLength:length usedLength:NULL encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, string.length) remainingRange:NULL];
+}
+
+- (BOOL) encodeValue:(id)value into:(NSMutableData*)data
+{
+	if (!value || value == [NSNull null])
+	{
+		appendType(data, AutoSyncBinaryTypeNull);
+	}
+	else if ([value isKindOfClass:[NSNumber class]])
+	{
+		NSNumber *number = value;
+		if (CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID())
+		{
+			appendType(data, number.boolValue ? AutoSyncBinaryTypeTrue : AutoSyncBinaryTypeFalse);
+		}
+		else if (CFNumberIsFloatType((__bridge CFNumberRef)number))
+		{
+			appendType(data, AutoSyncBinaryTypeDouble);
+			CFSwappedFloat64 swapped = CFConvertDoubleHostToSwapped(number.doubleValue);
+			[data appendBytes:&swapped length:sizeof(swapped)];
+		}
+		else
+		{
+			appendType(data, AutoSyncBinaryTypeInteger);
+			int64_t integer = number.longLongValue;
+			appendVarint(data, ((uint64_t)integer << 1) ^ (uint64_t)(integer >> 63));
+		}
+	}
+	else if ([value isKindOfClass:[NSString class]])
+	{
+		appendType(data, AutoSyncBinaryTypeString);
+		[self encodeString:value into:data];
+	}
+	else if ([value isKindOfClass:[NSData class]])
+	{
+		appendType(data, AutoSyncBinaryTypeData);
+		appendVarint(data, ((NSData*)value).length);
+		[data appendData:value];
+	}
+	else if ([value isKindOfClass:[NSDate class]])
+	{
+		return [self encodeValue:@(((NSDate*)value).timeIntervalSince1970) into:data];
+	}
+	else if ([value isKindOfClass:[NSDictionary class]])
+	{
+		NSDictionary *map = value;
+		appendType(data, AutoSyncBinaryTypeMap);
+		appendVarint(data, map.count);
+		for (id key in map)
+		{
+			[self encodeString:[key isKindOfClass:[NSString class]] ? key : [key description] into:data];
+			if (![self encodeValue:map[key] into:data])
+				return NO;
+		}
+	}
+	else if ([value isKindOfClass:[NSArray class]])
+	{
+		NSArray *array = value;
+		NSMutableOrderedSet *columns = array.count ? [NSMutableOrderedSet new] : nil;
+		for (id row in array)
+		{
+			if (![row isKindOfClass:[NSDictionary class]])
+			{
+				columns = nil;
+				break;
+			}
+			[columns addObjectsFromArray:((NSDictionary*)row).allKeys];
+		}
+		if (columns)
+		{
+			//rows, send the column names once
+			appendType(data, AutoSyncBinaryTypeTable);
+			appendVarint(data, columns.count);
+			for (id column in columns)
+			{
+				[self encodeString:[column isKindOfClass:[NSString class]] ? column : [column description] into:data];
+			}
+			appendVarint(data, array.count);
+			for (NSDictionary *row in array)
+			{
+				for (id column in columns)
+				{
+					id columnValue = row[column];
+					if (!columnValue)
+						appendType(data, AutoSyncBinaryTypeMissing);
+					else if (![self encodeValue:columnValue into:data])
+						return NO;
+				}
+			}
+		}
+		else
+		{
+			appendType(data, AutoSyncBinaryTypeArray);
+			appendVarint(data, array.count);
+			for (id item in array)
+			{
+				if (![self encodeValue:item into:data])
+					return NO;
+			}
+		}
+	}
+	else
+	{
+		NSLog(@"Cannot encode %@ for sync", [value class]);
+		return NO;
+	}
+	return YES;
+}
+
+#pragma mark - decoding
+
+static inline BOOL readVarint(const uint8_t *bytes, NSUInteger length, NSUInteger *position, uint64_t *value)
+{
+	uint64_t result = 0;
+	for (NSUInteger shift = 0; shift < 64 && *position < length; shift += 7)
+	{
+		uint8_t byte = bytes[(*position)++];
+		result |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			*value = result;
+			return YES;
+		}
+	}
+	return NO;
+}
+
+- (nullable NSString*) decodeStringFrom:(const uint8_t*)bytes length:(NSUInteger)length position:(NSUInteger*)position
+{
+	uint64_t stringLength;
+	if (!readVarint(bytes, length, position, &stringLength) || stringLength > length - *position)
+		return nil;
+	NSString *string = [[NSString alloc] initWithBytes:bytes + *position length:(NSUInteger)stringLength encoding:NSUTF8StringEncoding];
+	*position += stringLength;
+	return string;
+}
+
+///Returns nil when broken, and the private marker for missing table values.
+- (nullable id) decodeValueFrom:(const uint8_t*)bytes length:(NSUInteger)length position:(NSUInteger*)position
+{
+	if (*position >= length)
+		return nil;
+	AutoSyncBinaryType type = bytes[(*position)++];
+	uint64_t count;
+	switch (type)
+	{
+		case AutoSyncBinaryTypeNull:
+			return [NSNull null];
+		case AutoSyncBinaryTypeFalse:
+			return @NO;
+		case AutoSyncBinaryTypeTrue:
+			return @YES;
+		case AutoSyncBinaryTypeMissing:
+			return AutoSyncBinaryMissingValue;
+		case AutoSyncBinaryTypeInteger:
+		{
+			if (!readVarint(bytes, length, position, &count))
+				return nil;
+			return @((int64_t)(count >> 1) ^ -(int64_t)(count & 1));
+		}
+		case AutoSyncBinaryTypeDouble:
+		{
+			CFSwappedFloat64 swapped;
+			if (length - *position < sizeof(swapped))
+				return nil;
+			memcpy(&swapped, bytes + *position, sizeof(swapped));
+			*position += sizeof(swapped);
+			return @(CFConvertDoubleSwappedToHost(swapped));
+		}
+		case AutoSyncBinaryTypeString:
+			return [self decodeStringFrom:bytes length:length position:position];
+		case AutoSyncBinaryTypeData:
+		{
+			if (!readVarint(bytes, length, position, &count) || count > length - *position)
+				return nil;
+			NSData *data = [NSData dataWithBytes:bytes + *position length:(NSUInteger)count];
+			*position += count;
+			return data;
+		}
+		case AutoSyncBinaryTypeArray:
+		{
+			if (!readVarint(bytes, length, position, &count) || count > length - *position)
+				return nil;
+			NSMutableArray *array = [[NSMutableArray alloc] initWithCapacity:(NSUInteger)count];
+			for (uint64_t index = 0; index < count; index++)
+			{
+				id item = [self decodeValueFrom:bytes length:length position:position];
+				if (!item || item == AutoSyncBinaryMissingValue)
+					return nil;
+				[array addObject:item];
+			}
+			return array;
+		}
+		case AutoSyncBinaryTypeMap:
+		{
+			if (!readVarint(bytes, length, position, &count) || count > length - *position)
+				return nil;
+			NSMutableDictionary *map = [[NSMutableDictionary alloc] initWithCapacity:(NSUInteger)count];
+			for (uint64_t index = 0; index < count; index++)
+			{
+				NSString *key = [self decodeStringFrom:bytes length:length position:position];
+				id item = key ? [self decodeValueFrom:bytes length:length position:position] : nil;
+				if (!item || item == AutoSyncBinaryMissingValue)
+					return nil;
+				map[key] = item;
+			}
+			return map;
+		}
+		case AutoSyncBinaryTypeTable:
+		{
+			if (!readVarint(bytes, length, position, &count) || count > length - *position)
+				return nil;
+			NSMutableArray<NSString*> *columns = [[NSMutableArray alloc] initWithCapacity:(NSUInteger)count];
+			for (uint64_t index = 0; index < count; index++)
+			{
+				NSString *column = [self decodeStringFrom:bytes length:length position:position];
+				if (!column)
+					return nil;
+				[columns addObject:column];
+			}
+			uint64_t rowCount;
+			if (!readVarint(bytes, length, position, &rowCount) || rowCount > length - *position)
+				return nil;
+			NSMutableArray *rows = [[NSMutableArray alloc] initWithCapacity:(NSUInteger)rowCount];
+			for (uint64_t index = 0; index < rowCount; index++)
+			{
+				NSMutableDictionary *row = [[NSMutableDictionary alloc] initWithCapacity:columns.count];
+				for (NSString *column in columns)
+				{
+					id item = [self decodeValueFrom:bytes length:length position:position];
+					if (!item)
+						return nil;
+					if (item != AutoSyncBinaryMissingValue)
+						row[column] = item;
+				}
+				[rows addObject:row];
+			}
+			return rows;
+		}
+	}
+	return nil;
+}
+
+#pragma mark - compression
+
++ (nullable NSData*) deflate:(NSData*)data level:(int)level
+{
+	uLongf length = compressBound(data.length);
+	NSMutableData *result = [NSMutableData dataWithLength:length];
+	if (compress2(result.mutableBytes, &length, data.bytes, data.length, level) != Z_OK)
+		return nil;
+	result.length = length;
+	return result;
+}
+
++ (nullable NSData*) inflate:(NSData*)data
+{
+	z_stream stream = {0};
+	stream.next_in = (Bytef*)data.bytes;
+	stream.avail_in = (uInt)data.length;
+	if (inflateInit(&stream) != Z_OK)
+		return nil;
+	NSMutableData *result = [NSMutableData dataWithLength:data.length * 4 + 1024];
+	int status = Z_OK;
+	while (status == Z_OK)
+	{
+		if (stream.total_out >= result.length)
+			[result increaseLengthBy:result.length];
+		stream.next_out = (Bytef*)result.mutableBytes + stream.total_out;
+		stream.avail_out = (uInt)(result.length - stream.total_out);
+		status = inflate(&stream, Z_NO_FLUSH);
+	}
+	inflateEnd(&stream);
+	if (status != Z_STREAM_END)
+		return nil;
+	result.length = stream.total_out;
+	return result;
+}
+
+@end
 
 @implementation AutoSyncHandler
 {
@@ -37,6 +1023,25 @@
 	UIBackgroundTaskIdentifier backgroundSyncIdentifier;
 	NSMutableDictionary *serverClientTableMapping, *postDeleted, *postCreated, *postUpdated;
 	NSDate *autoSyncLastRequest;
+	
+	//what the batch in flight carries, to size the next one. batchMeasures is className -> @[approx bytes, rows]
+	NSDate *batchStart;
+	NSUInteger batchBytes;
+	NSMutableDictionary <NSString*, NSArray <NSNumber*>*> *batchMeasures;
+	
+	//the next batch is prepared while the current one is on the wire, rows the server changes meanwhile make it stale.
+	dispatch_group_t pipelineGroup;
+	AutoSyncBatch *preparedBatch;
+	NSMutableDictionary <NSString*, NSMutableSet <NSNumber*>*> *replyTouchedIds;
+	//reply sections of one group are applied in order on its queue: { className: queue }
+	NSMutableDictionary <NSString*, dispatch_queue_t> *groupQueues;
+	NSMutableDictionary <NSString*, AutoSyncApplyPlan*> *applyPlans;
+	NSMutableDictionary <NSString*, AutoSyncEncodePlan*> *encodePlans;
+	
+	//the last batch with rows that was sent, the server acknowledges how many rows of each table it stored. After a round trip without reply we ask before resending.
+	long long sentBatchId;
+	NSDictionary <NSString*, NSDictionary <NSNumber*, NSArray <NSNumber*>*>*> *sentIds;
+	BOOL resumeSentBatch;
 }
 
 #pragma mark - setting up
@@ -96,6 +1101,11 @@ static AutoSyncHandler *syncHandler = nil;
 	syncRecord = [AutoSyncRecord createInstanceWithId:1];
 	self.apiURL = [NSURL URLWithString:syncRecord.apiURL];
 	syncSemaphore = dispatch_semaphore_create(1);
+	pipelineGroup = dispatch_group_create();
+	replyTouchedIds = [NSMutableDictionary new];
+	applyPlans = [NSMutableDictionary new];
+	encodePlans = [NSMutableDictionary new];
+	_maxConcurrentGroups = AUTO_SYNC_CONCURRENT_GROUPS;
 	[self setupBackgroundDownloads];
 	
 	if (DEBUG)
@@ -117,13 +1127,35 @@ static AutoSyncHandler *syncHandler = nil;
 {
 	_syncClasses = syncClasses;
 	serverClientTableMapping = [NSMutableDictionary new];
+	groupQueues = [NSMutableDictionary new];
 	for (NSArray<NSString*> *group in syncClasses)
 	{
+		dispatch_queue_t groupQueue = dispatch_queue_create(NULL, DISPATCH_QUEUE_SERIAL);
 		for (NSString *className in group)
 		{
 			Class tableClass = NSClassFromString(className);
 			NSString *serverTableName = [tableClass serverTableName];
 			serverClientTableMapping[serverTableName] = className;
+			groupQueues[className] = groupQueue;
+		}
+	}
+	[self createTombstoneIndexes];
+}
+
+///Deleted rows are kept as tombstones (is_deleted) until the server knows, a partial index holds only those - so finding them never scans the table.
+- (void) createTombstoneIndexes
+{
+	for (NSArray<NSString*> *group in self.syncClasses)
+	{
+		for (NSString *className in group)
+		{
+			//one block per table, so other queries get in between when a large table is indexed the first time.
+			[NSClassFromString(className) executeInDatabase:^(FMDatabase *db)
+			{
+				NSString *query = [NSString stringWithFormat:@"CREATE INDEX IF NOT EXISTS %@_tombstones ON %@ (id) WHERE is_deleted", className, className];
+				if (![db executeUpdate:query])
+					NSLog(@"Could not create tombstone index for %@: %@", className, db.lastError);
+			}];
 		}
 	}
 }
@@ -175,21 +1207,27 @@ static AutoSyncHandler *syncHandler = nil;
 
 - (void) purgeDeleted
 {
-	NSString *deletedQuery = @"DELETE FROM %@ WHERE is_deleted";
 	for (NSArray<NSString*> *group in self.syncClasses)
 	{
-		Class syncClass = NSClassFromString(group.firstObject);
-		[syncClass executeInDatabase:^(FMDatabase *db)
+		for (NSString *className in group)
 		{
-			for (NSString *className in group)
-			{
-				[db executeUpdate:[NSString stringWithFormat:deletedQuery, className]];
-				//NSLog(@"deleted %@", @(db.changes));
-			}
-		}];
+			[self purgeDeletedInTable:className];
+		}
 	}
 }
 
+///Delete tombstones in the background one batch at a time, each batch is its own block at the end of the file's queue.
+- (void) purgeDeletedInTable:(NSString*)className
+{
+	//the subquery uses the tombstone index, the same "WHERE is_deleted" as the index.
+	NSString *query = [NSString stringWithFormat:@"DELETE FROM %@ WHERE id IN (SELECT id FROM %@ WHERE is_deleted LIMIT %i)", className, className, AUTO_SYNC_PURGE_BATCH];
+	[NSClassFromString(className) executeInDatabase:^(FMDatabase *db)
+	{
+		if ([db executeUpdate:query] && db.changes >= AUTO_SYNC_PURGE_BATCH)
+			[self purgeDeletedInTable:className];
+	}];
+}
+
 - (BOOL)isInitSyncing
 {
 	return syncRecord.syncOptions & SyncOptionsInitSync;
@@ -376,6 +1414,8 @@ static NSString* downloadKey = @"AutoSyncTask";
 		[self initialSyncSetupComplete];
 	}
 	resyncCount = 0;
+	dispatch_group_wait(pipelineGroup, DISPATCH_TIME_FOREVER);
+	preparedBatch = nil;
 	[AutoModel saveAllWithChanges:nil];
 	NSDictionary *userInfo = @{ @"updated" : postUpdated.copy, @"created": postCreated.copy, @"deleted": postDeleted.copy };
 	[postUpdated removeAllObjects];
@@ -524,16 +1564,7 @@ static NSString* downloadKey = @"AutoSyncTask";
 	[AutoModel saveAllWithChanges:nil];
 	
 	//when all is done, delete previously deleted rows.
-	for (NSArray<NSString*> *group in self.syncClasses)
-	{
-		[NSClassFromString(group.firstObject) inDatabase:^(FMDatabase * _Nonnull db) {
-			for (NSString *className in group)
-			{
-				NSString *query = [NSString stringWithFormat:@"DELETE FROM %@ WHERE is_deleted", className];
-				[db executeUpdate:query];
-			}
-		}];
-	}
+	[self purgeDeleted];
 }
 
 //called from main sync when starting. What do we want here?
@@ -564,6 +1595,7 @@ static NSString* downloadKey = @"AutoSyncTask";
 	"autoSync":
 	{
 		"id": self.change_id,
+		"batch": last seq of the batch when it has creates or updates, "resume": 1 when only asking how much of that batch the server stored
 	SYNC_TYPE_DELETE: { table_name : [1,2,3,4] }, { other_table_name : [1,2,3,4] },
 	SYNC_TYPE_CREATE:
 		{
@@ -578,131 +1610,330 @@ static NSString* downloadKey = @"AutoSyncTask";
 	}
 	if only id is supplied, we have a regular sync
 	*/
-	NSMutableDictionary *deleteTables = [NSMutableDictionary new];
-	NSMutableDictionary *createTables = [NSMutableDictionary new];
-	NSMutableDictionary <NSString*, NSDictionary <NSNumber*, NSMutableDictionary*>*> *updateTables = [NSMutableDictionary new];
+	if (resumeSentBatch)
+	{
+		resumeSentBatch = NO;
+		[self sendResumeRequest];
+		return;
+	}
 	
-	//it takes too much time and effort to measure the sizes of everything, let's start by just asuming we wont be syncing the complete work of shakespeare and just limit ourselves to 10 000 objects or so. If the assumption is wrong, e.g. each object is a video - those special cases need handling of their own.
+	//deletes are read when sending, rows deleted since the batch was prepared must not be sent as creates or updates.
+	NSMutableDictionary <NSString*, NSArray*> *deleteTables = [self deletedTables];
+	AutoSyncBatch *batch = [self takePreparedBatch:deleteTables];
+	if (!batch)
+	{
+		AutoSyncLogBatch *logBatch = [AutoSyncLogBatch new];
+		logBatch.createdTableIds = syncRecord.startCreateSync;
+		logBatch.updatedTableIds = syncRecord.startUpdateSync;
+		batch = [self buildBatch:logBatch deleteTables:deleteTables];
+	}
 	
-	NSMutableDictionary<NSString*, NSMutableArray<NSNumber*> *> *createdTableIds = syncRecord.startCreateSync;
-	NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSMutableSet*> *> *updatedTableIds = syncRecord.startUpdateSync;
+	//the batch keeps its id while it is resent, so the server can tell how far it got.
+	NSMutableDictionary *actions = batch.actions;
+	batch.batchId = syncRecord.syncingSeq;
+	if (batch.sentIds.count && batch.batchId)
+	{
+		actions[@"batch"] = @(batch.batchId);
+		sentBatchId = batch.batchId;
+		sentIds = batch.sentIds;
+	}
+	else
+	{
+		sentBatchId = 0;
+		sentIds = nil;
+	}
+	if (deleteTables.count)
+	{
+		actions[[@(SyncTypeDelete) stringValue]] = deleteTables;
+		//We perform the delete when coming back from server, if fails we will calculate all of them again. If BG-download works, we will use this record and perform the delete.
+		syncRecord.deleteTables = deleteTables;
+	}
+	
+	if (initSync && DEBUG)
+	{
+		NSUInteger approxDataSize = 0;
+		for (NSArray <NSNumber*>* measure in batch.measures.allValues)
+			approxDataSize += measure[0].unsignedIntegerValue;
+		NSLog(@"approxDataSize became %@ mb", @(approxDataSize / (1024.0*1024)));
+	}
+	
+	//debug print actions
+	/*
+	NSArray *statuses = @[@"unknown", @"SyncTypeStatus", @"SyncTypeUpdate", @"SyncTypeDelete", @"SyncTypeCreate"];
+	for (NSString *action in actions)
+	{
+		NSInteger index = [action integerValue];
+		NSString *status = statuses[index];
+		NSLog(@"%@: %@", status, [[actions[action] allKeys] componentsJoinedByString:@", "]);
+	}
+	*/
+	batchMeasures = batch.measures;
+	//while this batch is on the wire, the next one is read and translated.
+	[self prepareNextBatch];
+	[self syncActions:actions syncState:SyncStateRegular];
+}
+
+///After a round trip without reply, ask the server how much of the last batch it stored. Its reply acknowledges those rows, and the rest is read from the log as a new batch.
+- (void) sendResumeRequest
+{
+	//the batch goes back to the log so completing this round trip doesn't acknowledge it, deletes are sent again with the next batch.
+	[syncRecord reimburseActions];
+	syncRecord.deleteTables = nil;
+	batchMeasures = nil;
+	NSMutableDictionary *actions = [NSMutableDictionary new];
+	actions[@"batch"] = @(sentBatchId);
+	actions[@"resume"] = @1;
+	[self syncActions:actions syncState:SyncStateRegular | SyncStateResendActions | SyncStateResume];
+}
+
+///The server tells how many rows of each table it stored from the last request of a batch, in request order: { "batch": id, server_table_name: { SyncType: count } }. Those are removed from the log, so only the rest is sent again.
+- (void) acknowledgeRows:(nullable NSDictionary*)ack
+{
+	if (![ack isKindOfClass:[NSDictionary class]] || sentBatchId == 0 || [ack[@"batch"] longLongValue] != sentBatchId)
+		return;
+	[ack enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull serverTable, NSDictionary * _Nonnull counts, BOOL * _Nonnull stop) {
+		
+		NSString *className = self->serverClientTableMapping[serverTable];
+		if (!className || ![counts isKindOfClass:[NSDictionary class]])
+			return;
+		for (NSNumber *type in @[@(SyncTypeCreate), @(SyncTypeUpdate)])
+		{
+			NSArray <NSNumber*>*ids = self->sentIds[className][type];
+			NSUInteger count = MIN([counts[type.stringValue] unsignedIntegerValue], ids.count);
+			if (count)
+				[self->syncRecord acknowledgeIds:[ids subarrayWithRange:NSMakeRange(0, count)] op:type.integerValue forClass:className throughSeq:self->sentBatchId];
+		}
+	}];
+}
+
+///Run the block for each sync group, at most maxConcurrentGroups at once. Each group is its own file with its own thread, so groups never wait for each other.
+- (void) forEachSyncGroup:(void (^)(NSArray<NSString*> *group))block
+{
+	NSArray<NSArray<NSString*> *> *groups = self.syncClasses;
+	size_t workers = MAX(1, MIN(self.maxConcurrentGroups, groups.count));
+	dispatch_apply(workers, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t worker)
+	{
+		for (NSUInteger index = worker; index < groups.count; index += workers)
+		{
+			block(groups[index]);
+		}
+	});
+}
+
+///Locally deleted ids waiting to be sent: { server_table_name: [1,2,3] }. Only reads the tombstone index, so it costs nothing when nothing is deleted.
+- (NSMutableDictionary <NSString*, NSArray*>*) deletedTables
+{
+	NSMutableDictionary <NSString*, NSArray*> *deleteTables = [NSMutableDictionary new];
+	NSString *deletedQuery = @"SELECT id FROM %@ WHERE is_deleted";
+	[self forEachSyncGroup:^(NSArray<NSString *> *group)
+	{
+		[NSClassFromString(group.firstObject) inDatabase:^(FMDatabase *db)
+		{
+			for (NSString *className in group)
+			{
+				Class tableClass = NSClassFromString(className);
+				NSMutableArray *deletedIds = [tableClass groupConcatQuery:[NSString stringWithFormat:deletedQuery, className] arguments:nil];
+				if (deletedIds.count)
+				{
+					@synchronized (deleteTables)
+					{
+						deleteTables[[tableClass serverTableName]] = deletedIds;
+					}
+				}
+			}
+		}];
+	}];
+	return deleteTables;
+}
+
+///Fetch the rows of a log batch and translate them into sync-format, leaving out deleted rows. Groups are read and translated concurrently, created rows in one pass over their statement.
+- (AutoSyncBatch*) buildBatch:(AutoSyncLogBatch*)logBatch deleteTables:(NSDictionary <NSString*, NSArray*>*)deleteTables
+{
+	AutoSyncBatch *batch = [AutoSyncBatch new];
+	batch.logBatch = logBatch;
+	batch.measures = [NSMutableDictionary new];
+	batch.ids = [NSMutableDictionary new];
+	batch.sentIds = [NSMutableDictionary new];
+	NSMutableDictionary *createActions = [NSMutableDictionary new];
+	NSMutableDictionary *updateActions = [NSMutableDictionary new];
 	
-	NSString *deletedQuery = @"SELECT id FROM %@ WHERE is_deleted";
-	for (NSArray<NSString*> *group in self.syncClasses)
+	[self forEachSyncGroup:^(NSArray<NSString *> *group)
 	{
-		Class syncClass = NSClassFromString(group.firstObject);
-		[syncClass inDatabase:^(FMDatabase *db)
+		NSMutableDictionary <NSString*, NSDictionary <NSNumber*, NSMutableDictionary*>*> *updateTables = [NSMutableDictionary new];
+		[NSClassFromString(group.firstObject) inDatabase:^(FMDatabase *db)
 		{
 			for (NSString *className in group)
 			{
 				Class tableClass = NSClassFromString(className);
-				
-				//we must loop through all classes to see if something is deleted.
-				NSMutableArray *createdIds = createdTableIds[className];
-				NSMutableDictionary<NSNumber*, NSMutableSet*> *updatedIds = updatedTableIds[className];
-				NSMutableArray *deletedIds = [tableClass groupConcatQuery:[NSString stringWithFormat:deletedQuery, className] arguments:nil];
+				NSMutableArray *createdIds = logBatch.createdTableIds[className];
+				NSMutableDictionary<NSNumber*, NSNumber*> *updatedIds = logBatch.updatedTableIds[className];
+				NSArray *deletedIds = deleteTables[[tableClass serverTableName]];
 				if (deletedIds.count)
 				{
-					deleteTables[[tableClass serverTableName]] = deletedIds;
 					[createdIds removeObjectsInArray:deletedIds];
 					[updatedIds removeObjectsForKeys:deletedIds];
 				}
 				
 				if (createdIds.count)
 				{
-					//Get a translated dictionary of all objects of this class - and remove columns not to be synced!
-					NSMutableArray *columns = [[AutoDB sharedInstance] columnNamesForClass:tableClass].mutableCopy;
-					NSSet *preventColumns = [tableClass preventSyncColumns];
-					if (preventColumns)
+					//rows are translated as they are read, the plan leaves out deleted items and columns not to be synced.
+					AutoSyncEncodePlan *plan = [self encodePlanForClass:tableClass className:className];
+					NSMutableArray *translatedRows = [[NSMutableArray alloc] initWithCapacity:createdIds.count];
+					NSMutableArray *sentIds = [[NSMutableArray alloc] initWithCapacity:createdIds.count];
+					__block NSUInteger tableSize = 0;
+					[plan encodeIds:createdIds inDB:db rowBlock:^(NSNumber *idValue, NSDictionary *row)
 					{
-						[columns removeObjectsInArray:preventColumns.allObjects];
+						[translatedRows addObject:row];
+						[sentIds addObject:idValue];
+						tableSize += [self approxSize:row];
+					}];
+					if (translatedRows.count)
+					{
+						@synchronized (batch)
+						{
+							createActions[[tableClass serverTableName]] = translatedRows;
+							[self addSentIds:sentIds type:SyncTypeCreate className:className batch:batch];
+							[self addMeasure:batch.measures className:className bytes:tableSize rows:translatedRows.count];
+						}
 					}
-					
-					//remember to not try to update/create deleted items!
-					NSString *query = [NSString stringWithFormat:@"SELECT %@ FROM %@ WHERE id IN (%@) AND is_deleted = 0", [columns componentsJoinedByString:@","], className, [tableClass questionMarks:createdIds.count]];
-					createTables[className] = [tableClass arrayQuery:query arguments:createdIds];
 				}
 				
 				//lastly do the updates
 				if (updatedIds.count)
 				{
-					//fetch the data for these columns of these objects!
-					updateTables[className] = [[AutoDB sharedInstance] valuesForColumns:updatedIds class:tableClass translateDates:NO];
+					//fetch the data for these columns of these objects, ids with the same mask share one statement.
+					updateTables[className] = [[AutoDB sharedInstance] valuesForColumnMasks:updatedIds columns:[self->syncRecord columnsForClass:className] class:tableClass translateDates:NO];
 				}
-			}
-		}];
-	}
-	
-	__block double approxDataSize = 0;	//, maxDataSize = 134217728;	//128mb is max, if one letter = one byte.
-	NSMutableDictionary *actions = [NSMutableDictionary new];
-	if (deleteTables.count)
-	{
-		actions[[@(SyncTypeDelete) stringValue]] = deleteTables;
-		//We perform the delete when coming back from server, if fails we will calculate all of them again. If BG-download works, we will use this record and perform the delete.
-		syncRecord.deleteTables = deleteTables;
-	}
-	if (createTables.count)
-	{
-		//if created objects, translate into sync-format
-		NSMutableDictionary *translatedValues = [NSMutableDictionary new];
-		actions[[@(SyncTypeCreate) stringValue]] = translatedValues;
-		[createTables enumerateKeysAndObjectsUsingBlock:^(NSString *className, NSArray *rows, BOOL * _Nonnull stop) {
-			Class tableClass = NSClassFromString(className);
-			NSString *serverTableName = [tableClass serverTableName];
-			NSMutableArray *translatedRows = [NSMutableArray new];
-			for (NSMutableDictionary *object in rows)
-			{
-				NSDictionary* result = [tableClass syncDataToServer:object];
-				if (result)
+				
+				NSMutableSet <NSNumber*>* ids = [NSMutableSet setWithArray:createdIds ?: @[]];
+				[ids addObjectsFromArray:updatedIds.allKeys];
+				@synchronized (batch)
 				{
-					[translatedRows addObject:result];
-					if (initSync && DEBUG)
-						approxDataSize += [self approxSize:result];
+					batch.ids[className] = ids;
 				}
 			}
-			if (translatedRows.count)
-				translatedValues[serverTableName] = translatedRows;
 		}];
-	}
-	if (updateTables.count)
-	{
-		//instead of saving all values, we just save what columns have changed - and fetch those columns for each object above. We also remove deleted items then.
-		NSMutableDictionary *translatedValues = [NSMutableDictionary new];
-		actions[[@(SyncTypeUpdate) stringValue]] = translatedValues;
+		
+		//translate updates into sync-format, still on this group's worker. Instead of saving all values, we just save what columns have changed - and fetch those columns for each object above. We also remove deleted items then.
 		for (NSString *className in updateTables)
 		{
 			Class tableClass = NSClassFromString(className);
-			NSString *serverTableName = [tableClass serverTableName];
 			NSMutableArray *translatedRows = [NSMutableArray new];
+			NSMutableArray *sentIds = [NSMutableArray new];
+			__block NSUInteger tableSize = 0;
 			[updateTables[className] enumerateKeysAndObjectsUsingBlock:^(NSNumber * idValue, NSMutableDictionary * _Nonnull object, BOOL * _Nonnull stop)
 			{
 				NSMutableDictionary* result = [tableClass syncDataToServer:object];
 				if (result)
 				{
 					[translatedRows addObject:result];
-					if (initSync && DEBUG)
-						approxDataSize += [self approxSize:result];
+					[sentIds addObject:idValue];
+					tableSize += [self approxSize:result];
 				}
 			}];
 			if (translatedRows.count)
-				translatedValues[serverTableName] = translatedRows;
+			{
+				@synchronized (batch)
+				{
+					updateActions[[tableClass serverTableName]] = translatedRows;
+					[self addSentIds:sentIds type:SyncTypeUpdate className:className batch:batch];
+					[self addMeasure:batch.measures className:className bytes:tableSize rows:translatedRows.count];
+				}
+			}
 		}
-	}
+	}];
 	
-	if (initSync && DEBUG)
-		NSLog(@"approxDataSize became %@ mb", @(approxDataSize / (1024*1024)));
+	batch.actions = [NSMutableDictionary new];
+	if (createActions.count)
+		batch.actions[[@(SyncTypeCreate) stringValue]] = createActions;
+	if (updateActions.count)
+		batch.actions[[@(SyncTypeUpdate) stringValue]] = updateActions;
+	return batch;
+}
+
+///Read and translate the batch after the one being sent in the background, if the log has more.
+- (void) prepareNextBatch
+{
+	if ((syncRecord.syncOptions & SyncOptionsPartialSync) == 0 || (syncRecord.syncOptions & (SyncOptionsInitSync | SyncOptionsResetSync)))
+		return;
 	
-	//debug print actions
-	/*
-	NSArray *statuses = @[@"unknown", @"SyncTypeStatus", @"SyncTypeUpdate", @"SyncTypeDelete", @"SyncTypeCreate"];
-	for (NSString *action in actions)
+	//from now on remember what the server changes, those rows must be read again.
+	@synchronized (replyTouchedIds)
 	{
-		NSInteger index = [action integerValue];
-		NSString *status = statuses[index];
-		NSLog(@"%@: %@", status, [[actions[action] allKeys] componentsJoinedByString:@", "]);
+		[replyTouchedIds removeAllObjects];
 	}
-	*/
-	[self syncActions:actions syncState:SyncStateRegular];
+	dispatch_group_async(pipelineGroup, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+		
+		AutoSyncLogBatch *logBatch = [self->syncRecord nextBatch];
+		if (logBatch)
+			self->preparedBatch = [self buildBatch:logBatch deleteTables:[self deletedTables]];
+	});
+}
+
+///The batch prepared while the last one was on the wire, nil if there is none or if it has gone stale.
+- (nullable AutoSyncBatch*) takePreparedBatch:(NSDictionary <NSString*, NSArray*>*)deleteTables
+{
+	dispatch_group_wait(pipelineGroup, DISPATCH_TIME_FOREVER);
+	AutoSyncBatch *batch = preparedBatch;
+	preparedBatch = nil;
+	if (!batch)
+		return nil;
+	
+	//rows the server has changed or that were deleted since the batch was read must be read again.
+	__block BOOL stale = NO;
+	@synchronized (replyTouchedIds)
+	{
+		[batch.ids enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull className, NSMutableSet<NSNumber *> * _Nonnull ids, BOOL * _Nonnull stop) {
+			
+			NSArray *deletedIds = deleteTables[[NSClassFromString(className) serverTableName]];
+			if ([ids intersectsSet:replyTouchedIds[className]] || (deletedIds && [ids intersectsSet:[NSSet setWithArray:deletedIds]]))
+			{
+				stale = YES;
+				*stop = YES;
+			}
+		}];
+	}
+	if (stale || ![syncRecord adoptBatch:batch.logBatch])
+		return nil;
+	return batch;
+}
+
+- (void) replyTouchedIds:(NSArray*)ids className:(NSString*)className
+{
+	@synchronized (replyTouchedIds)
+	{
+		NSMutableSet *touched = replyTouchedIds[className];
+		if (!touched)
+		{
+			touched = [NSMutableSet new];
+			replyTouchedIds[className] = touched;
+		}
+		for (NSNumber *idValue in ids)
+		{
+			if ([idValue isKindOfClass:[NSString class]])
+				[touched addObject:@([((NSString*)idValue) longLongValue])];
+			else
+				[touched addObject:idValue];
+		}
+	}
+}
+
+- (AutoSyncWindow*) syncWindow
+{
+	return syncRecord.syncWindow;
+}
+
+- (void) addMeasure:(NSMutableDictionary <NSString*, NSArray <NSNumber*>*> *)measures className:(NSString*)className bytes:(NSUInteger)bytes rows:(NSUInteger)rows
+{
+	NSArray <NSNumber*>* measure = measures[className];
+	measures[className] = @[@(measure[0].unsignedIntegerValue + bytes), @(measure[1].unsignedIntegerValue + rows)];
+}
+
+- (void) addSentIds:(NSArray <NSNumber*>*)ids type:(SyncType)type className:(NSString*)className batch:(AutoSyncBatch*)batch
+{
+	if (!batch.sentIds[className])
+		batch.sentIds[className] = [NSMutableDictionary new];
+	batch.sentIds[className][@(type)] = ids;
 }
 
 - (NSUInteger) approxSize:(NSDictionary*)result
@@ -755,10 +1986,70 @@ static NSString* downloadKey = @"AutoSyncTask";
 		AutoTransferUserInfo: [@(syncState) stringValue],
 		AutoTransferTaskPriority: @(NSURLSessionTaskPriorityHigh)
 	};
-	[[ADBackgroundDownload sharedInstance] transferWithRequest:[ADBackgroundDownload requestWithURL:self.apiURL parameters:sync] key:downloadKey settings:settings startBlock:nil];
+	NSURLRequest *request = [self requestWithPayload:sync];
+	[self measureBatch:request.HTTPBody.length];
+	id<AutoSyncTransport> transport = self.transport;
+	if (transport)
+	{
+		[transport sendRequest:request payload:sync completion:^(NSData * _Nullable replyData, NSInteger statusCode, NSError * _Nullable error) {
+			
+			//read it straight from the body, like a streamed download.
+			AutoSyncReplyReader *reply = nil;
+			if (!error && statusCode == 200 && replyData.length)
+				reply = [[AutoSyncReplyReader alloc] initWithStream:[NSInputStream inputStreamWithData:replyData]];
+			[self handleReply:reply statusCode:statusCode error:error syncState:syncState];
+		}];
+	}
+	else
+		[[ADBackgroundDownload sharedInstance] transferWithRequest:request key:downloadKey settings:settings startBlock:nil];
 	if (DEBUG) NSLog(@"sending sync");
 }
 
+///Tell the sync window what each table's rows really cost on the wire. The body is not split per table, so its length is shared out by the approximated sizes. Requests without a batch (id, continue_sync, resume) carry 0 bytes.
+- (void) measureBatch:(NSUInteger)bodyLength
+{
+	BOOL isBatch = batchMeasures.count > 0;
+	NSUInteger approxTotal = 0;
+	for (NSArray <NSNumber*>* measure in batchMeasures.allValues)
+		approxTotal += measure[0].unsignedIntegerValue;
+	if (!bodyLength)
+		bodyLength = approxTotal;
+	
+	if (approxTotal)
+	{
+		double ratio = (double)bodyLength / approxTotal;
+		[batchMeasures enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull className, NSArray<NSNumber *> * _Nonnull measure, BOOL * _Nonnull stop) {
+			[self->syncRecord.syncWindow measuredBytes:(NSUInteger)(measure[0].unsignedIntegerValue * ratio) rows:measure[1].unsignedIntegerValue forTable:className];
+		}];
+	}
+	batchMeasures = nil;
+	batchBytes = isBatch ? bodyLength : 0;
+	batchStart = [NSDate date];
+}
+
+- (NSURLRequest*) requestWithPayload:(NSDictionary*)sync
+{
+	id<AutoSyncPayloadCodec> codec = self.payloadCodec;
+	if (codec)
+	{
+		NSError *error = nil;
+		NSData *body = [codec encodePayload:sync error:&error];
+		if (body)
+		{
+			//start from the regular request so it keeps its headers, only the body is ours.
+			NSMutableURLRequest *request = [[ADBackgroundDownload requestWithURL:self.apiURL parameters:@{}] mutableCopy];
+			request.HTTPMethod = @"POST";
+			request.HTTPBody = body;
+			[request setValue:codec.contentType forHTTPHeaderField:@"Content-Type"];
+			[request setValue:codec.contentEncoding forHTTPHeaderField:@"Content-Encoding"];
+			[request setValue:[@(body.length) stringValue] forHTTPHeaderField:@"Content-Length"];
+			return request;
+		}
+		NSLog(@"could not encode sync payload, sending it as JSON: %@", error);
+	}
+	return [ADBackgroundDownload requestWithURL:self.apiURL parameters:sync];
+}
+
 - (void) downloadComplete:(NSNotification*)notif
 {
 	//NOTE: it won't come here before transfer is setup since we then don't listen to the callback.
@@ -776,7 +2067,15 @@ static NSString* downloadKey = @"AutoSyncTask";
         //NOTE: if we are using all file descriptors we might get no data here - blame backblaze!
         result = [task JSONDataWithError:&error];
 	}
-	
+	//The background download only gives us the parsed reply, so it is not streamed like replies from a transport. It is still applied section by section so each table is released when done.
+	AutoSyncReplyReader *reply = result ? [[AutoSyncReplyReader alloc] initWithDictionary:result] : nil;
+	result = nil;
+	[self handleReply:reply statusCode:task.statusCode error:error syncState:syncState];
+}
+
+///Handle the outcome of a sync request from any transport, reply is nil if nothing came back.
+- (void) handleReply:(nullable AutoSyncReplyReader*)reply statusCode:(NSInteger)statusCode error:(nullable NSError*)error syncState:(SyncState)syncState
+{
 	//handle common errors
 	if (error && isAutoErrorType(error.code, AutoErrorCodeLoginError) && [error.domain isEqualToString:AutoErrorDomain])
 	{
@@ -796,8 +2095,8 @@ static NSString* downloadKey = @"AutoSyncTask";
 	//Break if missing payments or unhandable server error - and insert new values into db.
 	//if (task.statusCode == 304)//all is up to date
 	
-	BOOL transferNotWorking = (!result && task.statusCode != 200 && task.statusCode != 304);
-	if (task.statusCode == 402)
+	BOOL transferNotWorking = (!reply && statusCode != 200 && statusCode != 304);
+	if (statusCode == 402)
 	{
 		//ask to fix payment before syncing again
 		[self handleMissingPayment];
@@ -807,7 +2106,7 @@ static NSString* downloadKey = @"AutoSyncTask";
 	}
 	else if (error || transferNotWorking)
 	{
-		NSLog(@"got server error - cannot continue %@ error: %@ httpResponseCode %@", result, error, @(task.statusCode));
+		NSLog(@"got server error - cannot continue error: %@ httpResponseCode %@", error, @(statusCode));
 		//TODO: handle all errors
 		
 		if ([error.domain isEqualToString:NSURLErrorDomain] && (error.code == -997 || error.code == -996))
@@ -815,25 +2114,11 @@ static NSString* downloadKey = @"AutoSyncTask";
 			//deamon is dead, try using less data
 			[syncRecord reimburseActions];
 			
-			//current is too much, set it to max
-			syncRecord.maxSyncAmount = syncRecord.currentSyncAmount;
-			if (syncRecord.minSyncAmount >= syncRecord.currentSyncAmount)
-				syncRecord.minSyncAmount = 1;
-			
-			//We know/hope that 1MB will work, so pick half between it and current (but safe up for errors).
-			NSInteger nextAmount;
-			double sizeInMB = ceil(task.sessionTask.originalRequest.HTTPBody.length / (1024*1024));
-			if (sizeInMB > 1)
-				nextAmount = floor(syncRecord.currentSyncAmount / sizeInMB);
-			else
-				nextAmount = syncRecord.currentSyncAmount / 4;
-			if (nextAmount >= syncRecord.currentSyncAmount)
-				nextAmount = syncRecord.minSyncAmount;
-			nextAmount = (syncRecord.currentSyncAmount - nextAmount) / 2;
-			if (nextAmount <= syncRecord.minSyncAmount)
-				nextAmount = syncRecord.minSyncAmount;
-			syncRecord.currentSyncAmount = nextAmount;
-			NSLog(@"syncRecord.maxAmount became %@", @(syncRecord.currentSyncAmount));
+			//current is too much, halve the window and send a smaller batch - after asking how much of it got stored.
+			[syncRecord.syncWindow roundTripFailedWithBytes:batchBytes];
+			syncRecord.hasChanges = YES;
+			resumeSentBatch = sentIds.count > 0;
+			NSLog(@"sync window became %@ bytes", @(syncRecord.syncWindow.windowBytes));
 			
 			resyncCount++;
 			[self determineSyncAction:YES];
@@ -841,7 +2126,10 @@ static NSString* downloadKey = @"AutoSyncTask";
 		}
 		else if (resyncCount < 4 && (transferNotWorking || [error.domain isEqualToString:NSPOSIXErrorDomain]))
 		{
-			//This error is due to bg-downloads never working properly - just send again
+			//This error is due to bg-downloads never working properly - just send again, but less since the link may be bad. The server may have stored some of it.
+			[syncRecord.syncWindow roundTripFailedWithBytes:batchBytes];
+			syncRecord.hasChanges = YES;
+			resumeSentBatch = sentIds.count > 0;
 			resyncCount++;
 			[self determineSyncAction:YES];
 			return;
@@ -857,43 +2145,66 @@ static NSString* downloadKey = @"AutoSyncTask";
 		dispatch_semaphore_signal(syncSemaphore);
 		return;
 	}
-	else if (syncRecord.maxSyncAmount > syncRecord.currentSyncAmount && syncRecord.minSyncAmount < syncRecord.currentSyncAmount)
+	
+	//the round trip worked, let the window grow from the batch it carried and how long it took.
+	if (batchBytes >= AUTO_SYNC_MEASURE_MIN_BYTES)
 	{
-		//syncing worked and we are between min and max
-		syncRecord.minSyncAmount = syncRecord.currentSyncAmount;	//if working, don't go below this threshold.
-		NSInteger nextAmount = floor((syncRecord.maxSyncAmount - syncRecord.currentSyncAmount) / 4);
-		if (nextAmount >= 1 && nextAmount + syncRecord.currentSyncAmount <= syncRecord.maxSyncAmount)
-		{
-			syncRecord.currentSyncAmount += nextAmount;	//step up a little bit to get closer to
-		}
+		NSTimeInterval roundTrip = batchStart ? -[batchStart timeIntervalSinceNow] : 0;
+		[syncRecord.syncWindow roundTripSucceededWithBytes:batchBytes duration:roundTrip];
 	}
+	syncRecord.hasChanges = YES;
+	batchStart = nil;
+	
+	//Note that reply may be null if nothing has changed - so nothing can be updated and you can't delete anything.
+	[self applyReply:reply syncState:syncState];
+}
+
+- (void) applyReply:(nullable AutoSyncReplyReader*)reply syncState:(SyncState)syncState
+{
 	/*Algorithm is as follows:
 	 1. perform delete on all deleted ids (both from server and those we sent).
 	 2. update and merge all values from server.
 	 3. loop through errors, if any duplicate ids - we move those automatically, if duplicate unique columns - we need to call a resolver method. Or if just resync - then do nothing.
 	 4. if there where errors, resync.
 	 */
-	
-	//Note that result may be null if nothing has changed - so nothing can be updated and you can't delete anything.
 	BOOL continueSync = NO;
 	BOOL sendError = NO;
-	if (result)
+	if (reply)
 	{
-		continueSync = result[@"continue_sync"] != nil;
+		BOOL allChangesFound = YES;
+		NSDictionary *replyInfo = [self updateServerReply:reply allChangesFound:&allChangesFound];
+		if (!replyInfo)
+		{
+			//the reply broke half way, ask what was stored and send the rest again.
+			if (resyncCount < 4)
+			{
+				resyncCount++;
+				resumeSentBatch = sentIds.count > 0;
+				[self determineSyncAction:YES];
+				return;
+			}
+			[[NSNotificationCenter defaultCenter] postNotificationName:AutoSyncDoneNotification object:nil userInfo:@{ @"error": reply.error }];
+			_isSyncing = NO;
+			dispatch_semaphore_signal(syncSemaphore);
+			return;
+		}
+		continueSync = replyInfo[@"continue_sync"] != nil;
+		//stored rows need not be sent again, otherwise the whole batch stays until acknowledged.
+		if (continueSync || (syncState & SyncStateResume))
+			[self acknowledgeRows:replyInfo[@"ack"]];
 		if (continueSync)
 		{
 			//if we get continue we must always resend actions - but not deletes
 			[syncRecord reimburseActions];
 		}
-		[self updateServerReply:result];
 		//always update change_id, since if we gotten new items we don't want to fetch those again in case of resync.
-		if ([self verifyServerChanges:result])
+		if (allChangesFound)
 		{
-			if (result[@"id"]) syncRecord.change_id = result[@"id"];
+			if (replyInfo[@"id"]) syncRecord.change_id = replyInfo[@"id"];
 			else
 				NSLog(@"error! no change id!");
 		}
-		sendError = [self handleServerError:result];
+		sendError = [self handleServerError:replyInfo];
 		if (sendError && continueSync == NO)
 		{
 			//we have errors that are triggering resync
@@ -996,7 +2307,8 @@ static NSString* downloadKey = @"AutoSyncTask";
 
 #pragma mark - update local db from sync
 
-- (void) updateServerReply:(NSDictionary*)result
+///Apply the reply one section at a time and return what is not table data (id, error, continue_sync), nil if the reply could not be read.
+- (nullable NSDictionary*) updateServerReply:(AutoSyncReplyReader*)reply allChangesFound:(BOOL*)allChangesFound
 {
 	//delete those we sent in (if any)
 	NSDictionary *deleteIds = syncRecord.deleteTables;
@@ -1007,53 +2319,163 @@ static NSString* downloadKey = @"AutoSyncTask";
 	}];
 	syncRecord.deleteTables = nil;	//only delete these once
 	
-	//Then loop through all tables, and update values.
-	[result enumerateKeysAndObjectsUsingBlock:^(NSString *serverName, NSDictionary *sync, BOOL * _Nonnull stop) {
-		//if ([sync.class isKindOfClass:[NSNumber class]]) return;
-		NSString *className = serverClientTableMapping[serverName];
-		if (!className) return;
-		Class tableClass = NSClassFromString(className);
-		if (!tableClass || [tableClass isSubclassOfClass:[AutoSync class]] == NO)
-		{
-			//it always asks about id first, so check class.
-			return;
-		}
-		//also save information to notify the app.
+	//also save information to notify the app. Sections read these on their group's queue, so they are all created before the first section is applied.
+	for (NSString *className in groupQueues)
+	{
 		if (!postUpdated[className])
 		{
 			postUpdated[className] = [NSMutableArray new];
 			postCreated[className] = [NSMutableArray new];
 			postDeleted[className] = [NSMutableArray new];
 		}
-		
-		//delete what other clients have deleted
-		NSArray *deletions = sync[[@(SyncTypeDelete) stringValue]];
-		if (deletions)
+	}
+	
+	//Then loop through all tables, and update values. Sections of different groups are applied at the same time, each group's in reply order.
+	NSMutableDictionary *replyInfo = [NSMutableDictionary new];
+	dispatch_group_t applyGroup = dispatch_group_create();
+	dispatch_semaphore_t applySlots = dispatch_semaphore_create(MAX(1, self.maxConcurrentGroups));
+	while (YES)
+	{
+		@autoreleasepool
 		{
-			[tableClass deleteIds:deletions];
-			[self syncDelete:deletions className:className notifyAndClear:YES];
-			if (postDeleted[className])
-				[postDeleted[className] addObjectsFromArray:deletions];
-			else
-				postDeleted[className] = deletions.mutableCopy;
+			NSString *serverName = nil;
+			id sync = nil;
+			if (![reply nextKey:&serverName value:&sync])
+				break;
+			NSString *className = serverClientTableMapping[serverName];
+			Class tableClass = className ? NSClassFromString(className) : nil;
+			if (!tableClass || [tableClass isSubclassOfClass:[AutoSync class]] == NO || [sync isKindOfClass:[NSDictionary class]] == NO)
+			{
+				//it always asks about id first, so check class.
+				replyInfo[serverName] = sync;
+				continue;
+			}
+			if (![self verifyServerChanges:@{ serverName: sync }])
+				*allChangesFound = NO;
+			
+			dispatch_semaphore_wait(applySlots, DISPATCH_TIME_FOREVER);
+			dispatch_group_async(applyGroup, groupQueues[className], ^{
+				@autoreleasepool
+				{
+					[self updateSection:sync tableClass:tableClass className:className];
+				}
+				dispatch_semaphore_signal(applySlots);
+			});
 		}
+	}
+	dispatch_group_wait(applyGroup, DISPATCH_TIME_FOREVER);
+	
+	[AutoModel saveAllWithChanges:nil];
+	if (reply.error)
+	{
+		NSLog(@"could not read sync reply %@", reply.error);
+		return nil;
+	}
+	return replyInfo;
+}
+
+///Apply one table's section in one transaction, runs on the queue of the table's group. The post-dictionaries for the class must be created before.
+- (void) updateSection:(NSDictionary*)sync tableClass:(Class)tableClass className:(NSString*)className
+{
+	//delete what other clients have deleted
+	NSArray *deletions = sync[[@(SyncTypeDelete) stringValue]];
+	if (deletions)
+	{
+		[tableClass deleteIds:deletions];
+		[self syncDelete:deletions className:className notifyAndClear:YES];
+		[self replyTouchedIds:deletions className:className];
+		[postDeleted[className] addObjectsFromArray:deletions];
+	}
+	
+	//what we have changed ourselves is read from the sync log before the transaction, so applying rows never waits for the record's database.
+	NSArray *objects = sync[[@(SyncTypeStatus) stringValue]];
+	NSDictionary *updates = sync[[@(SyncTypeUpdate) stringValue]];
+	NSMutableArray <NSNumber*>*sectionIds = [NSMutableArray arrayWithCapacity:objects.count + updates.count];
+	for (NSDictionary *data in objects)
+		[sectionIds addObject:@([data[@"id"] longLongValue])];
+	for (NSString *idString in updates)
+		[sectionIds addObject:@([idString longLongValue])];
+	NSDictionary <NSNumber*, NSNumber*>*localMasks = [syncRecord updateMasksForIds:sectionIds forClass:className];
+	
+	[tableClass inDatabase:^(AFMDatabase * _Nonnull db) {
+		
+		BOOL transaction = !db.inTransaction;
+		if (transaction)
+			[db beginTransaction];
 		
 		//create what other clients have created
-		NSArray *objects = sync[[@(SyncTypeStatus) stringValue]];
-		if (objects)
+		for (NSUInteger index = 0; index < objects.count; index += AUTO_SYNC_APPLY_BATCH)
 		{
-			@autoreleasepool { [self syncStatus:objects tableClass:tableClass className:className]; }
+			@autoreleasepool
+			{
+				NSRange range = NSMakeRange(index, MIN(AUTO_SYNC_APPLY_BATCH, objects.count - index));
+				[self syncStatus:[objects subarrayWithRange:range] localMasks:localMasks tableClass:tableClass className:className];
+			}
 		}
 		
 		//update new values
-		NSDictionary *updates = sync[[@(SyncTypeUpdate) stringValue]];
-		if (updates)
+		NSArray *updateIds = updates.allKeys;
+		for (NSUInteger index = 0; index < updateIds.count; index += AUTO_SYNC_APPLY_BATCH)
 		{
-			@autoreleasepool{ [self syncUpdate:updates tableClass:tableClass className:className]; }
+			@autoreleasepool
+			{
+				NSArray *batchIds = [updateIds subarrayWithRange:NSMakeRange(index, MIN(AUTO_SYNC_APPLY_BATCH, updateIds.count - index))];
+				NSDictionary *batch = [NSDictionary dictionaryWithObjects:[updates objectsForKeys:batchIds notFoundMarker:[NSNull null]] forKeys:batchIds];
+				[self syncUpdate:batch localMasks:localMasks tableClass:tableClass className:className];
+			}
 		}
+		
+		if (transaction)
+			[db commit];
+	}];
+}
+
+- (AutoSyncApplyPlan*) applyPlanForClass:(Class)tableClass className:(NSString*)className
+{
+	@synchronized (applyPlans)
+	{
+		AutoSyncApplyPlan *plan = applyPlans[className];
+		if (!plan)
+		{
+			plan = [[AutoSyncApplyPlan alloc] initWithClass:tableClass className:className];
+			applyPlans[className] = plan;
+		}
+		return plan;
+	}
+}
+
+///The plan follows the codec, it decides how packed columns are sent.
+- (AutoSyncEncodePlan*) encodePlanForClass:(Class)tableClass className:(NSString*)className
+{
+	BOOL nested = self.payloadCodec.encodesNestedValues;
+	@synchronized (encodePlans)
+	{
+		AutoSyncEncodePlan *plan = encodePlans[className];
+		if (!plan || plan.nested != nested)
+		{
+			plan = [[AutoSyncEncodePlan alloc] initWithClass:tableClass className:className nested:nested];
+			encodePlans[className] = plan;
+		}
+		return plan;
+	}
+}
+
+///Patch the objects that are in memory after their rows are written, the others are read from the db when needed.
+- (void) patchCachedObjects:(NSDictionary <NSNumber*, NSDictionary*>*)rows plan:(AutoSyncApplyPlan*)plan tableClass:(Class)tableClass markCreated:(BOOL)markCreated
+{
+	if (rows.count == 0)
+		return;
+	[[tableClass tableCache] syncPerformBlock:^(NSMapTable * _Nonnull table) {
+		[rows enumerateKeysAndObjectsUsingBlock:^(NSNumber * _Nonnull idValue, NSDictionary * _Nonnull values, BOOL * _Nonnull stop) {
+			
+			AutoSync *object = [table objectForKey:idValue];
+			if (!object)
+				return;
+			if (markCreated && object.sync_state & AutoSyncStateNotCreated)
+				[object setPrimitiveValue:@(AutoSyncStateRegular) forKey:@"sync_state"];
+			[plan patchObject:object values:values];
+		}];
 	}];
-	
-	[AutoModel saveAllWithChanges:nil];
 }
 
 //we still need to take care of this here, since objects we delete cannot exist in the cache.
@@ -1084,94 +2506,82 @@ static NSString* downloadKey = @"AutoSyncTask";
 	}
 }
 
-//Create or refresh from server
-- (void) syncStatus:(NSArray*)serverData tableClass:(Class)tableClass className:(NSString*)className
+//Create or refresh from server, rows are written with prepared statements without loading them as objects.
+- (void) syncStatus:(NSArray*)serverData localMasks:(NSDictionary <NSNumber*, NSNumber*>*)localMasks tableClass:(Class)tableClass className:(NSString*)className
 {
-	NSDictionary <NSString *, NSNumber *>*columnSyntax = [AutoDB.sharedInstance columnSyntaxForClass:tableClass];
-	NSMutableArray *columnKeys = columnSyntax.allKeys.mutableCopy;
-	NSSet *preventSyncColumns = [tableClass preventSyncColumns];
-	if (preventSyncColumns)
-	{
-		[columnKeys removeObjectsInArray:[preventSyncColumns allObjects]];
-	}
-	
+	AutoSyncApplyPlan *plan = [self applyPlanForClass:tableClass className:className];
 	NSMutableArray *ids = [NSMutableArray new];
 	for (NSDictionary *data in serverData)
 	{
-		[ids addObject:data[@"id"]];
+		[ids addObject:@([data[@"id"] longLongValue])];
 	}
+	[self replyTouchedIds:ids className:className];
 	
-	NSMutableSet *presidentColumns = [tableClass localColumnsTakesSyncingPresident];
+	//refresh those rows we already have, create the rest.
+	NSMutableSet *existingIds = [NSMutableSet new];
+	[tableClass inDatabase:^(AFMDatabase * _Nonnull db) {
+		AFMResultSet *result = [db executeQuery:[NSString stringWithFormat:@"SELECT id FROM %@ WHERE id IN (%@)", className, [AutoModel questionMarks:ids.count]] withArgumentsInArray:ids];
+		while ([result next])
+		{
+			[existingIds addObject:@([result longLongIntForColumnIndex:0])];
+		}
+		[result close];
+	}];
 	
-	//refresh those objects we already have, create the rest.
-	NSMutableDictionary *objects = [tableClass fetchIds:ids].dictionary;
-	NSMutableDictionary <NSNumber*, NSMutableDictionary*> *createObjects = [NSMutableDictionary new];;
+	NSMutableDictionary <NSNumber*, NSMutableDictionary*> *updateRows = [NSMutableDictionary new];
+	NSMutableDictionary <NSNumber*, NSMutableDictionary*> *createObjects = [NSMutableDictionary new];
 	NSMutableArray *createValues = [NSMutableArray new];
-	for (NSMutableDictionary *source in serverData)
-	{
-		NSMutableDictionary *translatedValues = [tableClass syncTranslateFromServer:source];
-		NSNumber *idValue = source[@"id"];
-		AutoSync *object = objects[idValue];
-		if (object.sync_state & AutoSyncStateNotCreated)
-			[object setPrimitiveValue:@(AutoSyncStateRegular) forKey:@"sync_state"];
+	[serverData enumerateObjectsUsingBlock:^(NSMutableDictionary *source, NSUInteger index, BOOL * _Nonnull stop) {
 		
-		if (!object)
+		NSMutableDictionary *translatedValues = [tableClass syncTranslateFromServer:source];
+		NSNumber *idValue = ids[index];
+		if (![existingIds containsObject:idValue])
 		{
 			//new objects must check their unique values first, if they have any.
 			translatedValues[@"id"] = idValue;
 			createObjects[idValue] = translatedValues;
-			continue;
+			return;
 		}
 		
 		//Merge with our records, if we have changed these columns we overwrite them the next time we send stuff to the server.
-		[syncRecord mergeValues:translatedValues presidentColumns:presidentColumns id:object.idValue forClass:className];
+		[self->syncRecord mergeValues:translatedValues presidentColumns:plan.presidentColumns mask:[localMasks[idValue] longLongValue] forClass:className];
 		
 		//we had this object, so update it - but only db, we don't want to write this to the syncRecords
-		[postUpdated[className] addObject:idValue];
-		[self syncPerformUpdate:object merge:translatedValues syntax:columnSyntax];
-	}
+		[self->postUpdated[className] addObject:idValue];
+		updateRows[idValue] = translatedValues;
+	}];
 	
 	if (createObjects.count)
 	{
 		[tableClass handleUniqueValues:createObjects];
 		[createObjects enumerateKeysAndObjectsUsingBlock:^(NSNumber *idValue, NSMutableDictionary *translatedValues, BOOL * _Nonnull stop) {
 			
-			for (NSString* column in columnKeys)
-			{
-				id value = translatedValues[column];
-				if (value) [createValues addObject:value];
-				else [createValues addObject:[NSNull null]];
-			}
-			[postCreated[className] addObject:idValue];
+			[plan addInsertValues:translatedValues to:createValues];
+			[self->postCreated[className] addObject:idValue];
 		}];
 	}
 	
-	//Save and notify UI
-	if (objects.count)
-		[tableClass save:objects.allValues completion:nil];	//this will write to disc our invisble changes
-	if (createObjects.count)
-	{
-		//TODO: This should go into autoDB so it can break up the query in two if needed.
-		NSString *columnString = [columnKeys componentsJoinedByString:@","];
-		NSString *createQuestionMarks = [AutoModel questionMarksForQueriesWithObjects:createObjects.count columns:columnKeys.count];
-		NSString *insertQuery = [NSString stringWithFormat:@"INSERT OR REPLACE INTO %@ (%@) VALUES %@", className, columnString, createQuestionMarks];
-		[tableClass executeInDatabase:^(FMDatabase * _Nonnull db) {
-			
-			BOOL success = [db executeUpdate:insertQuery withArgumentsInArray:createValues];
-			if (!success)
-			{
-				NSLog(@"could not create objects! Sync will fail forever! %@", [db lastError]);
-			}
-		}];
-	}
+	//Save and notify UI, the section is written in one transaction.
+	BOOL markSynced = syncRecord.syncOptions & (SyncOptionsResetSync|SyncOptionsInitSync);
+	[tableClass inDatabase:^(AFMDatabase * _Nonnull db) {
+		
+		BOOL transaction = !db.inTransaction;
+		if (transaction)
+			[db beginTransaction];
+		[plan updateRows:updateRows markCreated:YES inDB:db];
+		[plan insertValues:createValues inDB:db];
+		//Update the db last, in case you have missed something.
+		if (markSynced)
+		{
+			[db executeUpdate:[NSString stringWithFormat:@"UPDATE %@ SET sync_state = 0 WHERE id IN (%@)", className, [AutoModel questionMarks:ids.count]] withArgumentsInArray:ids];
+		}
+		if (transaction)
+			[db commit];
+	}];
+	[self patchCachedObjects:updateRows plan:plan tableClass:tableClass markCreated:YES];
 	
-	//Update the db last, in case you have missed something.
-	if (syncRecord.syncOptions & (SyncOptionsResetSync|SyncOptionsInitSync))
+	if (markSynced)
 	{
-		[tableClass executeInDatabase:^(FMDatabase * _Nonnull db) {
-			
-			[db executeUpdate:[NSString stringWithFormat:@"UPDATE %@ SET sync_state = 0 WHERE id IN (%@)", className, [AutoModel questionMarks:ids.count]] withArgumentsInArray:ids];
-		}];
 		//also update the cache
 		[[tableClass tableCache] asyncExecuteBlock:^(NSMapTable * _Nonnull table) {
 			for (AutoSync* object in table.objectEnumerator.allObjects)
@@ -1185,20 +2595,39 @@ static NSString* downloadKey = @"AutoSyncTask";
 	}
 }
 
-- (void) syncUpdate:(NSDictionary*)updates tableClass:(Class)tableClass className:(NSString*)className
+- (void) syncUpdate:(NSDictionary*)updates localMasks:(NSDictionary <NSNumber*, NSNumber*>*)localMasks tableClass:(Class)tableClass className:(NSString*)className
 {
 	NSMutableArray *ids = [NSMutableArray new];
 	NSMutableDictionary *data = [NSMutableDictionary new];
 	
+	//sync data comes in as JSON strings - decode the whole batch with one parse instead of one per change.
+	NSArray<NSString*> *idStrings = updates.allKeys;
+	NSUInteger changeCount = 0;
+	NSMutableData *json = [NSMutableData dataWithBytes:"[" length:1];
+	for (NSString *idString in idStrings)
+	{
+		for (NSString *changeString in updates[idString])
+		{
+			if (changeCount++)
+				[json appendBytes:"," length:1];
+			[json appendData:[changeString dataUsingEncoding:NSUTF8StringEncoding]];
+		}
+	}
+	[json appendBytes:"]" length:1];
+	NSArray *decodedChanges = [NSJSONSerialization JSONObjectWithData:json options:NSJSONReadingMutableContainers error:nil];
+	json = nil;
+	if (decodedChanges.count != changeCount)
+		decodedChanges = nil;	//some change is broken, decode them one by one to find it.
+	
 	//These ids are all strings because JSON
-	[updates enumerateKeysAndObjectsUsingBlock:^(NSString* idString, NSArray *changes, BOOL * _Nonnull stop) {
-		
+	NSUInteger changeIndex = 0;
+	for (NSString *idString in idStrings)
+	{
 		NSMutableDictionary *result = nil;
-		for (NSString *changeString in changes)
+		for (NSString *changeString in updates[idString])
 		{
-			//sync data comes in as JSON - decode that
-			NSMutableDictionary *change = [NSJSONSerialization JSONObjectWithData:[changeString dataUsingEncoding:NSUTF8StringEncoding] options:NSJSONReadingMutableContainers error:nil];
-			if (!change)
+			NSMutableDictionary *change = decodedChanges ? decodedChanges[changeIndex++] : [NSJSONSerialization JSONObjectWithData:[changeString dataUsingEncoding:NSUTF8StringEncoding] options:NSJSONReadingMutableContainers error:nil];
+			if (![change isKindOfClass:[NSMutableDictionary class]])
 			{
 				NSLog(@"error with JSON: %@", changeString);
 				continue;
@@ -1213,50 +2642,26 @@ static NSString* downloadKey = @"AutoSyncTask";
 		NSNumber *idValue = @([idString integerValue]);
 		[ids addObject:idValue];
 		data[idValue] = result;
-	}];
-	NSDictionary <NSString *, NSNumber *>*columnSyntax = [AutoDB.sharedInstance columnSyntaxForClass:tableClass];
-	NSSet *presidentColumns = [tableClass localColumnsTakesSyncingPresident];
-	NSArray *objects = [tableClass fetchIds:ids].rows;
-	
-	for (AutoSync *object in objects)
-	{
-		NSMutableDictionary *translatedValues = data[object.idValue];
-		[syncRecord mergeValues:translatedValues presidentColumns:presidentColumns id:object.idValue forClass:className];
-		[self syncPerformUpdate:object merge:translatedValues syntax:columnSyntax];
 	}
-	//save changes!
-	[tableClass save:objects completion:nil];
+	AutoSyncApplyPlan *plan = [self applyPlanForClass:tableClass className:className];
+	[data enumerateKeysAndObjectsUsingBlock:^(NSNumber * _Nonnull idValue, NSMutableDictionary * _Nonnull translatedValues, BOOL * _Nonnull stop) {
+		[self->syncRecord mergeValues:translatedValues presidentColumns:plan.presidentColumns mask:[localMasks[idValue] longLongValue] forClass:className];
+	}];
+	//save changes in one transaction, rows we don't have are left alone.
+	[tableClass inDatabase:^(AFMDatabase * _Nonnull db) {
+		
+		BOOL transaction = !db.inTransaction;
+		if (transaction)
+			[db beginTransaction];
+		[plan updateRows:data markCreated:NO inDB:db];
+		if (transaction)
+			[db commit];
+	}];
+	[self patchCachedObjects:data plan:plan tableClass:tableClass markCreated:NO];
+	[self replyTouchedIds:ids className:className];
 	[postUpdated[className] addObjectsFromArray:ids];
 }
 
-- (void) syncPerformUpdate:(AutoSync*)object merge:(NSDictionary *)mergeValues syntax:(NSDictionary <NSString *, NSNumber *>*)columnSyntax
-{
-	if (!mergeValues)
-	{
-		return;
-	}
-	for (NSString *column in mergeValues)
-	{
-		NSNumber *syntax = columnSyntax[column];
-		if (syntax)
-		{
-			//merge these values:
-			id value = mergeValues[column];
-			if (value == [NSNull null])
-			{
-				//It works! NSLog(@"testing null!");
-				[object setPrimitiveValue:nil forKey:column];
-			}
-			else if (syntax.integerValue == AutoFieldTypeDate)
-				[object setPrimitiveValue:[NSDate dateWithTimeIntervalSince1970:[value doubleValue]] forKey:column];
-			else
-				[object setPrimitiveValue:value forKey:column];
-		}
-		else
-			NSLog(@"error, trying to set a column that don't exist: %@ value: %@", column, mergeValues[column]);
-	}
-}
-
 #pragma mark - error handling
 
 - (BOOL) handleServerError:(NSDictionary*)result
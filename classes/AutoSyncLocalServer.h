@@ -0,0 +1,97 @@
+//
+//  AutoSyncLocalServer.h
+//  AutoDB
+//
+//  Created by Olof Thorén on 2026-10-19.
+//  Copyright © 2026 Aggressive Development AB. All rights reserved.
+//
+
+#import "AutoSyncHandler.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+//Keys of the results from AutoSyncBenchmark
+#define AutoSyncBenchmarkRows @"rows"
+#define AutoSyncBenchmarkSeconds @"seconds"
+#define AutoSyncBenchmarkRowsPerSecond @"rowsPerSecond"
+#define AutoSyncBenchmarkRequests @"requests"
+#define AutoSyncBenchmarkRequestBytes @"requestBytes"
+#define AutoSyncBenchmarkReplyBytes @"replyBytes"
+#define AutoSyncBenchmarkPeakMemory @"peakMemory"
+#define AutoSyncBenchmarkError @"error"
+
+/**
+ An in-process stand-in for the sync server, speaking the same autoSync protocol. Set it as AutoSyncHandler.transport to sync without network, e.g. in tests and benchmarks.
+ It keeps every table as rows of server columns and a log of changes where the change id is the position in the log. Rows are stored as sent, only turned into JSON values (data as base64, dates as timestamps).
+ It serves one client, all changes made through the methods below are from "other clients" and are sent to the client on its next sync. Creates of ids other clients already have are rejected as duplicates, and updates of rows other clients changed since the client's change id are rejected so the client must merge and resend.
+ Requests with a batch id are acknowledged with how many leading rows of each table were stored, a resume request for the same batch gets that acknowledgement again.
+ */
+@interface AutoSyncLocalServer : NSObject <AutoSyncTransport>
+
+///Changes from other clients in one reply, the rest follows with continue_sync. Defaults to 1000.
+@property (nonatomic) NSUInteger maxChangesPerReply;
+///Added to every round trip.
+@property (nonatomic) NSTimeInterval latency;
+
+///The next requests get this status code without being applied, e.g. 500 to test retries or 402 for missing payment.
+- (void) failNextRequests:(NSUInteger)count statusCode:(NSInteger)statusCode;
+///The next requests are applied but their replies time out, like on a flaky link.
+- (void) loseNextReplies:(NSUInteger)count;
+
+//Other clients, rows must have an id.
+- (void) createRows:(NSArray <NSDictionary*>*)rows inTable:(NSString*)serverTable;
+- (void) updateIds:(NSArray <NSNumber*>*)ids values:(NSDictionary*)values inTable:(NSString*)serverTable;
+- (void) deleteIds:(NSArray <NSNumber*>*)ids inTable:(NSString*)serverTable;
+
+- (nullable NSDictionary*) rowWithId:(NSNumber*)idValue inTable:(NSString*)serverTable;
+- (NSUInteger) rowCountInTable:(NSString*)serverTable;
+///The change id of the latest change.
+@property (readonly) NSUInteger changeId;
+
+//Counters since the last resetCounters, rows are counted once per create, update or delete.
+@property (readonly) NSUInteger requests, requestBytes, replyBytes, rowsReceived, rowsSent;
+- (void) resetCounters;
+
+@end
+
+typedef NS_ENUM(NSUInteger, AutoSyncBenchmarkScenario)
+{
+	///The server has rows the client doesn't, initialSync fetches them all.
+	AutoSyncBenchmarkInitialSync,
+	///The client changes rows and sends them with mainSync.
+	AutoSyncBenchmarkIncremental,
+	///Like incremental, but other clients change the same rows first so they are rejected, merged and sent again.
+	AutoSyncBenchmarkConflicts,
+};
+
+/**
+ Measures sync throughput against an AutoSyncLocalServer. Which tables and rows are used is up to you, since sync classes are your own.
+ Example:
+ AutoSyncBenchmark *benchmark = [[AutoSyncBenchmark alloc] initWithHandler:AutoSyncHandler.sharedInstance server:[AutoSyncLocalServer new]];
+ benchmark.serverRows = ^(NSUInteger count) { return @{ @"note": rows }; };
+ NSLog(@"%@", [benchmark runScenario:AutoSyncBenchmarkInitialSync rows:10000]);
+ */
+@interface AutoSyncBenchmark : NSObject
+
+- (instancetype) initWithHandler:(AutoSyncHandler*)handler server:(AutoSyncLocalServer*)server;
+
+@property (nonatomic, readonly) AutoSyncHandler *handler;
+@property (nonatomic, readonly) AutoSyncLocalServer *server;
+///Rows other clients have created, for the initial sync: { server_table_name: [rows] }
+@property (nonatomic, copy, nullable) NSDictionary <NSString*, NSArray <NSDictionary*>*>* (^serverRows)(NSUInteger count);
+///Create or change this many objects and save them, return their ids: { server_table_name: [ids] }
+@property (nonatomic, copy, nullable) NSDictionary <NSString*, NSArray <NSNumber*>*>* (^localChanges)(NSUInteger count);
+///The values other clients write to the changed rows in the conflict scenario: { server_table_name: { column: value } }
+@property (nonatomic, nullable) NSDictionary <NSString*, NSDictionary*>* conflictValues;
+///Give up waiting for sync after this long. Defaults to 600 seconds.
+@property (nonatomic) NSTimeInterval timeout;
+
+/**
+ Prepare the scenario, sync and report rows/s, bytes on the wire and the peak memory footprint (see the AutoSyncBenchmark keys). Only the sync itself is measured.
+ Blocks until sync is done, so don't call it on the main thread. The handler must have a current user, initialSync turns syncing on for it.
+ */
+- (NSDictionary <NSString*, id>*) runScenario:(AutoSyncBenchmarkScenario)scenario rows:(NSUInteger)rows;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,609 @@
+//
+//  AutoSyncLocalServer.m
+//  AutoDB
+//
+//  Created by Olof Thorén on 2026-10-19.
+//  Copyright © 2026 Aggressive Development AB. All rights reserved.
+//
+
+#import "AutoSyncLocalServer.h"
+#import "AutoSync.h"
+#import <mach/mach.h>
+
+//Default for maxChangesPerReply.
+#define AUTO_SYNC_LOCAL_REPLY_CHANGES 1000
+//Default for AutoSyncBenchmark.timeout, in seconds.
+#define AUTO_SYNC_BENCHMARK_TIMEOUT 600
+//Memory is sampled this often while syncing, in milliseconds.
+#define AUTO_SYNC_BENCHMARK_SAMPLE 10
+
+///One entry in the server's log, its change id is its position + 1.
+@interface AutoSyncLocalChange : NSObject
+
+@property (nonatomic) NSString *table;
+@property (nonatomic) NSNumber *idValue;
+@property (nonatomic) SyncType type;
+///The changed columns of updates.
+@property (nonatomic, nullable) NSDictionary *values;
+@property (nonatomic) BOOL fromClient;
+
+@end
+
+@implementation AutoSyncLocalChange
+@end
+
+@implementation AutoSyncLocalServer
+{
+	//everything is read and changed on this queue, like a server handling one request at a time.
+	dispatch_queue_t queue;
+	NSMutableDictionary <NSString*, NSMutableDictionary <NSNumber*, NSMutableDictionary*>*> *tables;
+	NSMutableArray <AutoSyncLocalChange*> *changes;
+	//the change id of the last change other clients made to each row: { table: { id: change_id } }
+	NSMutableDictionary <NSString*, NSMutableDictionary <NSNumber*, NSNumber*>*> *otherChanges;
+	//rows the client has created, creating them again is a resend and not a duplicate.
+	NSMutableDictionary <NSString*, NSMutableSet <NSNumber*>*> *clientRows;
+	NSUInteger failCount, loseCount;
+	NSInteger failStatusCode;
+	//what was stored from the last request of each batch: { batch: ack }
+	NSMutableDictionary <NSNumber*, NSDictionary*> *batchAcks;
+}
+
+- (instancetype) init
+{
+	self = [super init];
+	queue = dispatch_queue_create("AutoSyncLocalServer", DISPATCH_QUEUE_SERIAL);
+	tables = [NSMutableDictionary new];
+	changes = [NSMutableArray new];
+	otherChanges = [NSMutableDictionary new];
+	clientRows = [NSMutableDictionary new];
+	batchAcks = [NSMutableDictionary new];
+	_maxChangesPerReply = AUTO_SYNC_LOCAL_REPLY_CHANGES;
+	return self;
+}
+
+- (void) failNextRequests:(NSUInteger)count statusCode:(NSInteger)statusCode
+{
+	dispatch_sync(queue, ^{
+		self->failCount = count;
+		self->failStatusCode = statusCode;
+	});
+}
+
+- (void) loseNextReplies:(NSUInteger)count
+{
+	dispatch_sync(queue, ^{
+		self->loseCount = count;
+	});
+}
+
+- (void) resetCounters
+{
+	dispatch_sync(queue, ^{
+		self->_requests = 0;
+		self->_requestBytes = 0;
+		self->_replyBytes = 0;
+		self->_rowsReceived = 0;
+		self->_rowsSent = 0;
+	});
+}
+
+#pragma mark - other clients
+
+- (void) createRows:(NSArray <NSDictionary*>*)rows inTable:(NSString*)serverTable
+{
+	dispatch_sync(queue, ^{
+		for (NSDictionary *row in rows)
+		{
+			[self createRow:row inTable:serverTable fromClient:NO];
+		}
+	});
+}
+
+- (void) updateIds:(NSArray <NSNumber*>*)ids values:(NSDictionary*)values inTable:(NSString*)serverTable
+{
+	dispatch_sync(queue, ^{
+		for (NSNumber *idValue in ids)
+		{
+			[self updateId:idValue values:values inTable:serverTable fromClient:NO];
+		}
+	});
+}
+
+- (void) deleteIds:(NSArray <NSNumber*>*)ids inTable:(NSString*)serverTable
+{
+	dispatch_sync(queue, ^{
+		for (NSNumber *idValue in ids)
+		{
+			[self deleteId:idValue inTable:serverTable fromClient:NO];
+		}
+	});
+}
+
+- (nullable NSDictionary*) rowWithId:(NSNumber*)idValue inTable:(NSString*)serverTable
+{
+	__block NSDictionary *row = nil;
+	dispatch_sync(queue, ^{
+		row = [self->tables[serverTable][idValue] copy];
+	});
+	return row;
+}
+
+- (NSUInteger) rowCountInTable:(NSString*)serverTable
+{
+	__block NSUInteger count = 0;
+	dispatch_sync(queue, ^{
+		count = self->tables[serverTable].count;
+	});
+	return count;
+}
+
+- (NSUInteger) changeId
+{
+	__block NSUInteger changeId = 0;
+	dispatch_sync(queue, ^{
+		changeId = self->changes.count;
+	});
+	return changeId;
+}
+
+#pragma mark - the store
+
+- (NSMutableDictionary <NSNumber*, NSMutableDictionary*>*) table:(NSString*)serverTable
+{
+	NSMutableDictionary *table = tables[serverTable];
+	if (!table)
+	{
+		table = [NSMutableDictionary new];
+		tables[serverTable] = table;
+	}
+	return table;
+}
+
+///Ids may come as strings, like they do in JSON keys.
+- (nullable NSNumber*) idValue:(id)value
+{
+	if (![value respondsToSelector:@selector(longLongValue)])
+		return nil;
+	return @([value longLongValue]);
+}
+
+///What a JSON server would store: data as base64 and dates as timestamps.
+- (id) jsonValue:(id)value
+{
+	if ([value isKindOfClass:[NSData class]])
+		return [value base64EncodedStringWithOptions:0];
+	if ([value isKindOfClass:[NSDate class]])
+		return @([value timeIntervalSince1970]);
+	if ([value isKindOfClass:[NSDictionary class]])
+	{
+		NSMutableDictionary *dictionary = [NSMutableDictionary new];
+		[value enumerateKeysAndObjectsUsingBlock:^(id key, id object, BOOL * _Nonnull stop) {
+			dictionary[[key description]] = [self jsonValue:object];
+		}];
+		return dictionary;
+	}
+	if ([value isKindOfClass:[NSArray class]])
+	{
+		NSMutableArray *array = [NSMutableArray new];
+		for (id object in value)
+		{
+			[array addObject:[self jsonValue:object]];
+		}
+		return array;
+	}
+	return value;
+}
+
+- (void) logChange:(SyncType)type table:(NSString*)serverTable id:(NSNumber*)idValue values:(nullable NSDictionary*)values fromClient:(BOOL)fromClient
+{
+	AutoSyncLocalChange *change = [AutoSyncLocalChange new];
+	change.table = serverTable;
+	change.idValue = idValue;
+	change.type = type;
+	change.values = values;
+	change.fromClient = fromClient;
+	[changes addObject:change];
+	if (!fromClient)
+	{
+		NSMutableDictionary *tableChanges = otherChanges[serverTable];
+		if (!tableChanges)
+		{
+			tableChanges = [NSMutableDictionary new];
+			otherChanges[serverTable] = tableChanges;
+		}
+		tableChanges[idValue] = @(changes.count);
+	}
+}
+
+- (BOOL) createRow:(NSDictionary*)row inTable:(NSString*)serverTable fromClient:(BOOL)fromClient
+{
+	NSNumber *idValue = [self idValue:row[@"id"]];
+	NSMutableDictionary *table = [self table:serverTable];
+	if (!idValue || table[idValue])
+		return NO;
+	NSMutableDictionary *stored = [self jsonValue:row];
+	stored[@"id"] = idValue;
+	table[idValue] = stored;
+	if (fromClient)
+	{
+		if (!clientRows[serverTable])
+			clientRows[serverTable] = [NSMutableSet new];
+		[clientRows[serverTable] addObject:idValue];
+	}
+	[self logChange:SyncTypeCreate table:serverTable id:idValue values:nil fromClient:fromClient];
+	return YES;
+}
+
+- (BOOL) updateId:(NSNumber*)idValue values:(NSDictionary*)values inTable:(NSString*)serverTable fromClient:(BOOL)fromClient
+{
+	NSMutableDictionary *row = tables[serverTable][idValue];
+	if (!row)
+		return NO;
+	NSMutableDictionary *columns = [self jsonValue:values];
+	[columns removeObjectForKey:@"id"];
+	[row addEntriesFromDictionary:columns];
+	[self logChange:SyncTypeUpdate table:serverTable id:idValue values:columns fromClient:fromClient];
+	return YES;
+}
+
+- (BOOL) deleteId:(NSNumber*)idValue inTable:(NSString*)serverTable fromClient:(BOOL)fromClient
+{
+	if (!idValue || !tables[serverTable][idValue])
+		return NO;
+	[tables[serverTable] removeObjectForKey:idValue];
+	[clientRows[serverTable] removeObject:idValue];
+	[self logChange:SyncTypeDelete table:serverTable id:idValue values:nil fromClient:fromClient];
+	return YES;
+}
+
+#pragma mark - the protocol
+
+- (void) sendRequest:(NSURLRequest*)request payload:(NSDictionary*)payload completion:(void (^)(NSData * _Nullable, NSInteger, NSError * _Nullable))completion
+{
+	dispatch_async(queue, ^{
+
+		self->_requests++;
+		self->_requestBytes += request.HTTPBody.length;
+		NSData *reply = nil;
+		NSInteger statusCode = 200;
+		NSError *error = nil;
+		if (self->failCount)
+		{
+			self->failCount--;
+			statusCode = self->failStatusCode;
+		}
+		else
+		{
+			//serve what was sent, a codec's body must decode or the request is rejected like a real server would.
+			NSDictionary *sync = payload;
+			id<AutoSyncPayloadCodec> codec = [AutoSyncHandler sharedInstance].payloadCodec;
+			if (codec && request.HTTPBody.length && [[request valueForHTTPHeaderField:@"Content-Type"] isEqualToString:codec.contentType])
+			{
+				NSError *decodeError = nil;
+				id decoded = [codec decodePayload:request.HTTPBody error:&decodeError];
+				sync = [decoded isKindOfClass:[NSDictionary class]] ? decoded : nil;
+				if (!sync)
+					NSLog(@"could not decode sync payload: %@", decodeError);
+			}
+			if (sync)
+			{
+				@autoreleasepool
+				{
+					reply = [self replyToSync:sync[@"autoSync"]];
+				}
+			}
+			else
+				statusCode = 400;
+			if (self->loseCount)
+			{
+				self->loseCount--;
+				reply = nil;
+				statusCode = 0;
+				error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:nil];
+			}
+			self->_replyBytes += reply.length;
+		}
+		dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.latency * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+			completion(reply, statusCode, error);
+		});
+	});
+}
+
+///Rows are stored in request order, the count is a checkpoint: everything before it is stored.
+- (void) acknowledge:(NSUInteger)count type:(SyncType)type table:(NSString*)serverTable ack:(nullable NSMutableDictionary*)ack
+{
+	if (!ack)
+		return;
+	NSMutableDictionary *counts = [ack[serverTable] mutableCopy] ?: [NSMutableDictionary new];
+	counts[[@(type) stringValue]] = @(count);
+	ack[serverTable] = counts;
+}
+
+- (void) addError:(SyncError)code values:(NSArray*)values table:(NSString*)serverTable to:(NSMutableDictionary*)errors
+{
+	if (values.count == 0)
+		return;
+	if (!errors[serverTable])
+		errors[serverTable] = [NSMutableArray new];
+	[errors[serverTable] addObject:@{ @"code": @(code), @"values": values }];
+}
+
+///Apply the client's changes like the server does, and reply with what other clients have changed since the client's change id.
+- (NSData*) replyToSync:(NSDictionary*)sync
+{
+	NSUInteger sinceId = [sync[@"id"] unsignedIntegerValue];
+	NSMutableDictionary <NSString*, NSMutableArray*> *errors = [NSMutableDictionary new];
+	//how many leading rows of each table were stored: { server_table_name: { SyncType: count } }
+	NSNumber *batchId = sync[@"batch"];
+	NSMutableDictionary *ack = nil;
+	if (batchId && sync[@"resume"])
+		ack = [batchAcks[batchId] mutableCopy];
+	else if (batchId)
+		ack = [NSMutableDictionary new];
+
+	NSDictionary <NSString*, NSArray*> *deletes = sync[[@(SyncTypeDelete) stringValue]];
+	[deletes enumerateKeysAndObjectsUsingBlock:^(NSString *serverTable, NSArray *ids, BOOL * _Nonnull stop) {
+		if (ids.count == 0)
+			[self addError:SyncErrorDeleteMissingValues values:@[] table:serverTable to:errors];
+		for (id idValue in ids)
+		{
+			self->_rowsReceived++;
+			[self deleteId:[self idValue:idValue] inTable:serverTable fromClient:YES];
+		}
+	}];
+
+	NSDictionary <NSString*, NSArray*> *creates = sync[[@(SyncTypeCreate) stringValue]];
+	[creates enumerateKeysAndObjectsUsingBlock:^(NSString *serverTable, NSArray <NSDictionary*>*rows, BOOL * _Nonnull stop) {
+		NSMutableArray *duplicates = [NSMutableArray new];
+		NSUInteger stored = 0;
+		for (NSDictionary *row in rows)
+		{
+			self->_rowsReceived++;
+			NSNumber *idValue = [self idValue:row[@"id"]];
+			BOOL created = [self createRow:row inTable:serverTable fromClient:YES];
+			//a create we already have is a resend (e.g. the reply was lost), then it is an update.
+			if (!created && idValue && [self->clientRows[serverTable] containsObject:idValue])
+				[self updateId:idValue values:row inTable:serverTable fromClient:YES];
+			else if (!created && idValue)
+				[duplicates addObject:idValue];
+			if (duplicates.count == 0)
+				stored++;
+		}
+		[self addError:SyncErrorDuplicateCreate values:duplicates table:serverTable to:errors];
+		[self acknowledge:stored type:SyncTypeCreate table:serverTable ack:ack];
+	}];
+
+	NSDictionary <NSString*, NSArray*> *updates = sync[[@(SyncTypeUpdate) stringValue]];
+	[updates enumerateKeysAndObjectsUsingBlock:^(NSString *serverTable, NSArray <NSDictionary*>*rows, BOOL * _Nonnull stop) {
+		NSMutableArray *conflicts = [NSMutableArray new];
+		NSUInteger stored = 0;
+		for (NSDictionary *row in rows)
+		{
+			self->_rowsReceived++;
+			NSNumber *idValue = [self idValue:row[@"id"]];
+			//the client hasn't seen what others have done, it must merge first.
+			if (idValue && [self->otherChanges[serverTable][idValue] unsignedIntegerValue] > sinceId)
+				[conflicts addObject:idValue];
+			else if (idValue)
+				[self updateId:idValue values:row inTable:serverTable fromClient:YES];	//rows others have deleted are ignored, the delete is in this reply.
+			if (conflicts.count == 0)
+				stored++;
+		}
+		[self addError:SyncErrorUpdateResync values:conflicts table:serverTable to:errors];
+		[self acknowledge:stored type:SyncTypeUpdate table:serverTable ack:ack];
+	}];
+
+	NSMutableDictionary *reply = [NSMutableDictionary new];
+	BOOL continueSync = NO;
+	reply[@"id"] = @([self addChangesSince:sinceId to:reply continueSync:&continueSync]);
+	if (continueSync)
+		reply[@"continue_sync"] = @1;
+	if (errors.count)
+		reply[@"error"] = errors;
+	if (ack)
+	{
+		ack[@"batch"] = batchId;
+		reply[@"ack"] = ack;
+		if (!sync[@"resume"])
+			batchAcks[batchId] = ack;
+	}
+
+	NSError *error = nil;
+	NSData *data = [NSJSONSerialization dataWithJSONObject:reply options:0 error:&error];
+	if (!data)
+		NSLog(@"local server could not encode reply %@", error);
+	return data;
+}
+
+///Add other clients' changes after sinceId to the reply, at most maxChangesPerReply coalesced per row. Returns the change id the client has after this reply.
+- (NSUInteger) addChangesSince:(NSUInteger)sinceId to:(NSMutableDictionary*)reply continueSync:(BOOL*)continueSync
+{
+	NSMutableDictionary <NSString*, NSMutableOrderedSet <NSNumber*>*> *created = [NSMutableDictionary new];
+	NSMutableDictionary <NSString*, NSMutableDictionary <NSString*, NSMutableArray <NSString*>*>*> *updated = [NSMutableDictionary new];
+	NSMutableDictionary <NSString*, NSMutableOrderedSet <NSNumber*>*> *deleted = [NSMutableDictionary new];
+	NSMutableSet <NSString*> *replyTables = [NSMutableSet new];
+
+	NSUInteger changeCount = 0;
+	NSUInteger changeId = MIN(sinceId, changes.count);
+	for (; changeId < changes.count; changeId++)
+	{
+		AutoSyncLocalChange *change = changes[changeId];
+		if (change.fromClient)
+			continue;
+		if (changeCount == self.maxChangesPerReply)
+		{
+			*continueSync = YES;
+			break;
+		}
+		changeCount++;
+
+		NSString *table = change.table;
+		if (![replyTables containsObject:table])
+		{
+			[replyTables addObject:table];
+			created[table] = [NSMutableOrderedSet new];
+			updated[table] = [NSMutableDictionary new];
+			deleted[table] = [NSMutableOrderedSet new];
+		}
+		NSString *idString = change.idValue.stringValue;
+		switch (change.type)
+		{
+			case SyncTypeCreate:
+				[created[table] addObject:change.idValue];
+				[deleted[table] removeObject:change.idValue];
+				break;
+			case SyncTypeUpdate:
+			{
+				//rows created in this reply are sent as they are now.
+				if ([created[table] containsObject:change.idValue])
+					break;
+				if (!updated[table][idString])
+					updated[table][idString] = [NSMutableArray new];
+				NSData *json = [NSJSONSerialization dataWithJSONObject:change.values options:0 error:nil];
+				if (json)
+					[updated[table][idString] addObject:[[NSString alloc] initWithData:json encoding:NSUTF8StringEncoding]];
+				break;
+			}
+			case SyncTypeDelete:
+				[created[table] removeObject:change.idValue];
+				[updated[table] removeObjectForKey:idString];
+				[deleted[table] addObject:change.idValue];
+				break;
+		}
+	}
+
+	for (NSString *table in replyTables)
+	{
+		NSMutableDictionary *section = [NSMutableDictionary new];
+		NSMutableArray *rows = [NSMutableArray new];
+		for (NSNumber *idValue in created[table])
+		{
+			NSDictionary *row = tables[table][idValue];
+			if (row)
+				[rows addObject:row];
+		}
+		if (rows.count)
+			section[[@(SyncTypeStatus) stringValue]] = rows;
+		if (updated[table].count)
+			section[[@(SyncTypeUpdate) stringValue]] = updated[table];
+		if (deleted[table].count)
+			section[[@(SyncTypeDelete) stringValue]] = deleted[table].array;
+		_rowsSent += rows.count + updated[table].count + deleted[table].count;
+		if (section.count)
+			reply[table] = section;
+	}
+	return changeId;
+}
+
+@end
+
+///The memory footprint, which is what the system limits apps by.
+static uint64_t AutoSyncMemoryFootprint(void)
+{
+	task_vm_info_data_t info;
+	mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+	if (task_info(mach_task_self(), TASK_VM_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+		return 0;
+	return info.phys_footprint;
+}
+
+@implementation AutoSyncBenchmark
+
+- (instancetype) initWithHandler:(AutoSyncHandler*)handler server:(AutoSyncLocalServer*)server
+{
+	self = [super init];
+	_handler = handler;
+	_server = server;
+	_timeout = AUTO_SYNC_BENCHMARK_TIMEOUT;
+	return self;
+}
+
+- (void) prepareScenario:(AutoSyncBenchmarkScenario)scenario rows:(NSUInteger)rows
+{
+	AutoSyncLocalServer *server = self.server;
+	if (scenario == AutoSyncBenchmarkInitialSync)
+	{
+		NSDictionary <NSString*, NSArray <NSDictionary*>*>* serverRows = self.serverRows ? self.serverRows(rows) : nil;
+		[serverRows enumerateKeysAndObjectsUsingBlock:^(NSString *serverTable, NSArray <NSDictionary*>*tableRows, BOOL * _Nonnull stop) {
+			[server createRows:tableRows inTable:serverTable];
+		}];
+		return;
+	}
+
+	NSDictionary <NSString*, NSArray <NSNumber*>*>* changedIds = self.localChanges ? self.localChanges(rows) : nil;
+	if (scenario == AutoSyncBenchmarkConflicts)
+	{
+		[changedIds enumerateKeysAndObjectsUsingBlock:^(NSString *serverTable, NSArray <NSNumber*>*ids, BOOL * _Nonnull stop) {
+			NSDictionary *values = self.conflictValues[serverTable];
+			if (values)
+				[server updateIds:ids values:values inTable:serverTable];
+		}];
+	}
+}
+
+- (NSDictionary <NSString*, id>*) runScenario:(AutoSyncBenchmarkScenario)scenario rows:(NSUInteger)rows
+{
+	AutoSyncHandler *handler = self.handler;
+	AutoSyncLocalServer *server = self.server;
+	handler.transport = server;
+	[handler waitForSync];
+
+	//changes made while preparing must not start syncing before we measure.
+	BOOL preventAutoSync = handler.preventAutoSync;
+	handler.preventAutoSync = YES;
+	[self prepareScenario:scenario rows:rows];
+	handler.preventAutoSync = preventAutoSync;
+	[server resetCounters];
+
+	dispatch_semaphore_t done = dispatch_semaphore_create(0);
+	__block NSError *syncError = nil;
+	id observer = [[NSNotificationCenter defaultCenter] addObserverForName:AutoSyncDoneNotification object:nil queue:nil usingBlock:^(NSNotification * _Nonnull note) {
+		syncError = note.userInfo[@"error"];
+		dispatch_semaphore_signal(done);
+	}];
+
+	__block uint64_t peakMemory = AutoSyncMemoryFootprint();
+	dispatch_queue_t sampleQueue = dispatch_queue_create(NULL, DISPATCH_QUEUE_SERIAL);
+	dispatch_source_t sampler = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, sampleQueue);
+	dispatch_source_set_timer(sampler, DISPATCH_TIME_NOW, AUTO_SYNC_BENCHMARK_SAMPLE * NSEC_PER_MSEC, NSEC_PER_MSEC);
+	dispatch_source_set_event_handler(sampler, ^{
+		peakMemory = MAX(peakMemory, AutoSyncMemoryFootprint());
+	});
+	dispatch_resume(sampler);
+
+	NSDate *start = [NSDate date];
+	BOOL started = YES;
+	if (scenario == AutoSyncBenchmarkInitialSync)
+		[handler initialSync];
+	else
+		started = [handler mainSync];
+	BOOL timedOut = started && dispatch_semaphore_wait(done, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.timeout * NSEC_PER_SEC))) != 0;
+	NSTimeInterval seconds = -[start timeIntervalSinceNow];
+
+	dispatch_source_cancel(sampler);
+	dispatch_sync(sampleQueue, ^{
+		peakMemory = MAX(peakMemory, AutoSyncMemoryFootprint());
+	});
+	[[NSNotificationCenter defaultCenter] removeObserver:observer];
+
+	NSUInteger syncedRows = server.rowsReceived + server.rowsSent;
+	NSMutableDictionary *result = [NSMutableDictionary new];
+	result[AutoSyncBenchmarkRows] = @(syncedRows);
+	result[AutoSyncBenchmarkSeconds] = @(seconds);
+	result[AutoSyncBenchmarkRowsPerSecond] = @(seconds > 0 ? syncedRows / seconds : 0);
+	result[AutoSyncBenchmarkRequests] = @(server.requests);
+	result[AutoSyncBenchmarkRequestBytes] = @(server.requestBytes);
+	result[AutoSyncBenchmarkReplyBytes] = @(server.replyBytes);
+	result[AutoSyncBenchmarkPeakMemory] = @(peakMemory);
+	if (!started)
+		syncError = [NSError errorWithDomain:@"AUTO_DB" code:123732 userInfo:@{@"localizedDescription": @"Sync did not start, is syncing on for the current user?"}];
+	else if (timedOut)
+		syncError = [NSError errorWithDomain:@"AUTO_DB" code:123733 userInfo:@{@"localizedDescription": @"Sync did not finish in time."}];
+	if (syncError)
+		result[AutoSyncBenchmarkError] = syncError;
+
+	NSLog(@"sync benchmark %@ rows: %@ rows/s, %@ requests, %@ bytes sent, %@ bytes received, peak memory %@ MB", @(rows), @((NSUInteger)[result[AutoSyncBenchmarkRowsPerSecond] doubleValue]), @(server.requests), @(server.requestBytes), @(server.replyBytes), @(peakMemory / (1024 * 1024)));
+	return result;
+}
+
+@end
@@ -18,25 +18,98 @@ typedef NS_OPTIONS(NSUInteger, SyncOptions)
 	SyncOptionsPartialSync = 1 << 2,
 };
 
-///The sync record is book-keeping to keep track of what should be sent to sync, and what we have sent.
+/**
+ Byte budget for sync batches that grows and shrinks like a congestion window. It starts small and doubles after each full round trip until it reaches the slow start threshold, then grows additively. Failures halve it, and it never grows past what the measured throughput can send within targetLatency.
+ Row sizes are measured per table from the encoded payloads, so batches are sized in bytes no matter how large each table's rows are.
+ */
+@interface AutoSyncWindow : NSObject
+
+///The largest payload we aim for, defaults to 1 MB.
+@property (nonatomic) NSUInteger targetBytes;
+///The smallest payload, defaults to 16 kB.
+@property (nonatomic) NSUInteger minBytes;
+///The longest a round trip should take, defaults to 10 seconds.
+@property (nonatomic) NSTimeInterval targetLatency;
+
+///Budget in encoded bytes for the next batch.
+@property (nonatomic, readonly) NSUInteger windowBytes;
+///Above this the window grows additively instead of doubling.
+@property (nonatomic, readonly) NSUInteger slowStartThreshold;
+///Smoothed bytes per second of completed round trips, 0 until measured.
+@property (nonatomic, readonly) double throughput;
+@property (nonatomic, readonly) NSUInteger lastPayloadBytes;
+@property (nonatomic, readonly) NSTimeInterval lastRoundTrip;
+@property (nonatomic, readonly) NSUInteger successCount, failureCount;
+
+///Estimated encoded size of one change of this table, from earlier batches.
+- (double) estimatedBytesPerRowForTable:(NSString*)table;
+///Remember how large the rows of a table became when encoded.
+- (void) measuredBytes:(double)bytes rows:(NSUInteger)rows forTable:(NSString*)table;
+///A payload of this size was sent and answered, duration is 0 if unknown (e.g. the app was relaunched while waiting).
+- (void) roundTripSucceededWithBytes:(NSUInteger)bytes duration:(NSTimeInterval)duration;
+///A payload of this size could not be sent, e.g. it was too large for the background transfer.
+- (void) roundTripFailedWithBytes:(NSUInteger)bytes;
+
+///All values as a dictionary, for monitoring or logging. Restore with updateWithState:.
+- (NSDictionary<NSString*, id>*) state;
+- (void) updateWithState:(NSDictionary<NSString*, id>*)state;
+
+@end
+
+///Kind of change in the sync log, same values as the matching SyncType.
+typedef NS_ENUM(NSInteger, AutoSyncLogOp)
+{
+	AutoSyncLogOpCreate = 1,
+	AutoSyncLogOpUpdate = 2,
+};
+
+///A batch read from the sync log, changes with startSeq < seq <= endSeq coalesced per row.
+@interface AutoSyncLogBatch : NSObject
+
+@property (nonatomic) long long startSeq, endSeq;
+///The log's generation when it was read, see AutoSyncRecord.logGeneration.
+@property (nonatomic) NSUInteger generation;
+@property (nonatomic) NSMutableDictionary<NSString*, NSMutableArray<NSNumber*> *> *createdTableIds;
+///The changed columns of each id as a bitmask, see columnsForClass: { table_name: { id: mask } }
+@property (nonatomic) NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSNumber*> *> *updatedTableIds;
+
+@end
+
+/**
+ The sync record is book-keeping to keep track of what should be sent to sync, and what we have sent.
+ Pending changes are appended to an indexed log table (table, id, column bitmask, op, seq) in the record's database, so recording a change is one insert and nothing is re-archived when saving. The column of each mask bit is kept in a table next to the log. A batch is the oldest changes up to a seq, which is deleted when the server has acknowledged it.
+ */
 @interface AutoSyncRecord : AutoModel
 
 @property (nonatomic) SyncOptions syncOptions;
-///The max amount of items to sync each time, limit this if items get large...
-@property (nonatomic) NSUInteger currentSyncAmount, maxSyncAmount, minSyncAmount;
+///Last seq of the log in the batch being synced, 0 when no batch is in flight.
+@property (nonatomic) long long syncingSeq;
+///Decides how much to send in each batch, its state is saved with the record.
+@property (nonatomic, readonly) AutoSyncWindow *syncWindow;
 @property (nonatomic, nullable) NSData *data;
 @property (nonatomic, nullable) NSString *apiURL;
 @property (nonatomic) NSNumber *change_id;
 @property (nonatomic, nullable) NSDictionary* deleteTables;
 
-///We want a easier way to keep track of sync-state. So whenever something is changed, that object adds its id to the changed table ids. Then when starting syncing we can copy these ids and clear out the arrays - so if something is changed/created while syncing those changes won't get missed.
+///We want a easier way to keep track of sync-state. So whenever something is changed, that object adds its id to the log. When starting syncing we read the oldest changes as a batch - so if something is changed/created while syncing those changes won't get missed. A batch that was never acknowledged is returned again.
 - (NSMutableDictionary<NSString*, NSMutableArray<NSNumber*> *> *) startCreateSync;
-- (NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSMutableSet*> *> *) startUpdateSync;
+- (NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSNumber*> *> *) startUpdateSync;
+///The columns of a table in mask bit order, for AutoDB valuesForColumnMasks.
+- (NSArray<NSString*> *) columnsForClass:(NSString*)tableClass;
+
+///Read the batch that follows the one in flight without sending it, so it can be prepared while waiting for the server. Nil when there is nothing more.
+- (nullable AutoSyncLogBatch*) nextBatch;
+///Make a batch from nextBatch the one in flight. Returns NO if the log has been rewritten since it was read or older changes are still pending, then read it again with startCreateSync.
+- (BOOL) adoptBatch:(AutoSyncLogBatch*)batch;
+///Increases whenever rows already in the log are changed or removed (ids moved, deletes, a resync), so batches read before are stale. Appending changes does not.
+@property (nonatomic, readonly) NSUInteger logGeneration;
 
 ///Remove everything before resyncing, and add it back later.
 - (void) setupResync;
 - (void) syncCreatedComplete:(NSString*)tableClass;
 - (void) syncUpdatedComplete:(NSString*)tableClass;
+///The server has stored these rows of a batch, remove their changes up to the batch's last seq so only the rest is sent again. Later changes of the same rows stay.
+- (void) acknowledgeIds:(NSArray<NSNumber*> *)ids op:(AutoSyncLogOp)op forClass:(NSString*)tableClass throughSeq:(long long)endSeq;
 - (void) syncComplete;
 ///When getting continue_sync the server has only regarded deleted ids, so we need to send any actions again.
 - (void) reimburseActions;
@@ -47,7 +120,10 @@ typedef NS_OPTIONS(NSUInteger, SyncOptions)
 - (void) addCreatedId:(NSNumber*)id forClass:(NSString*)tableClass;
 - (void) swapCreatedId:(NSNumber*)idValue withOldId:(NSNumber*)oldIdValue forClass:(NSString*)tableClass;
 - (void) addUpdatedId:(NSNumber*)id value:(id)value column:(NSString*)column forClass:(NSString*)tableClass;
-- (void) mergeValues:(NSMutableDictionary*)translatedValues presidentColumns:(NSSet*)presidentColumns id:(NSNumber*)idValue forClass:(NSString*)tableClass;
+///The changed columns of each id we have not synced yet, read once before a section is applied: { id: mask }
+- (NSDictionary<NSNumber*, NSNumber*> *) updateMasksForIds:(NSArray<NSNumber*> *)ids forClass:(NSString*)tableClass;
+///Remove the president columns we have changed (mask from updateMasksForIds:) from values that came from the server.
+- (void) mergeValues:(NSMutableDictionary*)translatedValues presidentColumns:(NSSet*)presidentColumns mask:(long long)mask forClass:(NSString*)tableClass;
 - (void) moveId:(NSNumber*)oldId toId:(NSNumber*)newId forClass:(NSString*)tableClass;
 - (void) markAsCreated:(NSArray*)ids forClass:(NSString*)tableClass;
 
@@ -7,42 +7,218 @@
 //
 
 #import "AutoSyncRecord.h"
+#import "AutoDB.h"
+
+//Pending changes are appended here, seq orders them so a batch is always a range from the start of the log.
+#define AUTO_SYNC_LOG_TABLE @"auto_sync_log"
+//The column of each bit in the log masks, written in the same transaction as the first change that uses it.
+#define AUTO_SYNC_LOG_COLUMNS_TABLE @"auto_sync_log_columns"
+
+//Acknowledged rows are removed from the log this many per statement.
+#define AUTO_SYNC_ACK_IDS 100
+
+//Rows of tables we have not measured yet are guessed to be this large.
+#define AUTO_SYNC_DEFAULT_ROW_BYTES 512
+//Weight of the newest measurement in smoothed values.
+#define AUTO_SYNC_SMOOTHING 0.3
+
+@implementation AutoSyncWindow
+{
+	NSMutableDictionary<NSString*, NSNumber*> *bytesPerRow;
+}
+
+- (instancetype) init
+{
+	self = [super init];
+	_targetBytes = 1024 * 1024;
+	_minBytes = 16 * 1024;
+	_targetLatency = 10;
+	_windowBytes = _targetBytes / 4;
+	_slowStartThreshold = _targetBytes;
+	bytesPerRow = [NSMutableDictionary new];
+	return self;
+}
+
+- (double) estimatedBytesPerRowForTable:(NSString*)table
+{
+	@synchronized (self)
+	{
+		NSNumber *estimate = bytesPerRow[table];
+		return estimate ? estimate.doubleValue : AUTO_SYNC_DEFAULT_ROW_BYTES;
+	}
+}
+
+- (void) measuredBytes:(double)bytes rows:(NSUInteger)rows forTable:(NSString*)table
+{
+	if (rows == 0)
+		return;
+	@synchronized (self)
+	{
+		double measured = bytes / rows;
+		NSNumber *estimate = bytesPerRow[table];
+		bytesPerRow[table] = @(estimate ? estimate.doubleValue * (1 - AUTO_SYNC_SMOOTHING) + measured * AUTO_SYNC_SMOOTHING : measured);
+	}
+}
+
+- (void) roundTripSucceededWithBytes:(NSUInteger)bytes duration:(NSTimeInterval)duration
+{
+	@synchronized (self)
+	{
+		_successCount++;
+		_lastPayloadBytes = bytes;
+		_lastRoundTrip = duration;
+		if (duration > 0 && bytes > 0)
+		{
+			double measured = bytes / duration;
+			_throughput = _throughput > 0 ? _throughput * (1 - AUTO_SYNC_SMOOTHING) + measured * AUTO_SYNC_SMOOTHING : measured;
+		}
+		
+		double window = _windowBytes;
+		if (bytes >= _windowBytes / 2)	//only grow when we actually used the window
+		{
+			if (window < _slowStartThreshold)
+				window = MIN(window * 2, _slowStartThreshold);
+			else
+				window += MAX(_minBytes, _targetBytes / 8);
+		}
+		if (duration > _targetLatency && bytes > 0)
+		{
+			//too slow, shrink smoothly towards what fits within the latency.
+			window = MIN(window, bytes * _targetLatency / duration);
+		}
+		if (_throughput > 0)
+			window = MIN(window, _throughput * _targetLatency);
+		[self setWindow:window];
+	}
+}
+
+- (void) roundTripFailedWithBytes:(NSUInteger)bytes
+{
+	@synchronized (self)
+	{
+		_failureCount++;
+		_lastPayloadBytes = bytes;
+		double failed = bytes > 0 ? MIN(_windowBytes, bytes) : _windowBytes;
+		_slowStartThreshold = MAX(_minBytes, failed / 2);
+		[self setWindow:failed / 2];
+	}
+}
+
+- (void) setWindow:(double)window
+{
+	_windowBytes = (NSUInteger)MAX(_minBytes, MIN(window, _targetBytes));
+}
+
+- (NSDictionary<NSString*, id>*) state
+{
+	@synchronized (self)
+	{
+		return @{
+			@"targetBytes": @(_targetBytes),
+			@"minBytes": @(_minBytes),
+			@"targetLatency": @(_targetLatency),
+			@"windowBytes": @(_windowBytes),
+			@"slowStartThreshold": @(_slowStartThreshold),
+			@"throughput": @(_throughput),
+			@"lastPayloadBytes": @(_lastPayloadBytes),
+			@"lastRoundTrip": @(_lastRoundTrip),
+			@"successCount": @(_successCount),
+			@"failureCount": @(_failureCount),
+			@"bytesPerRow": bytesPerRow.copy,
+		};
+	}
+}
+
+- (void) updateWithState:(NSDictionary<NSString*, id>*)state
+{
+	@synchronized (self)
+	{
+		if (state[@"targetBytes"]) _targetBytes = [state[@"targetBytes"] unsignedIntegerValue];
+		if (state[@"minBytes"]) _minBytes = [state[@"minBytes"] unsignedIntegerValue];
+		if (state[@"targetLatency"]) _targetLatency = [state[@"targetLatency"] doubleValue];
+		if (state[@"windowBytes"]) [self setWindow:[state[@"windowBytes"] doubleValue]];
+		if (state[@"slowStartThreshold"]) _slowStartThreshold = [state[@"slowStartThreshold"] unsignedIntegerValue];
+		_throughput = [state[@"throughput"] doubleValue];
+		_lastPayloadBytes = [state[@"lastPayloadBytes"] unsignedIntegerValue];
+		_lastRoundTrip = [state[@"lastRoundTrip"] doubleValue];
+		_successCount = [state[@"successCount"] unsignedIntegerValue];
+		_failureCount = [state[@"failureCount"] unsignedIntegerValue];
+		if ([state[@"bytesPerRow"] isKindOfClass:[NSDictionary class]])
+			[bytesPerRow setDictionary:state[@"bytesPerRow"]];
+	}
+}
+
+@end
+
+@implementation AutoSyncLogBatch
+@end
 
 @implementation AutoSyncRecord
 {
-	///{ table_name: [1,2,3...] }
-	NSMutableDictionary<NSString*, NSMutableArray<NSNumber*> *> *createdTableIds;
-	///{ table_name: [1,2,3...] }
-	NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSMutableSet *> *> *updatedTableIds;
+	///The batch currently being synced, as read from the log: { table_name: [1,2,3...] }
 	NSMutableDictionary<NSString*, NSMutableArray<NSNumber*> *> *syncingCreatedTableIds;
-	NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSMutableSet *> *> *syncingUpdatedTableIds;
+	///{ table_name: { id: mask } }
+	NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSNumber *> *> *syncingUpdatedTableIds;
+	///The bit of each column in the log masks is its index here, columns are only appended so old masks stay valid: { table_name: [column, column...] }
+	NSMutableDictionary<NSString*, NSMutableArray<NSString*> *> *logColumns;
+	///logColumns the other way around, recording a change only looks up its bit: { table_name: { column: mask } }
+	NSMutableDictionary<NSString*, NSMutableDictionary<NSString*, NSNumber*> *> *logColumnMasks;
 	dispatch_queue_t queue;
-	NSUInteger amountLeft;
+	BOOL hasSyncingBatch;
 }
 
 - (instancetype)init
 {
 	self = [super init];
 	queue = dispatch_queue_create(NULL, DISPATCH_QUEUE_SERIAL);
+	logColumns = [NSMutableDictionary new];
+	logColumnMasks = [NSMutableDictionary new];
+	syncingCreatedTableIds = [NSMutableDictionary new];
+	syncingUpdatedTableIds = [NSMutableDictionary new];
+	_syncWindow = [AutoSyncWindow new];
 	return self;
 }
 
 - (void)awakeFromFetch
 {
-	if (!_currentSyncAmount || _currentSyncAmount == 1000)
-	{
-		_minSyncAmount = 0;
-		_maxSyncAmount = 2500;
-		_currentSyncAmount = _maxSyncAmount;
-	}
-	
+	NSMutableDictionary<NSString*, NSMutableArray<NSString*> *> *storedColumns = [NSMutableDictionary new];
+	[self.class inDatabase:^(AFMDatabase * _Nonnull db) {
+
+		[db executeUpdate:[NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ (seq INTEGER PRIMARY KEY AUTOINCREMENT, table_name TEXT NOT NULL, row_id INTEGER NOT NULL, op INTEGER NOT NULL, columns INTEGER NOT NULL DEFAULT 0)", AUTO_SYNC_LOG_TABLE]];
+		if (![db executeUpdate:[NSString stringWithFormat:@"CREATE INDEX IF NOT EXISTS %@_row ON %@ (table_name, row_id)", AUTO_SYNC_LOG_TABLE, AUTO_SYNC_LOG_TABLE]] ||
+			![db executeUpdate:[NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS %@ (table_name TEXT NOT NULL, position INTEGER NOT NULL, column_name TEXT NOT NULL, PRIMARY KEY(table_name, position))", AUTO_SYNC_LOG_COLUMNS_TABLE]])
+			NSLog(@"Could not create sync log: %@", db.lastError);
+		
+		AFMResultSet *result = [db executeQuery:[NSString stringWithFormat:@"SELECT table_name, position, column_name FROM %@ ORDER BY table_name, position", AUTO_SYNC_LOG_COLUMNS_TABLE]];
+		while ([result next])
+		{
+			NSString *table = [result stringForColumnIndex:0];
+			NSUInteger position = (NSUInteger)[result longLongIntForColumnIndex:1];
+			NSMutableArray *columns = storedColumns[table];
+			if (!columns)
+			{
+				columns = [NSMutableArray new];
+				storedColumns[table] = columns;
+			}
+			//a gap is a column whose first change never got stored, no mask uses it.
+			while (columns.count < position)
+				[columns addObject:@""];
+			[columns addObject:[result stringForColumnIndex:2]];
+		}
+		[result close];
+	}];
+	dispatch_sync(queue, ^{
+		[logColumns addEntriesFromDictionary:storedColumns];
+		[logColumnMasks removeAllObjects];
+	});
+
 	if (_data)
 	{
 		NSError *error = nil;
 		NSDictionary *data = nil;
 		if (@available(iOS 11.0, *))
 		{
-			data = [NSKeyedUnarchiver unarchivedObjectOfClasses:[NSSet setWithObjects:[NSMutableDictionary class], [NSMutableSet class], [NSMutableArray class], nil] fromData:_data error:&error];
+			data = [NSKeyedUnarchiver unarchivedObjectOfClasses:[NSSet setWithObjects:[NSDictionary class], [NSSet class], [NSArray class], [NSMutableDictionary class], [NSMutableSet class], [NSMutableArray class], [NSString class], [NSNumber class], nil] fromData:_data error:&error];
 		}
 		else
 		{
@@ -50,298 +226,492 @@
 			data = [NSKeyedUnarchiver unarchiveObjectWithData:_data];
 		}
 		if (!data || error) NSLog(@"error when unarchiving %@", error);
-		
-		createdTableIds = data[@"createdTableIds"];
-		syncingCreatedTableIds = data[@"syncingCreatedTableIds"];
+
 		_deleteTables = data[@"deleteTables"];
-		
-		updatedTableIds = data[@"updatedTableIds"];
-		syncingUpdatedTableIds = data[@"syncingUpdatedTableIds"];
-	}
-	if (!createdTableIds)
-	{
-		createdTableIds = [NSMutableDictionary new];
-		updatedTableIds = [NSMutableDictionary new];
+		if (data[@"logColumns"])
+		{
+			[self migrateArchivedColumns:data[@"logColumns"]];
+		}
+		if (data[@"syncWindow"])
+			[_syncWindow updateWithState:data[@"syncWindow"]];
+
+		if (data[@"createdTableIds"] || data[@"updatedTableIds"])
+		{
+			[self migrateArchivedChanges:data];
+		}
 	}
-	if (!syncingCreatedTableIds)
-		syncingCreatedTableIds = [NSMutableDictionary new];
-	if (!syncingUpdatedTableIds)
-		syncingUpdatedTableIds = [NSMutableDictionary new];
 	[super awakeFromFetch];
 }
 
-+ (NSDictionary *)defaultValues
+///Records from before the columns table archived the mask columns, store those of tables it doesn't have yet.
+- (void) migrateArchivedColumns:(NSDictionary<NSString*, NSArray<NSString*> *> *)archivedColumns
 {
-	return @{@"change_id" : @0};
+	NSMutableDictionary<NSString*, NSArray<NSString*> *> *missingColumns = [NSMutableDictionary new];
+	dispatch_sync(queue, ^{
+		[archivedColumns enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull table, NSArray<NSString *> * _Nonnull columns, BOOL * _Nonnull stop) {
+			if (self->logColumns[table])
+				return;
+			self->logColumns[table] = columns.mutableCopy;
+			missingColumns[table] = columns;
+		}];
+		[logColumnMasks removeAllObjects];
+	});
+	[self.class inDatabase:^(AFMDatabase * _Nonnull db) {
+
+		[db beginTransaction];
+		[missingColumns enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull table, NSArray<NSString *> * _Nonnull columns, BOOL * _Nonnull stop) {
+			[columns enumerateObjectsUsingBlock:^(NSString * _Nonnull column, NSUInteger index, BOOL * _Nonnull stop) {
+				[self storeColumn:column position:index forClass:table inDB:db];
+			}];
+		}];
+		[db commit];
+	}];
+	self.hasChanges = YES;	//write the archive again without the columns
 }
 
-- (void) deleteIds:(NSArray*)ids forClass:(NSString*)tableClass
+///Records from before the log kept all changes in the archive, move them to the log once. Changes that were being synced go first since they are older.
+- (void) migrateArchivedChanges:(NSDictionary*)data
 {
-	dispatch_sync(queue, ^{
-		
-		if (updatedTableIds[tableClass].count || syncingUpdatedTableIds[tableClass].count)
+	[self.class inDatabase:^(AFMDatabase * _Nonnull db) {
+
+		[db beginTransaction];
+		for (NSArray<NSString*> *keys in @[@[@"syncingCreatedTableIds", @"syncingUpdatedTableIds"], @[@"createdTableIds", @"updatedTableIds"]])
 		{
-			for (__strong NSNumber *idValue in ids)
-			{
-				if ([idValue isKindOfClass:[NSString class]])
-				{
-					idValue = @([((NSString*)idValue) integerValue]);
-				}
-				[updatedTableIds[tableClass] removeObjectForKey:idValue];
-				[syncingUpdatedTableIds[tableClass] removeObjectForKey:idValue];
-			}
+			NSDictionary<NSString*, NSArray<NSNumber*> *> *createdTableIds = data[keys[0]];
+			[createdTableIds enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull table, NSArray<NSNumber *> * _Nonnull ids, BOOL * _Nonnull stop) {
+				[self appendIds:ids forClass:table op:AutoSyncLogOpCreate columns:0 inDB:db];
+			}];
+			NSDictionary<NSString*, NSDictionary<NSNumber*, NSSet*> *> *updatedTableIds = data[keys[1]];
+			[updatedTableIds enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull table, NSDictionary<NSNumber *,NSSet *> * _Nonnull ids, BOOL * _Nonnull stop) {
+				[ids enumerateKeysAndObjectsUsingBlock:^(NSNumber * _Nonnull idValue, NSSet * _Nonnull columns, BOOL * _Nonnull stop) {
+					long long mask = 0;
+					for (NSString *column in columns)
+					{
+						NSUInteger newPosition = NSNotFound;
+						mask |= [self maskForColumn:column forClass:table newPosition:&newPosition];
+						if (newPosition != NSNotFound)
+							[self storeColumn:column position:newPosition forClass:table inDB:db];
+					}
+					[self appendIds:@[idValue] forClass:table op:AutoSyncLogOpUpdate columns:mask inDB:db];
+				}];
+			}];
 		}
-		if (createdTableIds[tableClass].count)
-			[createdTableIds[tableClass] removeObjectsInArray:ids];
-		if (syncingCreatedTableIds[tableClass].count)
-			[syncingCreatedTableIds[tableClass] removeObjectsInArray:ids];
-	});
+		[db commit];
+	}];
+	self.syncingSeq = 0;
+	self.hasChanges = YES;	//write the archive again without the changes
 }
 
-- (void) moveId:(NSNumber*)oldId toId:(NSNumber*)newId forClass:(NSString*)tableClass
++ (NSDictionary *)defaultValues
+{
+	return @{@"change_id" : @0};
+}
+
+#pragma mark - the log
+
+///Bit for a column in the log masks. A column without one is given the next, newPosition is then its position - to be stored with the change that uses it.
+- (long long) maskForColumn:(NSString*)column forClass:(NSString*)tableClass newPosition:(NSUInteger*)newPosition
 {
+	__block NSNumber *mask = nil;
 	dispatch_sync(queue, ^{
-		for (NSDictionary *table in @[syncingUpdatedTableIds, updatedTableIds])
+		NSMutableDictionary<NSString*, NSNumber*> *masks = logColumnMasks[tableClass];
+		NSMutableArray *columns = logColumns[tableClass];
+		if (!masks)
 		{
-			id object = table[tableClass][oldId];
-			if (object)
-			{
-				table[tableClass][newId] = object;
-				[table[tableClass] removeObjectForKey:oldId];
-			}
+			//the columns table only has the columns.
+			masks = [NSMutableDictionary new];
+			[columns enumerateObjectsUsingBlock:^(NSString *logColumn, NSUInteger index, BOOL * _Nonnull stop) {
+				masks[logColumn] = @((long long)(1ULL << MIN(index, AUTO_COLUMN_MASK_LAST_BIT)));
+			}];
+			logColumnMasks[tableClass] = masks;
 		}
-		//if item currently being created - remove it
-		NSMutableArray *ids = syncingCreatedTableIds[tableClass];
-		if (ids)
+		mask = masks[column];
+		if (!mask)
 		{
-			NSUInteger index = [ids indexOfObject:oldId];
-			if (index != NSNotFound)
+			if (!columns)
 			{
-				[ids removeObjectAtIndex:index];
+				columns = [NSMutableArray new];
+				logColumns[tableClass] = columns;
 			}
-		}
-		//item must sync its new id.
-		ids = syncingCreatedTableIds[tableClass];
-		if (ids)
-		{
-			NSUInteger index = [ids indexOfObject:oldId];
-			if (index != NSNotFound)
-			{
-				[ids removeObjectAtIndex:index];
-				[ids addObject:newId];
-			}
-			else
-				[ids addObject:newId];
+			mask = @((long long)(1ULL << MIN(columns.count, AUTO_COLUMN_MASK_LAST_BIT)));
+			masks[column] = mask;
+			*newPosition = columns.count;
+			[columns addObject:column];
 		}
 	});
+	return mask.longLongValue;
 }
 
-- (void) markAsCreated:(NSArray*)ids forClass:(NSString*)tableClass
+- (void) storeColumn:(NSString*)column position:(NSUInteger)position forClass:(NSString*)tableClass inDB:(AFMDatabase*)db
 {
-	dispatch_sync(queue, ^{
-		[syncingCreatedTableIds[tableClass] removeObjectsInArray:ids];
-		[createdTableIds[tableClass] removeObjectsInArray:ids];
-	});
-}			
+	if (![db executeUpdate:[NSString stringWithFormat:@"INSERT OR REPLACE INTO %@ (table_name, position, column_name) VALUES (?, ?, ?)", AUTO_SYNC_LOG_COLUMNS_TABLE], tableClass, @(position), column])
+		NSLog(@"Could not record sync column for %@: %@", tableClass, db.lastError);
+}
 
-- (void) mergeValues:(NSMutableDictionary*)translatedValues presidentColumns:(NSSet*)presidentColumns id:(NSNumber*)idValue forClass:(NSString*)tableClass
+- (NSArray<NSString*> *) columnsForClass:(NSString*)tableClass
 {
+	__block NSArray *columns = nil;
 	dispatch_sync(queue, ^{
-		NSMutableSet *updatedTable = updatedTableIds[tableClass][idValue].mutableCopy;
-		NSSet *syncingTable = syncingUpdatedTableIds[tableClass][idValue];
-		[updatedTable unionSet:syncingTable];
-		
-		if (!updatedTable && !syncingTable)
-			return;	//we have no changes.
-		
-		//skip some cases, e.g. if we have changed isRead before syncing was done BUT now sync want's to change it back - don't agree.
-		[updatedTable intersectSet:presidentColumns];
-		
-		//last change takes president, so here we guess that the client is more recent.
-		if (updatedTable.count)
-			[translatedValues removeObjectsForKeys:updatedTable.allObjects];
+		columns = [logColumns[tableClass] copy];
 	});
+	return columns ?: @[];
 }
 
-- (void) bulkAddCreatedIds:(NSArray <NSNumber*>*)bulkIds forClass:(NSString*)tableClass
+- (NSMutableSet*) columnsForMask:(long long)mask forClass:(NSString*)tableClass
 {
+	NSMutableSet *result = [NSMutableSet new];
 	dispatch_sync(queue, ^{
-		NSMutableArray *ids = createdTableIds[tableClass];
-		if (!ids)
+		NSArray *columns = logColumns[tableClass];
+		for (NSUInteger index = 0; index < columns.count; index++)
 		{
-			ids = [NSMutableArray new];
-			createdTableIds[tableClass] = ids;
+			if ((unsigned long long)mask & (1ULL << MIN(index, AUTO_COLUMN_MASK_LAST_BIT)))
+				[result addObject:columns[index]];
 		}
-		[ids addObjectsFromArray:bulkIds];
 	});
-	self.hasChanges = YES;
+	return result;
 }
 
-- (void) addCreatedId:(NSNumber*)id forClass:(NSString*)tableClass
+- (void) appendIds:(NSArray*)ids forClass:(NSString*)tableClass op:(AutoSyncLogOp)op columns:(long long)columns inDB:(AFMDatabase*)db
 {
-	dispatch_sync(queue, ^{
-		NSMutableArray *ids = createdTableIds[tableClass];
-		if (!ids)
+	NSString *insertQuery = [NSString stringWithFormat:@"INSERT INTO %@ (table_name, row_id, op, columns) VALUES (?, ?, ?, ?)", AUTO_SYNC_LOG_TABLE];
+	for (NSNumber *idValue in ids)
+	{
+		if (![db executeUpdate:insertQuery, tableClass, idValue, @(op), @(columns)])
 		{
-			ids = [NSMutableArray new];
-			createdTableIds[tableClass] = ids;
+			NSLog(@"Could not record sync change for %@: %@", tableClass, db.lastError);
+			return;
 		}
-		[ids addObject:id];
+	}
+}
+
+///Recording is async, the log is only read from the same db-thread so no change can be missed.
+- (void) appendIds:(NSArray*)ids forClass:(NSString*)tableClass op:(AutoSyncLogOp)op columns:(long long)columns
+{
+	[self.class executeInDatabase:^(AFMDatabase * _Nonnull db) {
+
+		BOOL transaction = ids.count > 1 && !db.inTransaction;
+		if (transaction)
+			[db beginTransaction];
+		[self appendIds:ids forClass:tableClass op:op columns:columns inDB:db];
+		if (transaction)
+			[db commit];
+	}];
+}
+
+- (void) deleteIds:(NSArray*)ids forClass:(NSString*)tableClass
+{
+	NSMutableArray *numberIds = [[NSMutableArray alloc] initWithCapacity:ids.count];
+	for (NSNumber *idValue in ids)
+	{
+		if ([idValue isKindOfClass:[NSString class]])
+			[numberIds addObject:@([((NSString*)idValue) longLongValue])];
+		else
+			[numberIds addObject:idValue];
+	}
+	dispatch_sync(queue, ^{
+		[syncingUpdatedTableIds[tableClass] removeObjectsForKeys:numberIds];
+		[syncingCreatedTableIds[tableClass] removeObjectsInArray:numberIds];
 	});
-	self.hasChanges = YES;
+	[self rewroteLog];
+	[self.class executeInDatabase:^(AFMDatabase * _Nonnull db) {
+		[db executeUpdate:[NSString stringWithFormat:@"DELETE FROM %@ WHERE table_name = ? AND row_id IN (%@)", AUTO_SYNC_LOG_TABLE, [AutoModel questionMarks:numberIds.count]] withArgumentsInArray:[@[tableClass] arrayByAddingObjectsFromArray:numberIds]];
+	}];
 }
 
-- (void) swapCreatedId:(NSNumber*)idValue withOldId:(NSNumber*)oldIdValue forClass:(NSString*)tableClass
+- (void) moveId:(NSNumber*)oldId toId:(NSNumber*)newId forClass:(NSString*)tableClass
 {
 	dispatch_sync(queue, ^{
-		NSMutableArray *ids = createdTableIds[tableClass];
-		if (!ids)
-		{
-			ids = [NSMutableArray new];
-			createdTableIds[tableClass] = ids;
-			[ids addObject:idValue];
-		}
-		else
+		NSMutableDictionary *updatedIds = syncingUpdatedTableIds[tableClass];
+		id object = updatedIds[oldId];
+		if (object)
 		{
-			[ids removeObject:oldIdValue];
-			[ids addObject:idValue];
+			updatedIds[newId] = object;
+			[updatedIds removeObjectForKey:oldId];
 		}
-		
+		//if item currently being created - remove it
+		[syncingCreatedTableIds[tableClass] removeObject:oldId];
 	});
-	self.hasChanges = YES;
+	[self rewroteLog];
+	[self.class executeInDatabase:^(AFMDatabase * _Nonnull db) {
+
+		[db executeUpdate:[NSString stringWithFormat:@"UPDATE %@ SET row_id = ? WHERE table_name = ? AND row_id = ?", AUTO_SYNC_LOG_TABLE], newId, tableClass, oldId];
+		//item must sync its new id.
+		[db executeUpdate:[NSString stringWithFormat:@"DELETE FROM %@ WHERE table_name = ? AND row_id = ? AND op = %i", AUTO_SYNC_LOG_TABLE, (int)AutoSyncLogOpCreate], tableClass, newId];
+		[self appendIds:@[newId] forClass:tableClass op:AutoSyncLogOpCreate columns:0 inDB:db];
+	}];
 }
 
-- (void) addUpdatedId:(NSNumber*)idValue value:(id)value column:(NSString*)column forClass:(NSString*)tableClass
+- (void) markAsCreated:(NSArray*)ids forClass:(NSString*)tableClass
 {
 	dispatch_sync(queue, ^{
-		
-		if ([createdTableIds[tableClass] containsObject:idValue])
-		{
-			return;
-		}
-		NSMutableDictionary *ids = updatedTableIds[tableClass];
-		if (!ids)
+		[syncingCreatedTableIds[tableClass] removeObjectsInArray:ids];
+	});
+	[self rewroteLog];
+	[self.class executeInDatabase:^(AFMDatabase * _Nonnull db) {
+		[db executeUpdate:[NSString stringWithFormat:@"DELETE FROM %@ WHERE table_name = ? AND op = %i AND row_id IN (%@)", AUTO_SYNC_LOG_TABLE, (int)AutoSyncLogOpCreate, [AutoModel questionMarks:ids.count]] withArgumentsInArray:[@[tableClass] arrayByAddingObjectsFromArray:ids]];
+	}];
+}
+
+///The changed columns of the ids we have in the log, both pending and syncing changes are there so one query finds them.
+- (NSDictionary<NSNumber*, NSNumber*> *) updateMasksForIds:(NSArray<NSNumber*> *)ids forClass:(NSString*)tableClass
+{
+	NSMutableDictionary<NSNumber*, NSNumber*> *masks = [NSMutableDictionary new];
+	if (ids.count == 0)
+		return masks;
+	[self.class inDatabase:^(AFMDatabase * _Nonnull db) {
+		AFMResultSet *result = [db executeQuery:[NSString stringWithFormat:@"SELECT row_id, columns FROM %@ WHERE table_name = ? AND op = %i AND row_id IN (%@)", AUTO_SYNC_LOG_TABLE, (int)AutoSyncLogOpUpdate, [AutoModel questionMarks:ids.count]] withArgumentsInArray:[@[tableClass] arrayByAddingObjectsFromArray:ids]];
+		while ([result next])
 		{
-			ids = [NSMutableDictionary new];
-			updatedTableIds[tableClass] = ids;
+			NSNumber *idValue = @([result longLongIntForColumnIndex:0]);
+			masks[idValue] = @([masks[idValue] longLongValue] | [result longLongIntForColumnIndex:1]);
 		}
-		NSMutableSet *row = ids[idValue];
-		if (!row)
+		[result close];
+	}];
+	return masks;
+}
+
+- (void) mergeValues:(NSMutableDictionary*)translatedValues presidentColumns:(NSSet*)presidentColumns mask:(long long)mask forClass:(NSString*)tableClass
+{
+	if (!mask)
+		return;	//we have no changes.
+
+	//skip some cases, e.g. if we have changed isRead before syncing was done BUT now sync want's to change it back - don't agree.
+	NSMutableSet *updatedTable = [self columnsForMask:mask forClass:tableClass];
+	[updatedTable intersectSet:presidentColumns];
+
+	//last change takes president, so here we guess that the client is more recent.
+	if (updatedTable.count)
+		[translatedValues removeObjectsForKeys:updatedTable.allObjects];
+}
+
+- (void) bulkAddCreatedIds:(NSArray <NSNumber*>*)bulkIds forClass:(NSString*)tableClass
+{
+	[self appendIds:bulkIds forClass:tableClass op:AutoSyncLogOpCreate columns:0];
+}
+
+- (void) addCreatedId:(NSNumber*)id forClass:(NSString*)tableClass
+{
+	[self appendIds:@[id] forClass:tableClass op:AutoSyncLogOpCreate columns:0];
+}
+
+- (void) swapCreatedId:(NSNumber*)idValue withOldId:(NSNumber*)oldIdValue forClass:(NSString*)tableClass
+{
+	[self rewroteLog];
+	[self.class executeInDatabase:^(AFMDatabase * _Nonnull db) {
+
+		[db executeUpdate:[NSString stringWithFormat:@"UPDATE %@ SET row_id = ? WHERE table_name = ? AND row_id = ? AND op = %i", AUTO_SYNC_LOG_TABLE, (int)AutoSyncLogOpCreate], idValue, tableClass, oldIdValue];
+		if (db.changes == 0)
 		{
-			row = [NSMutableSet new];
-			ids[idValue] = row;
+			[self appendIds:@[idValue] forClass:tableClass op:AutoSyncLogOpCreate columns:0 inDB:db];
 		}
-		[row addObject:column];
-	});
-	self.hasChanges = YES;
+	}];
+}
+
+- (void) addUpdatedId:(NSNumber*)idValue value:(id)value column:(NSString*)column forClass:(NSString*)tableClass
+{
+	//updates of created objects are skipped when reading the batch, the whole object is sent anyway.
+	NSUInteger newPosition = NSNotFound;
+	long long mask = [self maskForColumn:column forClass:tableClass newPosition:&newPosition];
+	if (newPosition == NSNotFound)
+	{
+		[self appendIds:@[idValue] forClass:tableClass op:AutoSyncLogOpUpdate columns:mask];
+		return;
+	}
+	
+	//a new column, its bit is stored together with the change so the log never has a mask we can't read.
+	[self.class executeInDatabase:^(AFMDatabase * _Nonnull db) {
+
+		BOOL transaction = !db.inTransaction;
+		if (transaction)
+			[db beginTransaction];
+		[self storeColumn:column position:newPosition forClass:tableClass inDB:db];
+		[self appendIds:@[idValue] forClass:tableClass op:AutoSyncLogOpUpdate columns:mask inDB:db];
+		if (transaction)
+			[db commit];
+	}];
 }
 
 #pragma mark - sending values
 
-//return the old values or start new sync build.
-- (NSDictionary*) startCreateSync
+///Read the batch from the log, the one in flight if it never got acknowledged - otherwise the oldest changes that fit in the sync window.
+- (void) loadSyncingBatch
 {
-	//if the old tables did not get through, or wasn't marked - return them before building new
-	dispatch_sync(queue, ^{
-		
-		BOOL escape = NO;
-		if (syncingCreatedTableIds.count)
+	__block AutoSyncLogBatch *batch = nil;
+	[self.class inDatabase:^(AFMDatabase * _Nonnull db) {
+
+		long long endSeq = self.syncingSeq;
+		if (endSeq > 0)
 		{
-			for (NSString *table in syncingCreatedTableIds)
-			{
-				if ([syncingCreatedTableIds[table] count])
-				{
-					escape = YES;
-				}
-			}
+			//everything in flight may have been acknowledged table by table, then start a new batch.
+			AFMResultSet *result = [db executeQuery:[NSString stringWithFormat:@"SELECT 1 FROM %@ WHERE seq <= ? LIMIT 1", AUTO_SYNC_LOG_TABLE], @(endSeq)];
+			if (![result next])
+				endSeq = 0;
+			[result close];
 		}
-		if (escape)
+		if (endSeq == 0)
+			endSeq = [self batchEndAfterSeq:0 inDB:db];
+		batch = [self readBatchAfterSeq:0 endSeq:endSeq inDB:db];
+		[self markSyncingBatch:batch inDB:db];
+	}];
+	[self setSyncingBatch:batch];
+}
+
+- (AutoSyncLogBatch*) nextBatch
+{
+	__block AutoSyncLogBatch *batch = nil;
+	[self.class inDatabase:^(AFMDatabase * _Nonnull db) {
+
+		long long startSeq = self.syncingSeq;
+		long long endSeq = [self batchEndAfterSeq:startSeq inDB:db];
+		if (endSeq > startSeq)
+			batch = [self readBatchAfterSeq:startSeq endSeq:endSeq inDB:db];
+	}];
+	return batch;
+}
+
+- (BOOL) adoptBatch:(AutoSyncLogBatch*)batch
+{
+	__block BOOL adopted = NO;
+	[self.class inDatabase:^(AFMDatabase * _Nonnull db) {
+
+		if (self.syncingSeq != 0 || batch.generation != self.logGeneration)
+			return;
+		//the batch before must be acknowledged, otherwise its changes would be skipped.
+		AFMResultSet *result = [db executeQuery:[NSString stringWithFormat:@"SELECT 1 FROM %@ WHERE seq <= ? LIMIT 1", AUTO_SYNC_LOG_TABLE], @(batch.startSeq)];
+		BOOL hasOlder = [result next];
+		[result close];
+		if (hasOlder)
+			return;
+		[self markSyncingBatch:batch inDB:db];
+		adopted = YES;
+	}];
+	if (adopted)
+		[self setSyncingBatch:batch];
+	return adopted;
+}
+
+///The last seq of the oldest changes after startSeq whose estimated size fills the window, at least one. Returns startSeq if there are none.
+- (long long) batchEndAfterSeq:(long long)startSeq inDB:(AFMDatabase*)db
+{
+	long long endSeq = startSeq;
+	double budget = self.syncWindow.windowBytes;
+	NSMutableDictionary<NSString*, NSNumber*> *estimates = [NSMutableDictionary new];
+	AFMResultSet *result = [db executeQuery:[NSString stringWithFormat:@"SELECT seq, table_name FROM %@ WHERE seq > ? ORDER BY seq", AUTO_SYNC_LOG_TABLE], @(startSeq)];
+	while ([result next])
+	{
+		NSString *table = [result stringForColumnIndex:1];
+		NSNumber *estimate = estimates[table];
+		if (!estimate)
 		{
-			if (createdTableIds.count)
-				self.syncOptions |= SyncOptionsPartialSync;
-			amountLeft = 0;	//prevent update when we have create
-			return;	//we still have stuff to do
+			estimate = @([self.syncWindow estimatedBytesPerRowForTable:table]);
+			estimates[table] = estimate;
 		}
-		amountLeft = _currentSyncAmount;
-		[syncingCreatedTableIds removeAllObjects];
-		
-		[createdTableIds.copy enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull table, NSMutableArray<NSNumber *> * _Nonnull ids, BOOL * _Nonnull stop) {
-			if (ids.count > amountLeft)
+		endSeq = [result longLongIntForColumnIndex:0];
+		budget -= estimate.doubleValue;
+		if (budget <= 0)
+			break;
+	}
+	[result close];
+	return endSeq;
+}
+
+- (AutoSyncLogBatch*) readBatchAfterSeq:(long long)startSeq endSeq:(long long)endSeq inDB:(AFMDatabase*)db
+{
+	NSMutableDictionary<NSString*, NSMutableArray<NSNumber*> *> *createdTableIds = [NSMutableDictionary new];
+	NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSNumber *> *> *updatedMasks = [NSMutableDictionary new];
+	NSMutableDictionary<NSString*, NSMutableSet<NSNumber*> *> *createdSets = [NSMutableDictionary new];
+	AFMResultSet *result = [db executeQuery:[NSString stringWithFormat:@"SELECT table_name, row_id, op, columns FROM %@ WHERE seq > ? AND seq <= ? ORDER BY seq", AUTO_SYNC_LOG_TABLE], @(startSeq), @(endSeq)];
+	while ([result next])
+	{
+		NSString *table = [result stringForColumnIndex:0];
+		NSNumber *idValue = @([result longLongIntForColumnIndex:1]);
+		if ([result longLongIntForColumnIndex:2] == AutoSyncLogOpCreate)
+		{
+			NSMutableSet *created = createdSets[table];
+			if (!created)
 			{
-				NSRange range = NSMakeRange(0, amountLeft);
-				syncingCreatedTableIds[table] = [ids subarrayWithRange:range].mutableCopy;
-				[ids removeObjectsInRange:range];
-				*stop = YES;
-				amountLeft = 0;
-				self.syncOptions |= SyncOptionsPartialSync;
+				created = [NSMutableSet new];
+				createdSets[table] = created;
+				createdTableIds[table] = [NSMutableArray new];
 			}
-			else
+			if (![created containsObject:idValue])
 			{
-				[createdTableIds removeObjectForKey:table];
-				syncingCreatedTableIds[table] = ids;
-				amountLeft -= ids.count;
+				[created addObject:idValue];
+				[createdTableIds[table] addObject:idValue];
 			}
-		}];
+			[updatedMasks[table] removeObjectForKey:idValue];
+		}
+		else if (![createdSets[table] containsObject:idValue])
+		{
+			NSMutableDictionary *masks = updatedMasks[table];
+			if (!masks)
+			{
+				masks = [NSMutableDictionary new];
+				updatedMasks[table] = masks;
+			}
+			masks[idValue] = @([masks[idValue] longLongValue] | [result longLongIntForColumnIndex:3]);
+		}
+	}
+	[result close];
+
+	//masks stay masks, columns are only looked up when fetching their values.
+	NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSNumber *> *> *updatedTableIds = [NSMutableDictionary new];
+	[updatedMasks enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull table, NSMutableDictionary<NSNumber *,NSNumber *> * _Nonnull masks, BOOL * _Nonnull stop) {
+		if (masks.count)
+			updatedTableIds[table] = masks;
+	}];
+
+	AutoSyncLogBatch *batch = [AutoSyncLogBatch new];
+	batch.startSeq = startSeq;
+	batch.endSeq = endSeq;
+	batch.generation = self.logGeneration;
+	batch.createdTableIds = createdTableIds;
+	batch.updatedTableIds = updatedTableIds;
+	return batch;
+}
+
+- (void) markSyncingBatch:(AutoSyncLogBatch*)batch inDB:(AFMDatabase*)db
+{
+	if (batch.endSeq != self.syncingSeq)
+		self.syncingSeq = batch.endSeq;
+	AFMResultSet *result = [db executeQuery:[NSString stringWithFormat:@"SELECT 1 FROM %@ WHERE seq > ? LIMIT 1", AUTO_SYNC_LOG_TABLE], @(batch.endSeq)];
+	if ([result next])
+		self.syncOptions |= SyncOptionsPartialSync;
+	[result close];
+}
+
+- (void) setSyncingBatch:(AutoSyncLogBatch*)batch
+{
+	dispatch_sync(queue, ^{
+		syncingCreatedTableIds = batch.createdTableIds;
+		syncingUpdatedTableIds = batch.updatedTableIds;
+		hasSyncingBatch = YES;
 	});
-	
-	if (syncingCreatedTableIds.count)
+}
+
+- (void) rewroteLog
+{
+	@synchronized (self)
 	{
-		self.hasChanges = YES;
+		_logGeneration++;
 	}
+}
+
+//return the old values or start new sync build.
+- (NSDictionary*) startCreateSync
+{
+	[self loadSyncingBatch];
 	return syncingCreatedTableIds;
 }
 
 - (NSDictionary*) startUpdateSync
 {
+	__block BOOL hasBatch;
 	dispatch_sync(queue, ^{
-		
-		if (syncingUpdatedTableIds.count)
-		{
-			for (NSString *table in syncingUpdatedTableIds)
-			{
-				if ([syncingUpdatedTableIds[table] count])
-				{
-					if (updatedTableIds.count)
-						self.syncOptions |= SyncOptionsPartialSync;
-					return;	//we still have stuff to do
-				}
-			}
-		}
-		
-		[syncingUpdatedTableIds removeAllObjects];
-		if (amountLeft == 0)
-			return;
-		
-		[updatedTableIds.copy enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull table, NSMutableDictionary<NSNumber *,NSMutableSet *> * _Nonnull ids, BOOL * _Nonnull stop) {
-			
-			if (ids.count > amountLeft)
-			{
-				NSMutableDictionary *subDic = [[NSMutableDictionary alloc] initWithCapacity:amountLeft];
-				NSRange range = NSMakeRange(0, amountLeft);
-				NSArray *keys = [ids.allKeys subarrayWithRange:range];
-				for (NSNumber *key in keys)
-				{
-					subDic[key] = ids[key];
-				}
-				syncingUpdatedTableIds[table] = subDic;
-				[ids removeObjectsForKeys:keys];
-				*stop = YES;
-				amountLeft = 0;
-				self.syncOptions |= SyncOptionsPartialSync;
-			}
-			else
-			{
-				syncingUpdatedTableIds[table] = ids;
-				[updatedTableIds removeObjectForKey:table];
-				amountLeft -= ids.count;
-			}
-		}];
-		
-		if (syncingUpdatedTableIds.count)
-		{
-			self.hasChanges = YES;
-		}
+		hasBatch = hasSyncingBatch;
 	});
+	if (!hasBatch)
+		[self loadSyncingBatch];
 	return syncingUpdatedTableIds;
 }
 
@@ -350,7 +720,7 @@
 	dispatch_sync(queue, ^{
 		[syncingCreatedTableIds removeObjectForKey:tableClass];
 	});
-	self.hasChanges = YES;
+	[self acknowledgeOp:AutoSyncLogOpCreate forClass:tableClass];
 }
 
 - (void) syncUpdatedComplete:(NSString*)tableClass
@@ -358,62 +728,91 @@
 	dispatch_sync(queue, ^{
 		[syncingUpdatedTableIds removeObjectForKey:tableClass];
 	});
-	self.hasChanges = YES;
+	[self acknowledgeOp:AutoSyncLogOpUpdate forClass:tableClass];
+}
+
+- (void) acknowledgeOp:(AutoSyncLogOp)op forClass:(NSString*)tableClass
+{
+	long long endSeq = self.syncingSeq;
+	if (endSeq == 0)
+		return;
+	[self.class executeInDatabase:^(AFMDatabase * _Nonnull db) {
+		[db executeUpdate:[NSString stringWithFormat:@"DELETE FROM %@ WHERE seq <= ? AND table_name = ? AND op = %i", AUTO_SYNC_LOG_TABLE, (int)op], @(endSeq), tableClass];
+	}];
+}
+
+- (void) acknowledgeIds:(NSArray<NSNumber*> *)ids op:(AutoSyncLogOp)op forClass:(NSString*)tableClass throughSeq:(long long)endSeq
+{
+	if (ids.count == 0 || endSeq == 0)
+		return;
+	dispatch_sync(queue, ^{
+		if (op == AutoSyncLogOpCreate)
+			[syncingCreatedTableIds[tableClass] removeObjectsInArray:ids];
+		else
+			[syncingUpdatedTableIds[tableClass] removeObjectsForKeys:ids];
+	});
+	[self rewroteLog];
+	[self.class executeInDatabase:^(AFMDatabase * _Nonnull db) {
+		
+		BOOL transaction = !db.inTransaction;
+		if (transaction)
+			[db beginTransaction];
+		NSString *deleteQuery = [NSString stringWithFormat:@"DELETE FROM %@ WHERE seq <= ? AND table_name = ? AND op = %i AND row_id IN (%@)", AUTO_SYNC_LOG_TABLE, (int)op, [AutoModel questionMarks:AUTO_SYNC_ACK_IDS]];
+		[db cacheStatementForQuery:deleteQuery];
+		for (NSUInteger index = 0; index < ids.count; index += AUTO_SYNC_ACK_IDS)
+		{
+			//fixed width so it is prepared once, the last chunk repeats its last id.
+			NSMutableArray *arguments = [NSMutableArray arrayWithObjects:@(endSeq), tableClass, nil];
+			[arguments addObjectsFromArray:[ids subarrayWithRange:NSMakeRange(index, MIN(AUTO_SYNC_ACK_IDS, ids.count - index))]];
+			while (arguments.count < AUTO_SYNC_ACK_IDS + 2)
+				[arguments addObject:arguments.lastObject];
+			[db executeUpdate:deleteQuery withArgumentsInArray:arguments];
+		}
+		if (transaction)
+			[db commit];
+	}];
 }
 
 - (void) setupResync
 {
 	dispatch_sync(queue, ^{
 		[syncingCreatedTableIds removeAllObjects];
-		[createdTableIds removeAllObjects];
 		[syncingUpdatedTableIds removeAllObjects];
-		[updatedTableIds removeAllObjects];
+		hasSyncingBatch = NO;
 	});
-	self.hasChanges = YES;
+	self.syncingSeq = 0;
+	[self rewroteLog];
+	[self.class executeInDatabase:^(AFMDatabase * _Nonnull db) {
+		[db executeUpdate:[NSString stringWithFormat:@"DELETE FROM %@", AUTO_SYNC_LOG_TABLE]];
+	}];
 }
 
 - (void) syncComplete
 {
+	long long endSeq = self.syncingSeq;
 	dispatch_sync(queue, ^{
 		[syncingCreatedTableIds removeAllObjects];
 		[syncingUpdatedTableIds removeAllObjects];
+		hasSyncingBatch = NO;
 	});
-	self.hasChanges = YES;
+	self.syncingSeq = 0;
+	if (endSeq == 0)
+		return;
+	[self.class executeInDatabase:^(AFMDatabase * _Nonnull db) {
+		[db executeUpdate:[NSString stringWithFormat:@"DELETE FROM %@ WHERE seq <= ?", AUTO_SYNC_LOG_TABLE], @(endSeq)];
+	}];
 }
 
 - (void) reimburseActions
 {
-	//put back everything again!
+	//put back everything again! The batch is still in the log, so it just becomes pending together with newer changes.
 	dispatch_sync(queue, ^{
-		
-		[syncingCreatedTableIds enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull table, NSMutableArray<NSNumber *> * _Nonnull ids, BOOL * _Nonnull stop) {
-			if (!createdTableIds[table])
-			{
-				createdTableIds[table] = ids;
-				return;
-			}
-			[createdTableIds[table] addObjectsFromArray:ids];
-		}];
-		
-		[syncingUpdatedTableIds enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull table, NSMutableDictionary<NSNumber *,NSMutableSet *> * _Nonnull ids, BOOL * _Nonnull stop) {
-			
-			if (!updatedTableIds[table])
-			{
-				updatedTableIds[table] = ids;
-				return;
-			}
-			for (NSNumber *idValue in ids)
-			{
-				NSMutableSet *object = updatedTableIds[table][idValue];
-				if (object)
-					[ids[idValue] addObjectsFromArray:object.allObjects];	//replace if there are newer changes
-				updatedTableIds[table][idValue] = ids[idValue];
-			}
-		}];
 		[syncingCreatedTableIds removeAllObjects];
 		[syncingUpdatedTableIds removeAllObjects];
+		hasSyncingBatch = NO;
 	});
-	self.hasChanges = YES;
+	self.syncingSeq = 0;
+	[self rewroteLog];
 }
 
 - (void)setDeleteTables:(NSDictionary *)deleteTables
@@ -425,17 +824,12 @@
 - (NSData *)data
 {
 	__block NSData *archive;
-	
-	//we cannot use numbers as keys, so you must convert back and forth manually
+
+	//pending changes live in the log, only small state is archived.
 	dispatch_sync(queue, ^{
-		
+
 		NSMutableDictionary *data = [NSMutableDictionary new];
-		data[@"updatedTableIds"] = updatedTableIds;
-		data[@"createdTableIds"] = createdTableIds;
-		if (syncingCreatedTableIds)
-			data[@"syncingCreatedTableIds"] = syncingCreatedTableIds;
-		if (syncingUpdatedTableIds)
-			data[@"syncingUpdatedTableIds"] = syncingUpdatedTableIds;
+		data[@"syncWindow"] = self.syncWindow.state;
 		if (self.deleteTables)
 			data[@"deleteTables"] = self.deleteTables;
 		NSError *error = nil;
@@ -942,6 +942,40 @@
 @end
 
 
+/** Diagnostics for how statements are executed.
+ 
+ When enabled, each distinct statement is run through `EXPLAIN QUERY PLAN` the first time it is executed, and every execution is timed. Full table scans and temporary b-trees (sorting without an index) are recorded per table - which is the same as per model class for AutoDB - and `report` suggests indexes to add in `+columnIndex`.
+ 
+ @warning This is for debugging only, it slows down every statement.
+ */
+
+@interface AFMQueryPlanInspector : NSObject
+
++ (instancetype)sharedInspector;
+
+/** Turn inspection on or off for all databases. */
+
+@property (atomic, assign, getter=isEnabled) BOOL enabled;
+
+/** Statements that scan a whole table or sort in a temp b-tree, per table. Each entry has the keys "query", "plan", "fullScan", "tempBTree", "executions" and "totalTime". */
+
+- (NSDictionary <NSString*, NSArray <NSDictionary*>*>*)problemsByTable;
+
+/** Suggested index definitions per table, in the form used by `AUTO_INDEX_SPECIFIC`, e.g. "(parent_id, date)". */
+
+- (NSDictionary <NSString*, NSArray <NSString*>*>*)suggestedIndexes;
+
+/** A readable report of all problems sorted by total execution time, followed by suggested indexes. */
+
+- (NSString*)report;
+
+/** Forget everything recorded so far. */
+
+- (void)reset;
+
+@end
+
+
 /** Objective-C wrapper for `sqlite3_stmt`
  
  This is a wrapper for a SQLite `sqlite3_stmt`. Generally when using FMDB you will not need to interact directly with `FMStatement`, but rather with `<FMDatabase>` and `<FMResultSet>` only.
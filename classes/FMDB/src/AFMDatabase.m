@@ -8,6 +8,14 @@
 - (BOOL)executeUpdate:(NSString*)sql error:(NSError**)outErr withArgumentsInArray:(NSArray*)arrayArgs orDictionary:(NSDictionary *)dictionaryArgs orVAList:(va_list)args;
 @end
 
+@interface AFMQueryPlanInspector ()
+- (void)inspectQuery:(NSString*)sql inDatabase:(sqlite3*)db;
+- (void)recordExecution:(NSString*)sql duration:(CFAbsoluteTime)duration;
+@end
+
+//checked for every statement, so we don't want to message the inspector when it's off.
+static BOOL inspectQueryPlans = NO;
+
 @implementation AFMDatabase
 @synthesize cachedStatements=_cachedStatements;
 @synthesize logsErrors=_logsErrors;
@@ -260,6 +268,11 @@
 
 - (void)resultSetDidClose:(AFMResultSet *)resultSet
 {
+	if (resultSet.executionStartTime)
+	{
+		[[AFMQueryPlanInspector sharedInspector] recordExecution:resultSet.query duration:CFAbsoluteTimeGetCurrent() - resultSet.executionStartTime];
+		resultSet.executionStartTime = 0;
+	}
 	NSValue *setValue = [NSValue valueWithNonretainedObject:resultSet];
 	[_openResultSets removeObject:setValue];
 }
@@ -1031,6 +1044,10 @@ typedef NS_ENUM(NSInteger, AutoFieldType)
 	{
 		NSLog(@"%@ executeQuery: %@", self, sql);
 	}
+	if (inspectQueryPlans && sql)
+	{
+		[[AFMQueryPlanInspector sharedInspector] inspectQuery:sql inDatabase:_db];
+	}
 	
     FMStatement *statement = [self cachedStatementForQuery:sql];
 	if (statement)
@@ -1151,6 +1168,12 @@ typedef NS_ENUM(NSInteger, AutoFieldType)
 	rs = [AFMResultSet resultSetWithStatement:statement usingParentDatabase:self];
 	[rs setQuery:sql];
 	
+	if (inspectQueryPlans)
+	{
+		//rows are stepped by the result set, so we time until it is closed.
+		rs.executionStartTime = CFAbsoluteTimeGetCurrent();
+	}
+	
 	NSValue *openResultSet = [NSValue valueWithNonretainedObject:rs];
 	[_openResultSets addObject:openResultSet];
 	
@@ -1222,6 +1245,10 @@ typedef NS_ENUM(NSInteger, AutoFieldType)
 	{
 		NSLog(@"%@ executeUpdate: %@", self, sql);
 	}
+	if (inspectQueryPlans && sql)
+	{
+		[[AFMQueryPlanInspector sharedInspector] inspectQuery:sql inDatabase:_db];
+	}
 	
     //we might cache some statements but don't want to force caching of all.
     FMStatement *cachedStmt = [self cachedStatementForQuery:sql];
@@ -1344,7 +1371,12 @@ typedef NS_ENUM(NSInteger, AutoFieldType)
 	 ** executed is not a SELECT statement, we assume no data will be returned.
 	 */
 	
+	CFAbsoluteTime startTime = inspectQueryPlans ? CFAbsoluteTimeGetCurrent() : 0;
 	rc = sqlite3_step(preparedStatement);
+	if (startTime && sql)
+	{
+		[[AFMQueryPlanInspector sharedInspector] recordExecution:sql duration:CFAbsoluteTimeGetCurrent() - startTime];
+	}
 	
 	if (SQLITE_DONE == rc)
 	{
@@ -1866,4 +1898,295 @@ static dispatch_queue_t queue = nil;
 }
 
 
+@end
+
+#pragma mark - query plan inspection
+
+@interface AFMQueryPlanEntry : NSObject
+
+@property (nonatomic) NSString *query;
+@property (nonatomic) NSArray <NSString*>*plan;
+@property (nonatomic) NSString *mainTable;
+@property (nonatomic) NSMutableSet <NSString*>*fullScanTables;
+@property (nonatomic) BOOL tempBTree;
+@property (nonatomic) NSUInteger executions;
+@property (nonatomic) CFAbsoluteTime totalTime;
+
+@end
+
+@implementation AFMQueryPlanEntry
+@end
+
+@implementation AFMQueryPlanInspector
+{
+	dispatch_queue_t inspectorQueue;
+	NSMutableDictionary <NSString*, AFMQueryPlanEntry*>*entries;
+}
+
++ (instancetype)sharedInspector
+{
+	static AFMQueryPlanInspector *sharedInspector = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^(void)
+	{
+		sharedInspector = [self new];
+	});
+	return sharedInspector;
+}
+
+- (instancetype)init
+{
+	self = [super init];
+	inspectorQueue = dispatch_queue_create("AFMQueryPlanInspector", NULL);
+	entries = [NSMutableDictionary new];
+	return self;
+}
+
+- (BOOL)isEnabled
+{
+	return inspectQueryPlans;
+}
+
+- (void)setEnabled:(BOOL)enabled
+{
+	inspectQueryPlans = enabled;
+}
+
+- (void)reset
+{
+	dispatch_sync(inspectorQueue, ^(void)
+	{
+		[self->entries removeAllObjects];
+	});
+}
+
+//Called before the statement is executed, on the thread owning the connection.
+- (void)inspectQuery:(NSString*)sql inDatabase:(sqlite3*)db
+{
+	__block BOOL isKnown = NO;
+	dispatch_sync(inspectorQueue, ^(void)
+	{
+		isKnown = self->entries[sql] != nil;
+	});
+	if (isKnown)
+		return;
+	
+	AFMQueryPlanEntry *entry = [AFMQueryPlanEntry new];
+	entry.query = sql;
+	entry.fullScanTables = [NSMutableSet new];
+	NSMutableArray <NSString*>*plan = [NSMutableArray new];
+	entry.plan = plan;
+	
+	//only explain statements that reads rows, inserts and schema changes are not interesting.
+	NSCharacterSet *whitespace = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+	NSString *command = [[sql stringByTrimmingCharactersInSet:whitespace] componentsSeparatedByCharactersInSet:whitespace].firstObject.uppercaseString;
+	if ([@[@"SELECT", @"UPDATE", @"DELETE", @"WITH"] containsObject:command])
+	{
+		sqlite3_stmt *explain = 0x00;
+		NSString *explainQuery = [@"EXPLAIN QUERY PLAN " stringByAppendingString:sql];
+		if (sqlite3_prepare_v2(db, [explainQuery UTF8String], -1, &explain, 0) == SQLITE_OK)
+		{
+			while (sqlite3_step(explain) == SQLITE_ROW)
+			{
+				//columns are: id, parent, notused, detail
+				const char *detail = (const char *)sqlite3_column_text(explain, 3);
+				if (detail)
+					[plan addObject:[NSString stringWithUTF8String:detail]];
+			}
+		}
+		sqlite3_finalize(explain);
+	}
+	
+	for (NSString *detail in plan)
+	{
+		if ([detail hasPrefix:@"USE TEMP B-TREE"])
+		{
+			entry.tempBTree = YES;
+			continue;
+		}
+		NSArray <NSString*>*words = [detail componentsSeparatedByString:@" "];
+		if (words.count < 2 || ([words[0] isEqualToString:@"SCAN"] == NO && [words[0] isEqualToString:@"SEARCH"] == NO))
+			continue;
+		
+		//older versions of sqlite says "SCAN TABLE name", newer just "SCAN name"
+		NSUInteger index = [words[1] isEqualToString:@"TABLE"] ? 2 : 1;
+		if (index >= words.count)
+			continue;
+		NSString *table = words[index];
+		if ([table isEqualToString:@"SUBQUERY"] || [table isEqualToString:@"CONSTANT"] || [table hasPrefix:@"("])
+			continue;
+		if (!entry.mainTable)
+			entry.mainTable = table;
+		if ([words[0] isEqualToString:@"SCAN"] && [detail rangeOfString:@"INDEX"].location == NSNotFound)
+			[entry.fullScanTables addObject:table];
+	}
+	
+	dispatch_sync(inspectorQueue, ^(void)
+	{
+		if (!self->entries[sql])
+			self->entries[sql] = entry;
+	});
+}
+
+- (void)recordExecution:(NSString*)sql duration:(CFAbsoluteTime)duration
+{
+	dispatch_async(inspectorQueue, ^(void)
+	{
+		AFMQueryPlanEntry *entry = self->entries[sql];
+		entry.executions++;
+		entry.totalTime += duration;
+	});
+}
+
+- (NSArray <AFMQueryPlanEntry*>*)problemEntries
+{
+	NSMutableArray <AFMQueryPlanEntry*>*problems = [NSMutableArray new];
+	dispatch_sync(inspectorQueue, ^(void)
+	{
+		for (AFMQueryPlanEntry *entry in self->entries.objectEnumerator)
+		{
+			if (entry.fullScanTables.count || (entry.tempBTree && entry.mainTable))
+				[problems addObject:entry];
+		}
+	});
+	[problems sortUsingComparator:^NSComparisonResult(AFMQueryPlanEntry *first, AFMQueryPlanEntry *second)
+	{
+		return [@(second.totalTime) compare:@(first.totalTime)];
+	}];
+	return problems;
+}
+
+- (NSDictionary <NSString*, NSArray <NSDictionary*>*>*)problemsByTable
+{
+	NSMutableDictionary <NSString*, NSMutableArray <NSDictionary*>*>*problemsByTable = [NSMutableDictionary new];
+	for (AFMQueryPlanEntry *entry in [self problemEntries])
+	{
+		NSMutableSet *tables = entry.fullScanTables.mutableCopy;
+		if (entry.tempBTree && entry.mainTable)
+			[tables addObject:entry.mainTable];
+		for (NSString *table in tables)
+		{
+			if (!problemsByTable[table])
+				problemsByTable[table] = [NSMutableArray new];
+			[problemsByTable[table] addObject:@{ @"query" : entry.query,
+												 @"plan" : [entry.plan componentsJoinedByString:@"; "],
+												 @"fullScan" : @([entry.fullScanTables containsObject:table]),
+												 @"tempBTree" : @(entry.tempBTree && [entry.mainTable isEqualToString:table]),
+												 @"executions" : @(entry.executions),
+												 @"totalTime" : @(entry.totalTime) }];
+		}
+	}
+	return problemsByTable;
+}
+
+- (NSDictionary <NSString*, NSArray <NSString*>*>*)suggestedIndexes
+{
+	NSMutableDictionary <NSString*, NSMutableOrderedSet <NSString*>*>*suggestions = [NSMutableDictionary new];
+	for (AFMQueryPlanEntry *entry in [self problemEntries])
+	{
+		//we can only guess columns for statements on a single table
+		if (!entry.mainTable || entry.fullScanTables.count > 1)
+			continue;
+		NSString *index = [self suggestedIndexForQuery:entry.query];
+		if (!index)
+			continue;
+		if (!suggestions[entry.mainTable])
+			suggestions[entry.mainTable] = [NSMutableOrderedSet new];
+		[suggestions[entry.mainTable] addObject:index];
+	}
+	NSMutableDictionary <NSString*, NSArray <NSString*>*>*result = [NSMutableDictionary new];
+	[suggestions enumerateKeysAndObjectsUsingBlock:^(NSString *table, NSMutableOrderedSet *indexes, BOOL *stop)
+	{
+		result[table] = indexes.array;
+	}];
+	return result;
+}
+
+//Equality columns first, then one range column, then the sort - the order sqlite can use them in.
+- (NSString*)suggestedIndexForQuery:(NSString*)query
+{
+	NSString *upperQuery = query.uppercaseString;
+	NSRange whereRange = [upperQuery rangeOfString:@" WHERE " options:NSBackwardsSearch];
+	NSRange orderRange = [upperQuery rangeOfString:@" ORDER BY " options:NSBackwardsSearch];
+	NSUInteger whereEnd = orderRange.location != NSNotFound ? orderRange.location : query.length;
+	NSUInteger orderEnd = query.length;
+	for (NSString *ending in @[@" GROUP BY ", @" LIMIT "])
+	{
+		NSRange range = [upperQuery rangeOfString:ending options:NSBackwardsSearch];
+		if (range.location != NSNotFound && range.location < whereEnd)
+			whereEnd = range.location;
+		if (range.location != NSNotFound && orderRange.location != NSNotFound && range.location > orderRange.location && range.location < orderEnd)
+			orderEnd = range.location;
+	}
+	
+	NSMutableOrderedSet <NSString*>*columns = [NSMutableOrderedSet new];
+	NSSet *ignored = [NSSet setWithObjects:@"id", @"rowid", @"and", @"or", @"not", @"null", @"where", nil];
+	if (whereRange.location != NSNotFound && NSMaxRange(whereRange) < whereEnd)
+	{
+		NSString *clause = [query substringWithRange:NSMakeRange(NSMaxRange(whereRange), whereEnd - NSMaxRange(whereRange))];
+		NSArray *patterns = @[@"([A-Za-z_][A-Za-z0-9_]*)\\s*(?:==|=|\\bIN\\b|\\bIS\\b)", @"([A-Za-z_][A-Za-z0-9_]*)\\s*(?:<=|>=|<|>|\\bBETWEEN\\b|\\bLIKE\\b)"];
+		for (NSUInteger patternIndex = 0; patternIndex < patterns.count; patternIndex++)
+		{
+			NSRegularExpression *expression = [NSRegularExpression regularExpressionWithPattern:patterns[patternIndex] options:NSRegularExpressionCaseInsensitive error:nil];
+			NSArray <NSTextCheckingResult*>*matches = [expression matchesInString:clause options:0 range:NSMakeRange(0, clause.length)];
+			for (NSTextCheckingResult *match in matches)
+			{
+				NSString *column = [clause substringWithRange:[match rangeAtIndex:1]];
+				if ([ignored containsObject:column.lowercaseString] == NO)
+				{
+					[columns addObject:column];
+					//only the first range column can use the index
+					if (patternIndex == 1)
+						break;
+				}
+			}
+		}
+	}
+	if (orderRange.location != NSNotFound && NSMaxRange(orderRange) < orderEnd)
+	{
+		NSString *clause = [query substringWithRange:NSMakeRange(NSMaxRange(orderRange), orderEnd - NSMaxRange(orderRange))];
+		for (NSString *part in [clause componentsSeparatedByString:@","])
+		{
+			NSString *column = [[part stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]] componentsSeparatedByString:@" "].firstObject;
+			if (column.length && [column rangeOfString:@"("].location == NSNotFound && [ignored containsObject:column.lowercaseString] == NO)
+				[columns addObject:column];
+		}
+	}
+	if (columns.count == 0)
+		return nil;
+	return [NSString stringWithFormat:@"(%@)", [columns.array componentsJoinedByString:@", "]];
+}
+
+- (NSString*)report
+{
+	NSArray <AFMQueryPlanEntry*>*problems = [self problemEntries];
+	__block NSUInteger inspectedCount = 0;
+	dispatch_sync(inspectorQueue, ^(void)
+	{
+		inspectedCount = self->entries.count;
+	});
+	
+	NSMutableString *report = [NSMutableString stringWithFormat:@"Query plans: %lu statements inspected, %lu without proper indexes.\n", (unsigned long)inspectedCount, (unsigned long)problems.count];
+	for (AFMQueryPlanEntry *entry in problems)
+	{
+		NSMutableArray *kinds = [NSMutableArray new];
+		if (entry.fullScanTables.count)
+			[kinds addObject:[NSString stringWithFormat:@"FULL SCAN of %@", [entry.fullScanTables.allObjects componentsJoinedByString:@", "]]];
+		if (entry.tempBTree)
+			[kinds addObject:@"TEMP B-TREE"];
+		[report appendFormat:@"\n%@: %@ - %lu executions, %.2f ms total\n\t%@\n\t%@\n", entry.mainTable, [kinds componentsJoinedByString:@" and "], (unsigned long)entry.executions, entry.totalTime * 1000, entry.query, [entry.plan componentsJoinedByString:@"; "]];
+	}
+	
+	NSDictionary <NSString*, NSArray <NSString*>*>*suggestions = [self suggestedIndexes];
+	if (suggestions.count)
+	{
+		[report appendString:@"\nSuggested indexes, add to +columnIndex:\n"];
+		[suggestions enumerateKeysAndObjectsUsingBlock:^(NSString *table, NSArray <NSString*>*indexes, BOOL *stop)
+		{
+			[report appendFormat:@"%@: AUTO_INDEX_SPECIFIC : @[@\"%@\"]\n", table, [indexes componentsJoinedByString:@"\", @\""]];
+		}];
+	}
+	return report;
+}
+
 @end
@@ -54,6 +54,10 @@
 
 @property (atomic, retain) FMStatement *statement;
 
+/** When the query was executed, only set while `<AFMQueryPlanInspector>` is enabled. */
+
+@property (atomic, assign) CFAbsoluteTime executionStartTime;
+
 ///------------------------------------
 /// @name Creating and closing database
 ///------------------------------------